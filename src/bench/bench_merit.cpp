@@ -5,7 +5,9 @@
 
 #include "bench.h"
 
+#include "chainparams.h"
 #include "crypto/sha256.h"
+#include "fs.h"
 #include "key.h"
 #include "validation.h"
 #include "util.h"
@@ -20,7 +22,14 @@ main(int argc, char** argv)
     SetupEnvironment();
     fPrintToDebugLog = false; // don't want to write to debug.log file
 
+    // Benchmarks of the referral DB open it under the data dir.
+    SelectParams(CBaseChainParams::REGTEST);
+    const fs::path path = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(path);
+    gArgs.ForceSetArg("-datadir", path.string());
+
     benchmark::BenchRunner::RunAll();
 
+    fs::remove_all(path);
     ECC_Stop();
 }
@@ -0,0 +1,216 @@
+// Copyright (c) 2017-2021 The Merit Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chainparams.h"
+#include "key.h"
+#include "pog3/cgsstate.h"
+#include "pog3/snapshot.h"
+#include "random.h"
+#include "referrals.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include <boost/thread.hpp>
+
+#include <limits>
+#include <vector>
+
+// These benchmarks replay a synthetic regtest chain the way IBD connects
+// blocks: RewardAmbassadors runs the lottery of every block on the tip before
+// it, then the block's confirmed and staked beacons are inserted and fed to
+// pog3::CGSState like ConnectBlock does. The chain starts at
+// pog2_blockheight. The pog2 benchmarks keep pog3 off to stay in the pog2
+// era, the pog3 ones connect the pog2 blocks before timing so the state is
+// carried across pog3_blockheight like on a real chain.
+//
+// The incremental benchmarks carry the CGS state across blocks like the
+// node does now. The rebuild ones drop it before every lottery, so each one
+// walks the referral DB like it used to.
+static const int INITIAL_BEACONS = 1000;
+static const int BEACONS_PER_BLOCK = 10;
+static const CAmount BEACON_STAKE = 100 * COIN;
+
+namespace
+{
+    class SyntheticChain
+    {
+    public:
+        explicit SyntheticChain(const Consensus::Params& params) :
+            m_params{params},
+            m_blocktree{1 << 20, true},
+            m_db{1 << 20, true, true, "bench_referrals"},
+            m_cache{&m_db}
+        {
+            pblocktree = &m_blocktree;
+            prefviewdb = &m_db;
+            prefviewcache = &m_cache;
+            pog3::SetupCgsThreadPool(boost::thread::hardware_concurrency());
+            pog3::GetCgsState().Invalidate();
+
+            AddBeacon(m_params.genesis_address, referral::Address{}, 0, true);
+            for (int i = 1; i < INITIAL_BEACONS; i++) {
+                AddBeacon(RandomParent(), 0);
+            }
+            WriteCoins();
+
+            m_height = m_params.pog2_blockheight - 1;
+            m_tip = m_rand.rand256();
+        }
+
+        ~SyntheticChain()
+        {
+            pog3::GetCgsState().Invalidate();
+            pog3::ClearCgsSnapshots();
+            prefviewcache = nullptr;
+            prefviewdb = nullptr;
+            pblocktree = nullptr;
+        }
+
+        int Height() const
+        {
+            return m_height;
+        }
+
+        /** Runs the lottery of the next block and connects it. */
+        void ConnectBlock(bool rebuild)
+        {
+            const int height = m_height + 1;
+
+            if (rebuild) {
+                pog3::GetCgsState().Invalidate();
+            }
+
+            const auto lottery = RewardAmbassadors(
+                    height,
+                    m_tip,
+                    GetSplitSubsidy(height, m_params).ambassador,
+                    m_params);
+            assert(!std::get<0>(lottery).winners.empty());
+
+            referral::ReferralRefs refs;
+            for (int i = 0; i < BEACONS_PER_BLOCK; i++) {
+                refs.push_back(AddBeacon(RandomParent(), height));
+            }
+            WriteCoins();
+
+            const auto prev = m_tip;
+            m_tip = m_rand.rand256();
+            m_height = height;
+            pog3::GetCgsState().BlockConnected(m_tip, prev, m_height, refs);
+        }
+
+    private:
+        referral::ReferralRef AddBeacon(
+                const referral::Address& parent,
+                int height,
+                bool allow_no_parent = false)
+        {
+            CKey key;
+            key.MakeNewKey(true);
+            return AddBeacon(key.GetPubKey().GetID(), parent, height, allow_no_parent);
+        }
+
+        referral::ReferralRef AddBeacon(
+                const referral::Address& address,
+                const referral::Address& parent,
+                int height,
+                bool allow_no_parent)
+        {
+            CKey key;
+            key.MakeNewKey(true);
+            const auto ref = referral::MakeReferralRef(referral::MutableReferral{
+                    1, address, key.GetPubKey(), parent});
+
+            const bool inserted = m_db.InsertReferral(height, *ref, allow_no_parent, false);
+            assert(inserted);
+
+            //Only confirmed beacons can win, like ones that received an invite.
+            CAmount invites = 0;
+            const bool confirmed = m_db.UpdateConfirmation(1, address, 1, invites);
+            assert(confirmed);
+
+            m_addresses.push_back(address);
+            m_coins.emplace_back(
+                    CAddressUnspentKey{1, address, m_rand.rand256(), 0, false, false},
+                    CAddressUnspentValue{BEACON_STAKE, CScript{}, height});
+            return ref;
+        }
+
+        void WriteCoins()
+        {
+            const bool written = m_blocktree.UpdateAddressUnspentIndex(m_coins);
+            assert(written);
+            m_coins.clear();
+        }
+
+        const referral::Address& RandomParent()
+        {
+            return m_addresses[m_rand.randrange(m_addresses.size())];
+        }
+
+        const Consensus::Params& m_params;
+        FastRandomContext m_rand{true};
+        CBlockTreeDB m_blocktree;
+        referral::ReferralsViewDB m_db;
+        referral::ReferralsViewCache m_cache;
+        std::vector<referral::Address> m_addresses;
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>> m_coins;
+        uint256 m_tip;
+        int m_height = 0;
+    };
+
+    Consensus::Params Pog2Params()
+    {
+        auto params = Params().GetConsensus();
+        params.pog3_blockheight = std::numeric_limits<int>::max();
+        return params;
+    }
+
+    void Replay(
+            benchmark::State& state,
+            const Consensus::Params& params,
+            int first_height,
+            bool rebuild)
+    {
+        LOCK(cs_main);
+        SyntheticChain chain{params};
+        while (chain.Height() + 1 < first_height) {
+            chain.ConnectBlock(false);
+        }
+
+        while (state.KeepRunning()) {
+            chain.ConnectBlock(rebuild);
+        }
+    }
+}
+
+static void CGSReplayPog2Incremental(benchmark::State& state)
+{
+    const auto params = Pog2Params();
+    Replay(state, params, params.pog2_blockheight, false);
+}
+
+static void CGSReplayPog2Rebuild(benchmark::State& state)
+{
+    const auto params = Pog2Params();
+    Replay(state, params, params.pog2_blockheight, true);
+}
+
+static void CGSReplayPog3Incremental(benchmark::State& state)
+{
+    const auto& params = Params().GetConsensus();
+    Replay(state, params, params.pog3_blockheight, false);
+}
+
+static void CGSReplayPog3Rebuild(benchmark::State& state)
+{
+    const auto& params = Params().GetConsensus();
+    Replay(state, params, params.pog3_blockheight, true);
+}
+
+BENCHMARK(CGSReplayPog2Incremental);
+BENCHMARK(CGSReplayPog2Rebuild);
+BENCHMARK(CGSReplayPog3Incremental);
+BENCHMARK(CGSReplayPog3Rebuild);
@@ -0,0 +1,38 @@
+// Copyright (c) 2017-2021 The Merit Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "key.h"
+#include "refdb.h"
+
+// Inserts beacons under a parent that already has many children, like the
+// genesis address or a large ambassador.
+static const int WIDE_PARENT_CHILDREN = 100000;
+
+static referral::MutableReferral MakeBeacon(const referral::Address& parent)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    const auto pubkey = key.GetPubKey();
+    return referral::MutableReferral{1, pubkey.GetID(), pubkey, parent};
+}
+
+static void ReferralInsertWideParent(benchmark::State& state)
+{
+    referral::ReferralsViewDB db{1 << 20, true, true, "bench_referrals"};
+
+    const auto genesis = MakeBeacon(referral::Address{});
+    db.InsertReferral(0, genesis, true, false);
+
+    const auto parent = genesis.GetAddress();
+    for (int i = 0; i < WIDE_PARENT_CHILDREN; i++) {
+        db.InsertReferral(1, MakeBeacon(parent), false, false);
+    }
+
+    while (state.KeepRunning()) {
+        db.InsertReferral(2, MakeBeacon(parent), false, false);
+    }
+}
+
+BENCHMARK(ReferralInsertWideParent);
@@ -0,0 +1,79 @@
+// Copyright (c) 2017-2021 The Merit Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "dbwrapper.h"
+#include "random.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <vector>
+
+// Rewrites the ANVs of a block's worth of addresses and compacts them. Once
+// with the ANVs sharing a database with the referrals themselves, like the
+// referrals database used to, and once with the ANVs in a database of their
+// own.
+static const int REFERRALS = 50000;
+static const int REFERRAL_SIZE = 200;
+static const int ANV_UPDATES_PER_BLOCK = 2000;
+
+static const char DB_REFERRALS = 'r';
+static const char DB_ANV = 'a';
+
+static std::vector<uint160> WriteReferrals(CDBWrapper& db, FastRandomContext& rand)
+{
+    std::vector<uint160> addresses;
+    addresses.reserve(REFERRALS);
+
+    CDBBatch batch(db);
+    for (int i = 0; i < REFERRALS; i++) {
+        addresses.emplace_back(rand.randbytes(20));
+        batch.Write(std::make_pair(DB_REFERRALS, addresses.back()), rand.randbytes(REFERRAL_SIZE));
+    }
+
+    db.WriteBatch(batch);
+    return addresses;
+}
+
+static void WriteANVs(CDBWrapper& db, const std::vector<uint160>& addresses, FastRandomContext& rand, int updates)
+{
+    CDBBatch batch(db);
+    for (int i = 0; i < updates; i++) {
+        const auto& address = addresses[rand.randrange(addresses.size())];
+        batch.Write(std::make_pair(DB_ANV, address), rand.rand64());
+    }
+
+    db.WriteBatch(batch);
+    db.CompactRange(DB_ANV, static_cast<char>(DB_ANV + 1));
+}
+
+static void ReferralANVCompactionShared(benchmark::State& state)
+{
+    FastRandomContext rand{true};
+    CDBWrapper db{GetDataDir() / "bench_referrals", 1 << 22, true, true};
+
+    const auto addresses = WriteReferrals(db, rand);
+    WriteANVs(db, addresses, rand, REFERRALS);
+
+    while (state.KeepRunning()) {
+        WriteANVs(db, addresses, rand, ANV_UPDATES_PER_BLOCK);
+    }
+}
+
+static void ReferralANVCompactionSplit(benchmark::State& state)
+{
+    FastRandomContext rand{true};
+    CDBWrapper db{GetDataDir() / "bench_referrals", 1 << 21, true, true, false, true};
+    CDBWrapper anv_db{GetDataDir() / "bench_referrals_anv", 1 << 21, true, true};
+
+    const auto addresses = WriteReferrals(db, rand);
+    WriteANVs(anv_db, addresses, rand, REFERRALS);
+
+    while (state.KeepRunning()) {
+        WriteANVs(anv_db, addresses, rand, ANV_UPDATES_PER_BLOCK);
+    }
+}
+
+BENCHMARK(ReferralANVCompactionShared);
+BENCHMARK(ReferralANVCompactionSplit);
@@ -0,0 +1,52 @@
+// Copyright (c) 2017-2021 The Merit Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// This file is built with AVX2 enabled. Its functions may only be called
+// after checking at runtime that the CPU supports AVX2.
+
+#include "crypto/siphashxN.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace siphash_avx2
+{
+size_t SipHash24(uint64_t k0, uint64_t k1, const uint64_t* nonces, size_t count, uint64_t* hashes)
+{
+    size_t i = 0;
+#if NSIPHASH == 8
+    const __m256i ff = _mm256_set1_epi64x(0xff);
+
+    for (; i + 8 <= count; i += 8) {
+        const __m256i packet0 = _mm256_loadu_si256((const __m256i*)(nonces + i));
+        const __m256i packet1 = _mm256_loadu_si256((const __m256i*)(nonces + i + 4));
+
+        __m256i v0, v1, v2, v3, v4, v5, v6, v7;
+        v0 = v4 = _mm256_set1_epi64x(k0 ^ 0x736f6d6570736575ULL);
+        v1 = v5 = _mm256_set1_epi64x(k1 ^ 0x646f72616e646f6dULL);
+        v2 = v6 = _mm256_set1_epi64x(k0 ^ 0x6c7967656e657261ULL);
+        v3 = v7 = _mm256_set1_epi64x(k1 ^ 0x7465646279746573ULL);
+
+        v3 = XOR(v3, packet0);
+        v7 = XOR(v7, packet1);
+        SIPROUNDX8;
+        SIPROUNDX8;
+        v0 = XOR(v0, packet0);
+        v4 = XOR(v4, packet1);
+        v2 = XOR(v2, ff);
+        v6 = XOR(v6, ff);
+        SIPROUNDX8;
+        SIPROUNDX8;
+        SIPROUNDX8;
+        SIPROUNDX8;
+        v0 = XOR(XOR(v0, v1), XOR(v2, v3));
+        v4 = XOR(XOR(v4, v5), XOR(v6, v7));
+
+        _mm256_storeu_si256((__m256i*)(hashes + i), v0);
+        _mm256_storeu_si256((__m256i*)(hashes + i + 4), v4);
+    }
+#endif
+    return i;
+}
+} // namespace siphash_avx2
@@ -17,6 +17,17 @@
 #include <stdint.h> // for types uint32_t,uint64_t
 #include <string.h> // for functions strlen, memset
 
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace siphash_avx2
+{
+// siphash24 of the nonces 8 at a time in the AVX2 lanes. Returns how many
+// were hashed, which is 0 if the kernel was built without AVX2.
+size_t SipHash24(uint64_t k0, uint64_t k1, const uint64_t* nonces, size_t count, uint64_t* hashes);
+}
+
 uint64_t siphash24(const siphash_keys* keys, const uint64_t nonce)
 {
     uint64_t v0 = keys->k0 ^ 0x736f6d6570736575ULL,
@@ -46,6 +57,55 @@ void setKeys(const char* header, const uint32_t headerlen, siphash_keys* keys)
     keys->k1 = htole64(((uint64_t*)hdrkey)[1]);
 }
 
+void setKeys(const uint256& hash, siphash_keys* keys)
+{
+    // Same string as hash.GetHex() without allocating it.
+    static const char hexmap[] = "0123456789abcdef";
+    char header[2 * sizeof(uint256)];
+    for (size_t i = 0; i < sizeof(uint256); i++) {
+        const uint8_t byte = hash.begin()[sizeof(uint256) - 1 - i];
+        header[2 * i] = hexmap[byte >> 4];
+        header[2 * i + 1] = hexmap[byte & 0xf];
+    }
+
+    setKeys(header, sizeof(header), keys);
+}
+
+static bool HaveAVX2()
+{
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+    uint32_t eax, ebx, ecx, edx;
+    // AVX2 also needs the OS to save the ymm registers, see OSXSAVE and XCR0.
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !((ecx >> 27) & 1)) {
+        return false;
+    }
+
+    uint32_t xcr0, xcr0_high;
+    __asm__("xgetbv" : "=a"(xcr0), "=d"(xcr0_high) : "c"(0));
+    if ((xcr0 & 6) != 6 || __get_cpuid_max(0, nullptr) < 7) {
+        return false;
+    }
+
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx >> 5) & 1;
+#else
+    return false;
+#endif
+}
+
+static const bool have_avx2 = HaveAVX2();
+
+void siphash24N(const siphash_keys* keys, const uint64_t* nonces, size_t count, uint64_t* hashes)
+{
+    size_t i = 0;
+    if (have_avx2) {
+        i = siphash_avx2::SipHash24(keys->k0, keys->k1, nonces, count, hashes);
+    }
+    for (; i < count; i++) {
+        hashes[i] = siphash24(keys, nonces[i]);
+    }
+}
+
 // generate edge endpoint in cuckoo graph without partition bit
 uint32_t _sipnode(const siphash_keys* keys, uint32_t mask, uint32_t nonce, uint32_t uorv)
 {
@@ -234,13 +294,6 @@ int VerifyCycle(const uint256& hash, uint8_t edgeBits, uint8_t proofSize, const
     // edge mask is a max valid value of an edge (max index of nodes array).
     uint32_t edgeMask = (1 << edgeBits) - 1;
 
-    auto hashStr = hash.GetHex();
-
-    setKeys(hashStr.c_str(), hashStr.size(), &keys);
-
-    std::vector<uint32_t> uvs(2 * proofSize);
-    uint32_t xor0 = 0, xor1 = 0;
-
     for (uint32_t n = 0; n < proofSize; n++) {
         if (cycle[n] > edgeMask) {
             return POW_TOO_BIG;
@@ -249,9 +302,25 @@ int VerifyCycle(const uint256& hash, uint8_t edgeBits, uint8_t proofSize, const
         if (n && cycle[n] <= cycle[n - 1]) {
             return POW_TOO_SMALL;
         }
+    }
+
+    setKeys(hash, &keys);
+
+    // hash both endpoints of every edge in one go so they fill the siphash lanes
+    std::vector<uint64_t> nonces(2 * proofSize);
+    std::vector<uint64_t> hashes(2 * proofSize);
+    for (uint32_t n = 0; n < proofSize; n++) {
+        nonces[2 * n] = 2 * static_cast<uint64_t>(cycle[n]);
+        nonces[2 * n + 1] = 2 * static_cast<uint64_t>(cycle[n]) + 1;
+    }
+    siphash24N(&keys, nonces.data(), nonces.size(), hashes.data());
 
-        xor0 ^= uvs[2 * n] = sipnode(&keys, edgeMask, cycle[n], 0);
-        xor1 ^= uvs[2 * n + 1] = sipnode(&keys, edgeMask, cycle[n], 1);
+    std::vector<uint32_t> uvs(2 * proofSize);
+    uint32_t xor0 = 0, xor1 = 0;
+
+    for (uint32_t n = 0; n < proofSize; n++) {
+        xor0 ^= uvs[2 * n] = (static_cast<uint32_t>(hashes[2 * n]) & edgeMask) << 1;
+        xor1 ^= uvs[2 * n + 1] = (static_cast<uint32_t>(hashes[2 * n + 1]) & edgeMask) << 1 | 1;
     }
 
     // matching endpoints imply zero xors
@@ -57,6 +57,12 @@ uint64_t siphash24(const siphash_keys* keys, const uint64_t nonce);
 // convenience function for extracting siphash keys from header
 void setKeys(const char* header, const uint32_t headerlen, siphash_keys* keys);
 
+// extract siphash keys from the hex string of a block hash without building it
+void setKeys(const uint256& hash, siphash_keys* keys);
+
+// siphash24 of count nonces, using the AVX2 lanes when the CPU has them
+void siphash24N(const siphash_keys* keys, const uint64_t* nonces, size_t count, uint64_t* hashes);
+
 // generate edge endpoint in cuckoo graph without partition bit
 uint32_t _sipnode(const siphash_keys* keys, uint32_t mask, uint32_t nonce, uint32_t uorv);
 
@@ -17,6 +17,7 @@
 #include "crypto/siphashxN.h"
 #include "tinyformat.h"
 #include <bitset>
+#include <memory>
 #include <condition_variable>
 #include <mutex>
 #include <pthread.h>
@@ -1040,8 +1041,6 @@ public:
     solver_ctx(
             ctpl::thread_pool& poolIn,
             size_t nThreadsIn,
-            const char* header,
-            const uint32_t headerlen,
             const uint32_t nTrims,
             const uint8_t proofSizeIn) : pool{poolIn}, nThreads{nThreadsIn}, proofSize{proofSizeIn}
     {
@@ -1050,8 +1049,16 @@ public:
         cycleus.reserve(proofSize);
         cyclevs.reserve(proofSize);
 
-        setKeys(header, headerlen, &trimmer->sip_keys);
+        cuckoo = 0;
+    }
 
+    // Starts solving for another header. The trimmer buckets are kept as
+    // they are since every round overwrites them before reading.
+    void setheader(const char* header, const uint32_t headerlen)
+    {
+        setKeys(header, headerlen, &trimmer->sip_keys);
+        uxymap.reset();
+        sols.clear();
         cuckoo = 0;
     }
 
@@ -1294,68 +1301,116 @@ public:
     }
 };
 
-template <typename offset_t, uint8_t EDGEBITS, uint8_t XBITS>
-bool run(const uint256& hash, uint8_t proofSize, std::set<uint32_t>& cycle, size_t nThreads, ctpl::thread_pool& pool)
+class CuckooSolver::Context
 {
-    assert(EDGEBITS >= MIN_EDGE_BITS && EDGEBITS <= MAX_EDGE_BITS);
+public:
+    virtual ~Context() {}
+    virtual bool Solve(const uint256& hash, std::set<uint32_t>& cycle) = 0;
+};
 
-    uint32_t nTrims = EDGEBITS >= 30 ? 96 : 68;
+template <typename offset_t, uint8_t EDGEBITS, uint8_t XBITS>
+class SolverContext : public CuckooSolver::Context
+{
+public:
+    SolverContext(ctpl::thread_pool& pool, size_t nThreads, uint8_t proofSize) :
+        ctx{pool, nThreads, EDGEBITS >= 30 ? 96u : 68u, proofSize}
+    {
+        assert(EDGEBITS >= MIN_EDGE_BITS && EDGEBITS <= MAX_EDGE_BITS);
+    }
 
-    auto hashStr = hash.GetHex();
+    bool Solve(const uint256& hash, std::set<uint32_t>& cycle) override
+    {
+        auto hashStr = hash.GetHex();
+        ctx.setheader(hashStr.c_str(), hashStr.size());
 
-    solver_ctx<offset_t, EDGEBITS, XBITS> ctx(pool, nThreads, hashStr.c_str(), hashStr.size(), nTrims, proofSize);
+        bool found = ctx.solve();
 
-    bool found = ctx.solve();
+        if (found) {
+            copy(ctx.sols.begin(), ctx.sols.begin() + ctx.sols.size(), inserter(cycle, cycle.begin()));
+        }
 
-    if (found) {
-        copy(ctx.sols.begin(), ctx.sols.begin() + ctx.sols.size(), inserter(cycle, cycle.begin()));
+        return found;
     }
 
-    return found;
-}
+private:
+    solver_ctx<offset_t, EDGEBITS, XBITS> ctx;
+};
 
-bool FindCycleAdvanced(const uint256& hash,
+static std::unique_ptr<CuckooSolver::Context> MakeContext(
     uint8_t edgeBits,
     uint8_t proofSize,
-    std::set<uint32_t>& cycle,
     size_t nThreads,
     ctpl::thread_pool& pool)
 {
     switch (edgeBits) {
     case 16:
-        return run<uint32_t, 16u, 0u>(hash, proofSize, cycle, nThreads, pool);
+        return std::unique_ptr<CuckooSolver::Context>{new SolverContext<uint32_t, 16u, 0u>(pool, nThreads, proofSize)};
     case 17:
-        return run<uint32_t, 17u, 1u>(hash, proofSize, cycle, nThreads, pool);
+        return std::unique_ptr<CuckooSolver::Context>{new SolverContext<uint32_t, 17u, 1u>(pool, nThreads, proofSize)};
     case 18:
-        return run<uint32_t, 18u, 1u>(hash, proofSize, cycle, nThreads, pool);
+        return std::unique_ptr<CuckooSolver::Context>{new SolverContext<uint32_t, 18u, 1u>(pool, nThreads, proofSize)};
     case 19:
-        return run<uint32_t, 19u, 2u>(hash, proofSize, cycle, nThreads, pool);
+        return std::unique_ptr<CuckooSolver::Context>{new SolverContext<uint32_t, 19u, 2u>(pool, nThreads, proofSize)};
     case 20:
-        return run<uint32_t, 20u, 2u>(hash, proofSize, cycle, nThreads, pool);
+        return std::unique_ptr<CuckooSolver::Context>{new SolverContext<uint32_t, 20u, 2u>(pool, nThreads, proofSize)};
     case 21:
-        return run<uint32_t, 21u, 3u>(hash, proofSize, cycle, nThreads, pool);
+        return std::unique_ptr<CuckooSolver::Context>{new SolverContext<uint32_t, 21u, 3u>(pool, nThreads, proofSize)};
     case 22:
-        return run<uint32_t, 22u, 3u>(hash, proofSize, cycle, nThreads, pool);
+        return std::unique_ptr<CuckooSolver::Context>{new SolverContext<uint32_t, 22u, 3u>(pool, nThreads, proofSize)};
     case 23:
-        return run<uint32_t, 23u, 4u>(hash, proofSize, cycle, nThreads, pool);
+        return std::unique_ptr<CuckooSolver::Context>{new SolverContext<uint32_t, 23u, 4u>(pool, nThreads, proofSize)};
     case 24:
-        return run<uint32_t, 24u, 4u>(hash, proofSize, cycle, nThreads, pool);
+        return std::unique_ptr<CuckooSolver::Context>{new SolverContext<uint32_t, 24u, 4u>(pool, nThreads, proofSize)};
     case 25:
-        return run<uint32_t, 25u, 5u>(hash, proofSize, cycle, nThreads, pool);
+        return std::unique_ptr<CuckooSolver::Context>{new SolverContext<uint32_t, 25u, 5u>(pool, nThreads, proofSize)};
     case 26:
-        return run<uint32_t, 26u, 5u>(hash, proofSize, cycle, nThreads, pool);
+        return std::unique_ptr<CuckooSolver::Context>{new SolverContext<uint32_t, 26u, 5u>(pool, nThreads, proofSize)};
     case 27:
-        return run<uint32_t, 27u, 6u>(hash, proofSize, cycle, nThreads, pool);
+        return std::unique_ptr<CuckooSolver::Context>{new SolverContext<uint32_t, 27u, 6u>(pool, nThreads, proofSize)};
     case 28:
-        return run<uint32_t, 28u, 6u>(hash, proofSize, cycle, nThreads, pool);
+        return std::unique_ptr<CuckooSolver::Context>{new SolverContext<uint32_t, 28u, 6u>(pool, nThreads, proofSize)};
     case 29:
-        return run<uint32_t, 29u, 7u>(hash, proofSize, cycle, nThreads, pool);
+        return std::unique_ptr<CuckooSolver::Context>{new SolverContext<uint32_t, 29u, 7u>(pool, nThreads, proofSize)};
     case 30:
-        return run<uint64_t, 30u, 8u>(hash, proofSize, cycle, nThreads, pool);
+        return std::unique_ptr<CuckooSolver::Context>{new SolverContext<uint64_t, 30u, 8u>(pool, nThreads, proofSize)};
     case 31:
-        return run<uint64_t, 31u, 8u>(hash, proofSize, cycle, nThreads, pool);
+        return std::unique_ptr<CuckooSolver::Context>{new SolverContext<uint64_t, 31u, 8u>(pool, nThreads, proofSize)};
 
     default:
         throw std::runtime_error(strprintf("%s: EDGEBITS equal to %d is not suppoerted", __func__, edgeBits));
     }
 }
+
+CuckooSolver::CuckooSolver(ctpl::thread_pool& pool) : m_pool{pool} {}
+
+CuckooSolver::~CuckooSolver() {}
+
+bool CuckooSolver::FindCycle(
+    const uint256& hash,
+    uint8_t edgeBits,
+    uint8_t proofSize,
+    std::set<uint32_t>& cycle,
+    size_t nThreads)
+{
+    if (!m_ctx || edgeBits != m_edge_bits || proofSize != m_proof_size || nThreads != m_threads) {
+        // Free the old buckets first so both sizes are never allocated at once.
+        m_ctx.reset();
+        m_ctx = MakeContext(edgeBits, proofSize, nThreads, m_pool);
+        m_edge_bits = edgeBits;
+        m_proof_size = proofSize;
+        m_threads = nThreads;
+    }
+
+    return m_ctx->Solve(hash, cycle);
+}
+
+bool FindCycleAdvanced(const uint256& hash,
+    uint8_t edgeBits,
+    uint8_t proofSize,
+    std::set<uint32_t>& cycle,
+    size_t nThreads,
+    ctpl::thread_pool& pool)
+{
+    CuckooSolver solver{pool};
+    return solver.FindCycle(hash, edgeBits, proofSize, cycle, nThreads);
+}
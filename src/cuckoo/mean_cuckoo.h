@@ -16,9 +16,38 @@
 #include "uint256.h"
 #include "ctpl/ctpl.h"
 
+#include <memory>
 #include <set>
 #include <vector>
 
+/**
+ * Solver that keeps its trimming buckets between calls. They are only
+ * reallocated when the edge bits, proof size or number of threads change,
+ * so trying another nonce just re-keys siphash.
+ */
+class CuckooSolver
+{
+public:
+    class Context;
+
+    explicit CuckooSolver(ctpl::thread_pool&);
+    ~CuckooSolver();
+
+    bool FindCycle(
+        const uint256& hash,
+        uint8_t edgeBits,
+        uint8_t proofSize,
+        std::set<uint32_t>& cycle,
+        size_t threads_number);
+
+private:
+    ctpl::thread_pool& m_pool;
+    uint8_t m_edge_bits = 0;
+    uint8_t m_proof_size = 0;
+    size_t m_threads = 0;
+    std::unique_ptr<Context> m_ctx;
+};
+
 // Find proofsize-length cuckoo cycle in random graph
 bool FindCycleAdvanced(
     const uint256& hash,
@@ -18,7 +18,9 @@
 #include "hash.h"
 #include "pow.h"
 
+#include <algorithm>
 #include <assert.h>
+#include <future>
 #include <numeric>
 #include <set>
 #include <stdio.h>
@@ -60,6 +62,57 @@ bool VerifyProofOfWork(
     return false;
 }
 
+// Headers a thread should get at least before it is worth starting.
+static const size_t MIN_BATCH_HEADERS_PER_THREAD = 16;
+
+// Returns the first header in [begin, end) that fails, or headers.size().
+static size_t VerifyProofOfWorkRange(
+        const std::vector<CBlockHeader>& headers,
+        size_t begin,
+        size_t end,
+        const Consensus::Params& params)
+{
+    for (size_t i = begin; i < end; i++) {
+        const auto& header = headers[i];
+        if (!VerifyProofOfWork(header.GetHash(), header.nBits, header.nEdgeBits, header.sCycle, params)) {
+            return i;
+        }
+    }
+
+    return headers.size();
+}
+
+size_t VerifyProofOfWorkBatch(
+        const std::vector<CBlockHeader>& headers,
+        const Consensus::Params& params,
+        ctpl::thread_pool& pool)
+{
+    const size_t nThreads = std::max<size_t>(1, std::min<size_t>(
+                pool.size() + 1,
+                headers.size() / MIN_BATCH_HEADERS_PER_THREAD));
+    if (nThreads == 1) {
+        return VerifyProofOfWorkRange(headers, 0, headers.size(), params);
+    }
+
+    const size_t chunk = (headers.size() + nThreads - 1) / nThreads;
+    std::vector<std::future<size_t>> jobs;
+    for (size_t begin = chunk; begin < headers.size(); begin += chunk) {
+        const size_t end = std::min(begin + chunk, headers.size());
+        jobs.push_back(pool.push([&headers, &params, begin, end](int) {
+            return VerifyProofOfWorkRange(headers, begin, end, params);
+        }));
+    }
+
+    // The first chunk is checked on this thread.
+    size_t first_failed = VerifyProofOfWorkRange(headers, 0, chunk, params);
+
+    for (auto& job : jobs) {
+        first_failed = std::min(first_failed, job.get());
+    }
+
+    return first_failed;
+}
+
 bool FindProofOfWorkAdvanced(
     const uint256 hash,
     unsigned int nBits,
@@ -69,10 +122,25 @@ bool FindProofOfWorkAdvanced(
     size_t nThreads,
     bool& cycleFound,
     ctpl::thread_pool& pool)
+{
+    CuckooSolver solver{pool};
+    return FindProofOfWorkAdvanced(
+            hash, nBits, edgeBits, cycle, params, nThreads, cycleFound, solver);
+}
+
+bool FindProofOfWorkAdvanced(
+    const uint256 hash,
+    unsigned int nBits,
+    uint8_t edgeBits,
+    std::set<uint32_t>& cycle,
+    const Consensus::Params& params,
+    size_t nThreads,
+    bool& cycleFound,
+    CuckooSolver& solver)
 {
     assert(cycle.empty());
     cycleFound =
-        FindCycleAdvanced(hash, edgeBits, params.nCuckooProofSize, cycle, nThreads, pool);
+        solver.FindCycle(hash, edgeBits, params.nCuckooProofSize, cycle, nThreads);
 
     if (cycleFound && ::CheckProofOfWork(SerializeHash(cycle), nBits, params)) {
         return true;
@@ -17,6 +17,7 @@
 #include "consensus/params.h"
 #include "uint256.h"
 #include "ctpl/ctpl.h"
+#include "mean_cuckoo.h"
 #include <set>
 #include <vector>
 
@@ -34,6 +35,16 @@ bool VerifyProofOfWork(
         const std::set<uint32_t>& cycle,
         const Consensus::Params& params);
 
+/**
+ * Checks the proof-of-work of many headers, splitting them over the threads
+ * of the pool and the calling thread. Returns the index of the first header
+ * that fails VerifyProofOfWork, or headers.size() if they all pass.
+ */
+size_t VerifyProofOfWorkBatch(
+        const std::vector<CBlockHeader>& headers,
+        const Consensus::Params& params,
+        ctpl::thread_pool& pool);
+
 /**
  * Find cycle for block that satisfies the proof-of-work requirement
  * specified by block hash with advanced edge trimming and matrix solver
@@ -47,6 +58,20 @@ bool FindProofOfWorkAdvanced(
         size_t nThreads,
         bool& cycleFound,
         ctpl::thread_pool& pool);
+
+/**
+ * Same as above but reuses the buckets of the solver given, which is
+ * much cheaper when trying many nonces in a row.
+ */
+bool FindProofOfWorkAdvanced(
+        uint256 hash,
+        unsigned int nBits,
+        uint8_t edgeBits,
+        std::set<uint32_t>& cycle,
+        const Consensus::Params& params,
+        size_t nThreads,
+        bool& cycleFound,
+        CuckooSolver& solver);
 }
 
 #endif // MERIT_CUCKOO_MINER_H
@@ -74,12 +74,12 @@ public:
     }
 };
 
-static leveldb::Options GetOptions(size_t nCacheSize, bool compression, int maxOpenFiles)
+static leveldb::Options GetOptions(size_t nCacheSize, bool compression, int maxOpenFiles, int bloomBits)
 {
     leveldb::Options options;
     options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
     options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    options.filter_policy = bloomBits > 0 ? leveldb::NewBloomFilterPolicy(bloomBits) : nullptr;
     options.compression = compression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
     options.max_open_files = maxOpenFiles;
     options.info_log = new CMeritLevelDBLogger();
@@ -91,14 +91,14 @@ static leveldb::Options GetOptions(size_t nCacheSize, bool compression, int maxO
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, bool compression, int maxOpenFiles)
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, bool compression, int maxOpenFiles, int bloomBits)
 {
     penv = nullptr;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize, compression, maxOpenFiles);
+    options = GetOptions(nCacheSize, compression, maxOpenFiles, bloomBits);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
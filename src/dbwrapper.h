@@ -220,8 +220,9 @@ public:
      *                          with a zero'd byte array.
      * @param[in] compression   Enable snappy compression for the database
      * @param[in] maxOpenFiles  The maximum number of open files for the database
+     * @param[in] bloomBits     Bits per key of the bloom filters of the tables, 0 for none
      */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, bool compression = false, int maxOpenFiles = 64);
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, bool compression = false, int maxOpenFiles = 64, int bloomBits = 10);
     ~CDBWrapper();
 
     template <typename K, typename V>
@@ -26,6 +26,7 @@
 #include "netbase.h"
 #include "net.h"
 #include "net_processing.h"
+#include "pog3/cgsstate.h"
 #include "policy/feerate.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
@@ -41,6 +42,7 @@
 #include "timedata.h"
 #include "txdb.h"
 #include "txmempool.h"
+#include "stratum.h"
 #include "torcontrol.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -167,6 +169,7 @@ void Interrupt(boost::thread_group& threadGroup)
     InterruptRPC();
     InterruptREST();
     InterruptTorControl();
+    InterruptStratumServer();
     if (g_connman)
         g_connman->Interrupt();
     threadGroup.interrupt_all();
@@ -203,6 +206,7 @@ void Shutdown()
     g_connman.reset();
 
     StopTorControl();
+    StopStratumServer();
     UnregisterNodeSignals(GetNodeSignals());
     if (fDumpMempoolLater && gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
         DumpMempool();
@@ -368,6 +372,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
+    strUsage += HelpMessageOpt("-refcache=<n>", strprintf(_("Keep the in-memory referral cache below <n> megabytes, taken out of -dbcache (default: %u)"), referral::DEFAULT_REFERRAL_CACHE));
     strUsage += HelpMessageOpt("-maxrefmempool=<n>", strprintf(_("Keep the referrals memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_REFERRALS_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-refmempoolexpiry=<n>", strprintf(_("Do not keep referrals in the mempool longer than <n> hours (default: %u)"), DEFAULT_REFERRALS_MEMPOOL_EXPIRY));
     if (showDebug) {
@@ -462,6 +467,9 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", defaultChainParams->DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", defaultChainParams->DefaultConsistencyChecks()));
+        strUsage += HelpMessageOpt("-cgsverify", strprintf("Cross check the incrementally maintained CGS state against a full rebuild on every lottery (default: %u)", DEFAULT_CGS_VERIFY));
+        strUsage += HelpMessageOpt("-cgsfixedpointcheck", strprintf("Recompute every CGS lottery with fixed point arithmetic and log whether the winners match (default: %u)", DEFAULT_CGS_FIXED_POINT_CHECK));
+        strUsage += HelpMessageOpt("-checklotterycache", strprintf("Recompute every ambassador lottery that is reused for the same tip and log whether the winners match (default: %u)", DEFAULT_CHECK_LOTTERY_CACHE));
         strUsage += HelpMessageOpt("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf("Disable safemode, override a real safe mode event (default: %u)", DEFAULT_DISABLE_SAFEMODE));
         strUsage += HelpMessageOpt("-testsafemode", strprintf("Force safe mode (default: %u)", DEFAULT_TESTSAFEMODE));
@@ -522,6 +530,13 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug)
         strUsage += HelpMessageOpt("-blockversion=<n>", "Override block version to test forking scenarios");
 
+    strUsage += HelpMessageGroup(_("Stratum server options:"));
+    strUsage += HelpMessageOpt("-stratum", strprintf(_("Serve Cuckoo Cycle mining jobs to external solvers (default: %u)"), DEFAULT_STRATUM_ENABLE));
+    strUsage += HelpMessageOpt("-stratumaddress=<address>", _("Address the coinbase of blocks found by solvers pays to, required with -stratum"));
+    strUsage += HelpMessageOpt("-stratumbind=<addr>", strprintf(_("Bind the stratum server to the given address. Solvers are not authenticated, only bind to trusted interfaces (default: %s)"), DEFAULT_STRATUM_BIND));
+    strUsage += HelpMessageOpt("-stratumport=<port>", strprintf(_("Listen for solvers on <port> (default: %u)"), DEFAULT_STRATUM_PORT));
+    strUsage += HelpMessageOpt("-stratumsharebits=<bits>", _("Compact target in hex a cycle hash must meet to count as a share, solvers can change it for themselves (default: the proof-of-work limit)"));
+
     strUsage += HelpMessageGroup(_("RPC server options:"));
     strUsage += HelpMessageOpt("-server", _("Accept command line and JSON-RPC commands"));
     strUsage += HelpMessageOpt("-rest", strprintf(_("Accept public REST requests (default: %u)"), DEFAULT_REST_ENABLE));
@@ -993,6 +1008,8 @@ bool AppInitParameterInteraction()
         mempool.setSanityCheck(1.0 / ratio);
     }
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
+    fCgsFixedPointCheck = gArgs.GetBoolArg("-cgsfixedpointcheck", DEFAULT_CGS_FIXED_POINT_CHECK);
+    fCheckLotteryCache = gArgs.GetBoolArg("-checklotterycache", DEFAULT_CHECK_LOTTERY_CACHE);
     fCheckpointsEnabled = gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
 
     hashAssumeValid = uint256S(gArgs.GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
@@ -1256,13 +1273,18 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Using at most %i automatic connections (%i file descriptors available)\n", nMaxConnections, nFD);
 
     pog3::SetupCgsThreadPool(boost::thread::hardware_concurrency());
+    pog3::GetCgsState().SetVerify(gArgs.GetBoolArg("-cgsverify", DEFAULT_CGS_VERIFY));
     InitSignatureCache();
     InitScriptExecutionCache();
+    InitReferralSignatureCache();
 
-    LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+    LogPrintf("Using %u threads for script and referral verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadReferralCheck);
+        SetupHeaderPowThreadPool(nScriptCheckThreads - 1);
     }
 
     // Start the lightweight task scheduler thread
@@ -1440,6 +1462,9 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     nReferralDBCache = std::min(nReferralDBCache, nMaxReferralDBCache << 20); // cap total referrals db cache
 
     nTotalCache -= nReferralDBCache;
+    int64_t nReferralCache = std::max<int64_t>(gArgs.GetArg("-refcache", referral::DEFAULT_REFERRAL_CACHE), 1) << 20;
+    nReferralCache = std::min(nReferralCache, nTotalCache / 4); // use at most 25% of the remainder for the referral cache
+    nTotalCache -= nReferralCache;
 
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
@@ -1452,6 +1477,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for referral database\n", nReferralDBCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for in-memory referral cache\n", nReferralCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space and %.1fMiB of unused referrals mempool space)\n",
         nCoinCacheUsage * (1.0 / 1024 / 1024),
         nMempoolSizeMax * (1.0 / 1024 / 1024),
@@ -1482,7 +1508,19 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                     static_cast<size_t>(nReferralDBCache),
                         false, fReset || fReindexChainState};
 
-                prefviewcache = new referral::ReferralsViewCache{prefviewdb};
+                prefviewcache = new referral::ReferralsViewCache{
+                    prefviewdb,
+                        static_cast<size_t>(nReferralCache)};
+
+                if (prefviewdb->IsLoadingSnapshot()) {
+                    strLoadError = _("Loading a referral snapshot did not finish. You need to rebuild the database using -reindex-chainstate");
+                    break;
+                }
+
+                if (!prefviewdb->Upgrade()) {
+                    strLoadError = _("Error upgrading referrals database");
+                    break;
+                }
 
                 if (fReset) {
                     pblocktree->WriteReindexing(true);
@@ -1778,6 +1816,10 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         return false;
     }
 
+    if (gArgs.GetBoolArg("-stratum", DEFAULT_STRATUM_ENABLE) && !StartStratumServer(chainparams)) {
+        return InitError(_("Unable to start the stratum server. See debug log for details."));
+    }
+
     if(gArgs.GetBoolArg("-mine", DEFAULT_MINING)) {
         // Generate coins in the background
         auto pow_threads = gArgs.GetArg("-minepowthreads", DEFAULT_MINING_POW_THREADS);
@@ -0,0 +1,155 @@
+// Copyright (c) 2017-2021 The Merit Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MERIT_LRUCACHE_H
+#define MERIT_LRUCACHE_H
+
+#include "sync.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+#include <boost/optional.hpp>
+
+/**
+ * Thread safe map that keeps at most a number of bytes worth of the most
+ * recently used entries. Keys are spread over shards by their hash and each
+ * shard has its own lock and least recently used list so lookups of different
+ * keys rarely contend.
+ *
+ * The memory of an entry is estimated from the sizes of its nodes plus
+ * extra_entry_bytes for whatever the key and value allocate themselves.
+ */
+template <typename K, typename V, typename Hasher = std::hash<K>>
+class ShardedLRUCache
+{
+public:
+    static const size_t SHARDS = 16;
+
+    explicit ShardedLRUCache(size_t max_bytes, size_t extra_entry_bytes = 0) :
+        m_max_shard_entries{std::max<size_t>(1, max_bytes / SHARDS / (EntryUsage() + extra_entry_bytes))} {}
+
+    /** Returns the value of the key and marks it as most recently used. */
+    boost::optional<V> Get(const K& key) const
+    {
+        auto& shard = GetShard(key);
+        LOCK(shard.cs);
+
+        const auto it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            m_misses++;
+            return boost::none;
+        }
+
+        m_hits++;
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        return it->second->second;
+    }
+
+    bool Contains(const K& key) const
+    {
+        return static_cast<bool>(Get(key));
+    }
+
+    /** Inserts or replaces the value, evicting the least recently used entry if full. */
+    void Put(const K& key, const V& value) const
+    {
+        auto& shard = GetShard(key);
+        LOCK(shard.cs);
+
+        //Values are replaced rather than assigned since some, like
+        //referrals, can't be.
+        const auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.entries.erase(it->second);
+            shard.index.erase(it);
+        } else if (shard.index.size() >= m_max_shard_entries) {
+            shard.index.erase(shard.entries.back().first);
+            shard.entries.pop_back();
+            m_evictions++;
+        }
+
+        shard.entries.emplace_front(key, value);
+        shard.index.emplace(key, shard.entries.begin());
+    }
+
+    void Erase(const K& key) const
+    {
+        auto& shard = GetShard(key);
+        LOCK(shard.cs);
+
+        const auto it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            return;
+        }
+
+        shard.entries.erase(it->second);
+        shard.index.erase(it);
+    }
+
+    void Clear() const
+    {
+        for (auto& shard : m_shards) {
+            LOCK(shard.cs);
+            shard.index.clear();
+            shard.entries.clear();
+        }
+    }
+
+    size_t Size() const
+    {
+        size_t size = 0;
+        for (auto& shard : m_shards) {
+            LOCK(shard.cs);
+            size += shard.index.size();
+        }
+        return size;
+    }
+
+    size_t MaxSize() const { return m_max_shard_entries * SHARDS; }
+    uint64_t Hits() const { return m_hits; }
+    uint64_t Misses() const { return m_misses; }
+    uint64_t Evictions() const { return m_evictions; }
+
+private:
+    using Entry = std::pair<K, V>;
+    using Entries = std::list<Entry>;
+    using Index = std::unordered_map<K, typename Entries::iterator, Hasher>;
+
+    struct Shard
+    {
+        CCriticalSection cs;
+        Entries entries;
+        Index index;
+    };
+
+    static size_t EntryUsage()
+    {
+        //A list node with two links, a hash table node with a link and the
+        //cached hash, a bucket and the malloc overhead of both nodes.
+        return sizeof(Entry) + 2 * sizeof(void*) +
+            sizeof(typename Index::value_type) + 2 * sizeof(void*) +
+            sizeof(void*) +
+            4 * sizeof(void*);
+    }
+
+    Shard& GetShard(const K& key) const
+    {
+        return m_shards[m_hasher(key) % SHARDS];
+    }
+
+    const size_t m_max_shard_entries;
+    Hasher m_hasher;
+    mutable std::array<Shard, SHARDS> m_shards;
+    mutable std::atomic<uint64_t> m_hits{0};
+    mutable std::atomic<uint64_t> m_misses{0};
+    mutable std::atomic<uint64_t> m_evictions{0};
+};
+
+#endif // MERIT_LRUCACHE_H
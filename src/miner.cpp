@@ -240,7 +240,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
      * via referrals. The rewards are given out in a lottery where the probability
      * of winning is based on an ambassadors referral network.
      */
-    const auto lottery = RewardAmbassadors(
+    const auto lottery = CachedRewardAmbassadors(
             nHeight,
             previousBlockHash,
             subsidy.ambassador,
@@ -957,6 +957,9 @@ void MinerWorker(int thread_id, MinerContext& ctx)
     auto start_nonce = thread_id * ctx.nonces_per_thread;
     unsigned int nExtraNonce = 0;
 
+    // Kept for the life of the worker so every nonce reuses its buckets.
+    CuckooSolver solver{ctx.pool};
+
     while (ctx.alive) {
         if (ctx.chainparams.MiningRequiresPeers()) {
             // Busy-wait for the network to come online so we don't waste
@@ -1037,7 +1040,7 @@ void MinerWorker(int thread_id, MinerContext& ctx)
                         ctx.chainparams.GetConsensus(),
                         ctx.pow_threads,
                         cycle_found,
-                        ctx.pool)) {
+                        solver)) {
 
                 cycles_found++;
 
@@ -2184,8 +2184,10 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 pref->alias,
                 mempoolReferral.Size());
 
-            // Recursively process any orphan referral that depended on this one
-            std::set<NodeId> setMisbehaving;
+            // Collect every orphan referral that descends from this one and
+            // accept them as one package, parents before children.
+            ReferralPackage package;
+            std::set<uint256> packaged;
             while (!vWorkQueue.empty()) {
                 auto itByPrev = mapOrphanReferralsByPrev.find(vWorkQueue.front());
                 vWorkQueue.pop_front();
@@ -2195,42 +2197,46 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 }
 
                 for (const auto& mi : itByPrev->second) {
+                    const auto& porphanRef = mi->second.ref;
+                    assert(porphanRef);
 
-                    const auto fromPeerId = mi->second.fromPeer;
-
-                    if (setMisbehaving.count(fromPeerId)) {
+                    if (!packaged.insert(porphanRef->GetHash()).second) {
                         continue;
                     }
 
-                    const auto& porphanRef = mi->second.ref;
-                    assert(porphanRef);
+                    package.emplace_back(porphanRef, mi->second.fromPeer);
+                    vWorkQueue.emplace_back(porphanRef->GetAddress());
+                }
+            }
 
-                    const auto& orphanRef = *porphanRef;
-                    const auto& orphanHash = orphanRef.GetHash();
+            // The orphans of a peer after the first invalid one are skipped
+            // and stay orphans.
+            AcceptReferralPackageToMemoryPool(mempoolReferral, package);
 
-                    CValidationState stateDummy;
-                    bool fMissingReferrer2 = false;
+            for (const auto& e : package) {
+                const auto& orphanRef = *e.ref;
+                const auto& orphanHash = orphanRef.GetHash();
 
-                    if (AcceptReferralToMemoryPool(mempoolReferral, stateDummy, porphanRef, fMissingReferrer2)) {
-                        LogPrint(BCLog::REFMEMPOOL, "   accepted orphan referral %s\n", orphanHash.GetHex());
-                        RelayReferral(orphanRef, connman);
-
-                        vWorkQueue.emplace_back(orphanRef.GetAddress());
-                        vEraseQueue.push_back(orphanHash);
+                if (e.skipped) {
+                    continue;
+                }
 
-                    } else if (!fMissingReferrer2) {
-                        int nDos = 0;
-                        if (stateDummy.IsInvalid(nDos) && nDos > 0)
-                        {
-                            Misbehaving(fromPeerId, nDos);
-                            setMisbehaving.insert(fromPeerId);
-                            LogPrint(BCLog::REFMEMPOOL, "   invalid orphan referral %s\n", orphanHash.GetHex());
-                        }
+                if (e.accepted) {
+                    LogPrint(BCLog::REFMEMPOOL, "   accepted orphan referral %s\n", orphanHash.GetHex());
+                    RelayReferral(orphanRef, connman);
+                    vEraseQueue.push_back(orphanHash);
 
-                        // Has inputs but not accepted to mempool
-                        LogPrint(BCLog::REFMEMPOOL, "   removed orphan referral %s\n", orphanHash.GetHex());
-                        vEraseQueue.push_back(orphanHash);
+                } else if (!e.missing_referrer) {
+                    int nDos = 0;
+                    if (e.state.IsInvalid(nDos) && nDos > 0)
+                    {
+                        Misbehaving(e.source, nDos);
+                        LogPrint(BCLog::REFMEMPOOL, "   invalid orphan referral %s\n", orphanHash.GetHex());
                     }
+
+                    // Has inputs but not accepted to mempool
+                    LogPrint(BCLog::REFMEMPOOL, "   removed orphan referral %s\n", orphanHash.GetHex());
+                    vEraseQueue.push_back(orphanHash);
                 }
             }
 
@@ -191,29 +191,18 @@ bool IsValidAmbassadorDestination(char type)
      * However, since the number of ANVs is fixed no matter how large the
      * blockchain gets, then there should be no issue handling growth.
      */
-AnvDistribution::AnvDistribution(int height, referral::AddressANVs anvs) : m_inverted(anvs.size())
+AnvDistribution::AnvDistribution(int height, referral::AddressANVs anvs) :
+    m_anvs(std::move(anvs)),
+    m_cdf(m_anvs.size())
 {
-    //index anvs by address id for convenience.
-    std::transform(
-        std::begin(anvs),
-        std::end(anvs),
-        std::inserter(m_anvs, std::begin(m_anvs)),
-
-        [](const referral::AddressANV& v) {
-            assert(v.anv >= 0);
-            return std::make_pair(v.address, v);
-        });
-
-    assert(m_anvs.size() == anvs.size());
-
     /**
          * Prior to block 16000 the sort algorithm was defective because of the
          * comparator. Use legacy sort for old blocks and new sort after 16000
          */
     if (height < 16000) {
-        LegacySort(std::begin(anvs), std::end(anvs));
+        LegacySort(std::begin(m_anvs), std::end(m_anvs));
     } else {
-        std::sort(std::begin(anvs), std::end(anvs),
+        std::sort(std::begin(m_anvs), std::end(m_anvs),
             [](const referral::AddressANV& a, const referral::AddressANV& b) {
                 if (a.anv == b.anv) {
                     return a.address < b.address;
@@ -222,22 +211,17 @@ AnvDistribution::AnvDistribution(int height, referral::AddressANVs anvs) : m_inv
             });
     }
 
-    assert(m_inverted.size() == anvs.size());
-
     //compute CDF by adding up all the ANVs
     StackedAmount previous_anv = 0;
-    std::transform(std::begin(anvs), std::end(anvs), std::begin(m_inverted),
-        [&previous_anv](referral::AddressANV w) {
+    std::transform(std::begin(m_anvs), std::end(m_anvs), std::begin(m_cdf),
+        [&previous_anv](const referral::AddressANV& w) {
+            assert(w.anv >= 0);
             previous_anv += w.anv;
-            return StackedAddressANV { 
-                w.address_type,
-                w.address,
-                previous_anv,
-            };
+            return previous_anv;
         });
 
     //back will always return because we assume m_anvs is non-empty
-    if (!m_inverted.empty()) m_max_anv = m_inverted.back().anv;
+    if (!m_cdf.empty()) m_max_anv = m_cdf.back();
 
     assert(m_max_anv >= 0);
     cached_total_anv = std::max(cached_total_anv, m_max_anv);
@@ -246,30 +230,27 @@ AnvDistribution::AnvDistribution(int height, referral::AddressANVs anvs) : m_inv
 const referral::AddressANV& AnvDistribution::Sample(const uint256& hash) const
 {
     //It doesn't make sense to sample from an empty distribution.
-    assert(m_inverted.empty() == false);
+    assert(m_cdf.empty() == false);
 
     const auto selected_anv = SipHashUint256(0, 0, hash) % m_max_anv;
 
-    auto pos = std::lower_bound(std::begin(m_inverted), std::end(m_inverted),
+    auto pos = std::lower_bound(std::begin(m_cdf), std::end(m_cdf),
         selected_anv,
-        [](const StackedAddressANV& a, StackedAmount selected) {
-            return a.anv < selected;
+        [](const StackedAmount& anv, const StackedAmount& selected) {
+            return anv < selected;
         });
 
     assert(m_max_anv >= 0);
     assert(selected_anv < m_max_anv);
-    assert(pos != std::end(m_inverted)); //it should be impossible to not find an anv
-                                         //because selected_anv must be less than max
-    auto selected_address = m_anvs.find(pos->address);
+    assert(pos != std::end(m_cdf)); //it should be impossible to not find an anv
+                                    //because selected_anv must be less than max
 
-    assert(selected_address != std::end(m_anvs)); //all anvs in m_inverted must be in
-                                                  //our index
-    return selected_address->second;
+    return m_anvs[std::distance(std::begin(m_cdf), pos)];
 }
 
 size_t AnvDistribution::Size() const
 {
-    return m_inverted.size();
+    return m_anvs.size();
 }
 
 StackedAmount AnvDistribution::MaxANV() const
@@ -21,15 +21,7 @@ namespace pog
 {
     using StackedAmount = boost::multiprecision::int128_t;
 
-    struct StackedAddressANV
-    {
-        char address_type;
-        referral::Address address;
-        StackedAmount anv;
-    };
-
-    using InvertedAnvs = std::vector<StackedAddressANV>;
-    using WalletToAnv = std::map<referral::Address, referral::AddressANV>;
+    using StackedAmounts = std::vector<StackedAmount>;
 
     class AnvDistribution
     {
@@ -40,8 +32,9 @@ namespace pog
             StackedAmount MaxANV() const;
 
         private:
-            InvertedAnvs m_inverted;
-            WalletToAnv m_anvs;
+            //ANVs in sampling order and their CDF in that order.
+            referral::AddressANVs m_anvs;
+            StackedAmounts m_cdf;
             StackedAmount m_max_anv = 0;
     };
 
@@ -7,7 +7,9 @@
 #include "validation.h"
 #include "referrals.h"
 #include "ctpl/ctpl.h"
+#include "pog3/cgsstate.h"
 #include "sync.h"
+#include "util.h"
 
 #include <stack>
 #include <deque>
@@ -519,6 +521,53 @@ namespace pog2
         }
     }
 
+    /**
+     * Fills the entrants of the context from the beacon tree kept by
+     * pog3::CGSState instead of walking the referral DB and scanning the
+     * whole unspent index. The entrants are queued in the same order as
+     * PrefillContributionsAndHeights queues them. Their coins are looked up
+     * per address, so they are only in the order GetAllCoins gives within
+     * each entrant. Balances are sums of the coins and don't depend on it.
+     */
+    bool FillFromCgsState(
+            CGSContext& context,
+            referral::ReferralsViewCache& db,
+            const referral::Address& genesis_address,
+            const uint256& tip_hash)
+    {
+        assert(context.entrants.empty());
+
+        const auto tip_height = context.tip_height;
+        const bool filled = pog3::GetCgsState().Walk(db, genesis_address, tip_hash,
+                [&context, tip_height](
+                    char address_type,
+                    const referral::Address& address,
+                    int height,
+                    const Children& children) {
+                    auto& entrant = context.AddEntrant(
+                            address_type,
+                            address,
+                            height,
+                            children);
+
+                    GetCachedAddressUnspent(address, [&entrant, tip_height](const CAddressUnspentKey& key, const CAddressUnspentValue& value) {
+                            if (key.type == 0 || key.isInvite || value.satoshis == 0 || value.blockHeight > tip_height) {
+                                return;
+                            }
+
+                            assert(value.satoshis > 0);
+                            entrant.coins.emplace_back(value.blockHeight, value.satoshis);
+                        });
+                });
+
+        if (!filled) {
+            context.entrants.clear();
+            context.entrant_idx.clear();
+        }
+
+        return filled;
+    }
+
     void ComputeAllContributions(
             CGSContext& context,
             referral::ReferralsViewCache& db) {
@@ -581,32 +630,109 @@ namespace pog2
         }
     }
 
-    void GetAllRewardableEntrants(
+    void SetupContext(
             CGSContext& context,
-            referral::ReferralsViewCache& db,
             const Consensus::Params& params,
-            int height,
-            Entrants& entrants)
+            int height)
     {
-        assert(height >= 0);
-
         context.tip_height = height;
         context.coin_maturity = params.pog2_coin_maturity;
         context.new_coin_maturity = params.pog2_new_coin_maturity;
         context.B = params.pog2_convex_b;
         context.S = params.pog2_convex_s;
+    }
+
+    void ComputeRewardableEntrants(
+            CGSContext& context,
+            referral::ReferralsViewCache& db,
+            const Consensus::Params& params,
+            Entrants& entrants)
+    {
+        ComputeAges(context);
+
+        ComputeAllContributions(context, db);
+        context.tree_contribution = ContributionSubtreeIter(context, 2, params.genesis_address, db);
+
+        ComputeAllScores(context, db, params, entrants);
+    }
+
+    void RebuildAllRewardableEntrants(
+            CGSContext& context,
+            referral::ReferralsViewCache& db,
+            const Consensus::Params& params,
+            int height,
+            Entrants& entrants)
+    {
+        assert(height >= 0);
+
+        SetupContext(context, params, height);
         PrefillContributionsAndHeights(
                 context,
                 2,
                 params.genesis_address,
                 db);
         GetAllCoins(context, height);
-        ComputeAges(context);
 
-        ComputeAllContributions(context, db);
-        context.tree_contribution = ContributionSubtreeIter(context, 2, params.genesis_address, db);
+        ComputeRewardableEntrants(context, db, params, entrants);
+    }
 
-        ComputeAllScores(context, db, params, entrants);
+    bool SameEntrants(const Entrants& a, const Entrants& b)
+    {
+        return a.size() == b.size() &&
+            std::equal(a.begin(), a.end(), b.begin(),
+                [](const Entrant& x, const Entrant& y) {
+                    return x.address_type == y.address_type &&
+                        x.address == y.address &&
+                        x.balance == y.balance &&
+                        x.aged_balance == y.aged_balance &&
+                        x.cgs == y.cgs &&
+                        x.sub_cgs == y.sub_cgs &&
+                        x.beacon_height == y.beacon_height &&
+                        x.children == y.children &&
+                        x.network_size == y.network_size;
+                });
+    }
+
+    void GetAllRewardableEntrants(
+            CGSContext& context,
+            referral::ReferralsViewCache& db,
+            const Consensus::Params& params,
+            const uint256& tip_hash,
+            int height,
+            Entrants& entrants)
+    {
+        assert(height >= 0);
+
+        auto& state = pog3::GetCgsState();
+
+        SetupContext(context, params, height);
+        if (tip_hash.IsNull() || !FillFromCgsState(context, db, params.genesis_address, tip_hash)) {
+            RebuildAllRewardableEntrants(context, db, params, height, entrants);
+            return;
+        }
+
+        ComputeRewardableEntrants(context, db, params, entrants);
+
+        if (!state.Verify()) {
+            return;
+        }
+
+        CGSContext rebuilt_context;
+        rebuilt_context.cgs_pool = context.cgs_pool;
+
+        Entrants rebuilt_entrants;
+        rebuilt_entrants.reserve(entrants.size());
+        RebuildAllRewardableEntrants(rebuilt_context, db, params, height, rebuilt_entrants);
+
+        if (rebuilt_context.tree_contribution.value != context.tree_contribution.value ||
+                !SameEntrants(rebuilt_entrants, entrants)) {
+            LogPrintf("%s: CGS state at %s diverged from a full rebuild at height %d (%d vs %d entrants), using the rebuild\n",
+                    __func__, tip_hash.GetHex(), height, entrants.size(), rebuilt_entrants.size());
+
+            state.Invalidate();
+            context = std::move(rebuilt_context);
+            entrants = std::move(rebuilt_entrants);
+        }
     }
 
     CachedEntrant& CGSContext::AddEntrant(
@@ -107,10 +107,14 @@ namespace pog2
 
     using Entrants = std::vector<Entrant>;
 
+    /**
+     * tip_hash is the block the referral and unspent index DBs are at.
+     */
     void GetAllRewardableEntrants(
             CGSContext& context,
             referral::ReferralsViewCache&,
             const Consensus::Params&,
+            const uint256& tip_hash,
             int height,
             Entrants&);
 
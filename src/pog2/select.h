@@ -22,8 +22,6 @@ namespace referral
 
 namespace pog2
 {
-    using InvertedEntrants = pog2::Entrants;
-    using AddressToEntrant = std::map<referral::Address, pog2::Entrant>;
     using SampledAddresses = std::set<referral::Address>;
 
     class CgsDistribution
@@ -37,12 +35,16 @@ namespace pog2
         private:
 
             const pog2::Entrants m_entrants;
-            InvertedEntrants m_inverted;
-            AddressToEntrant m_cgses;
+
+            //Indices into m_entrants ordered by cgs then address, and the
+            //CDF of their cgs in that order.
+            std::vector<size_t> m_order;
+            std::vector<CAmount> m_cdf;
             CAmount m_max_cgs = 0;
     };
 
-    using CgsDistributionPtr = std::unique_ptr<CgsDistribution>;
+    //Distributions never change once built so copies of a selector share them.
+    using CgsDistributionPtr = std::shared_ptr<const CgsDistribution>;
 
     class AddressSelector
     {
@@ -3,14 +3,14 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "pog3/cgs.h"
+#include "pog3/cgsstate.h"
 #include "addressindex.h"
 #include "validation.h"
 #include "referrals.h"
 #include "sync.h"
+#include "util.h"
 
-#include <stack>
 #include <deque>
-#include <stack>
 #include <numeric>
 
 #include <boost/multiprecision/cpp_int.hpp> 
@@ -23,6 +23,9 @@ namespace pog3
         const size_t BATCH_SIZE = 100;
         const int NO_GENESIS = 13500;
         ctpl::thread_pool g_cgs_pool;
+
+        CCriticalSection cs_age_scales;
+        std::map<int, AgeScaleTablePtr> g_age_scales;
     }
 
     CAmount GetAmbassadorMinumumStake(int height, const Consensus::Params& consensus_params)
@@ -73,11 +76,43 @@ namespace pog3
         return age_scale;
     }
 
-    double AgeScale(const Coin& c, int tip_height, int maturity) {
-        assert(tip_height >= 0);
-        assert(c.height <= tip_height);
+    /**
+     * AgeScale only depends on the age of a coin in blocks and the maturity
+     * so the scale of every age is computed once and shared by every coin,
+     * every entrant and every later block. A table is replaced by a larger
+     * copy, doubling its size, when an older age is asked for so contexts
+     * holding the old one are unaffected.
+     */
+    AgeScaleTablePtr GetAgeScales(int maturity, int max_age)
+    {
         assert(maturity > 0);
-        return AgeScale(c.height, tip_height, maturity);
+        assert(max_age >= 0);
+
+        LOCK(cs_age_scales);
+        auto& table = g_age_scales[maturity];
+        if (table && static_cast<int>(table->size()) > max_age) {
+            return table;
+        }
+
+        auto grown = table ?
+            std::make_shared<AgeScaleTable>(*table) :
+            std::make_shared<AgeScaleTable>();
+
+        const size_t size = std::max(grown->size() * 2, static_cast<size_t>(max_age) + 1);
+        grown->reserve(size);
+        for (size_t age = grown->size(); age < size; age++) {
+            grown->push_back(AgeScale(0, age, maturity));
+        }
+
+        table = grown;
+        return table;
+    }
+
+    double AgeScale(const AgeScaleTable& scales, int height, int tip_height)
+    {
+        assert(height <= tip_height);
+        assert(static_cast<size_t>(tip_height - height) < scales.size());
+        return scales[tip_height - height];
     }
 
     int GetReferralHeight(
@@ -128,31 +163,24 @@ namespace pog3
         return cs;
     }
 
-    bool GetAllCoins(CGSContext& context, int tip_height) {
-        std::vector<UnspentPair> unspent;
-        if (!GetAllUnspent(false, [&context, tip_height](const CAddressUnspentKey& key, const CAddressUnspentValue& value) {
+    void AddEntrantCoins(CGSContext& context, const referral::Address& address) {
+        const auto tip_height = context.tip_height;
+        GetCachedAddressUnspent(address, [&context, tip_height](const CAddressUnspentKey& key, const CAddressUnspentValue& value) {
                 if (key.type == 0 || key.isInvite || value.satoshis == 0 || value.blockHeight > tip_height) {
                     return;
                 }
 
-                assert(!key.isInvite);
                 assert(value.satoshis > 0);
-
-                auto& entrant = context.GetEntrant(key.hashBytes);
-                entrant.coins.emplace_back(value.blockHeight, value.satoshis);
-           })) {
-            return false;
-        }
-        return true;
+                context.AddCoin(Coin{value.blockHeight, value.satoshis});
+           });
     }
 
-    BalancePair BalanceDecay(int tip_height, const Coin& c, int maturity) {
+    BalancePair BalanceDecay(int tip_height, const Coin& c, const AgeScaleTable& scales) {
         assert(tip_height >= 0);
         assert(c.height <= tip_height);
         assert(c.amount >= 0);
-        assert(maturity > 0);
 
-        const auto age_scale = AgeScale(c, tip_height, maturity);
+        const auto age_scale = AgeScale(scales, c.height, tip_height);
         const auto aged_balance = age_scale * c.amount; 
 
         assert(aged_balance <= std::numeric_limits<CAmount>::max());
@@ -164,14 +192,14 @@ namespace pog3
         return BalancePair{amount, c.amount};
     }
 
-    template <class AgeFunc>
-    BalancePair AgedBalance(int tip_height, const Coins& cs, int maturity, AgeFunc AgedBalanceFunc) {
+    template <class CoinRange, class AgeFunc>
+    BalancePair AgedBalance(int tip_height, const CoinRange& cs, const AgeScaleTable& scales, AgeFunc AgedBalanceFunc) {
         assert(tip_height >= 0);
 
         BalancePairs balances(cs.size());
         std::transform(cs.begin(), cs.end(), balances.begin(),
-                [tip_height, maturity, &AgedBalanceFunc](const Coin& c) {
-                    return AgedBalanceFunc(tip_height, c, maturity);
+                [tip_height, &scales, &AgedBalanceFunc](const Coin& c) {
+                    return AgedBalanceFunc(tip_height, c, scales);
                 });
 
         const auto aged_balance = 
@@ -204,15 +232,26 @@ namespace pog3
         assert(S >= V{0});
         assert(S <= V{1.01});
 
-        const V v = (B*c) + ((V{1} - B)*boost::multiprecision::pow(c, V{1} + S));
+        using boost::multiprecision::pow;
+        const V v = (B*c) + ((V{1} - B)*pow(c, V{1} + S));
         assert(v >= 0);
         return v;
     }
 
-    Contribution ContributionNode(
-            CGSContext& context,
-            CachedEntrant& entrant,
-            referral::ReferralsViewCache& db)
+    CAmount ToAmount(const ContributionAmount& v)
+    {
+        return v.convert_to<CAmount>();
+    }
+
+    CAmount ToAmount(const FixedAmount& v)
+    {
+        return v.ToAmount();
+    }
+
+    template <class V>
+    BasicContribution<V> ContributionNode(
+            const CGSContext& context,
+            const CachedEntrant& entrant)
     {
         assert(context.tip_height > 0);
         assert(context.new_coin_maturity > 0);
@@ -223,23 +262,24 @@ namespace pog3
             std::min(entrant.height, context.tip_height);
 
         if (beacon_height < 0 ) {
-            return Contribution{};
+            return BasicContribution<V>{};
         }
 
         assert(beacon_height <= context.tip_height);
 
         const auto beacon_age_scale =
-            1.0 - AgeScale(beacon_height, context.tip_height, context.new_coin_maturity);
+            1.0 - AgeScale(*context.beacon_age_scales, beacon_height, context.tip_height);
 
         assert(beacon_age_scale >= 0);
         assert(beacon_age_scale <= 1.01);
 
-        Contribution c;
+        BasicContribution<V> c;
 
         //We compute both the linear and sublinear versions of the contribution.
         //This is done because there are two pools of selections evenly split
         //between stake oriented and growth oriented engagements.
-        c.value = (beacon_age_scale * aged_balance.second) + aged_balance.first;
+        //The sum is done in double precision whatever V is.
+        c.value = V{(beacon_age_scale * aged_balance.second) + aged_balance.first};
 
         assert(c.value >= 0);
         assert(c.value <= aged_balance.second);
@@ -247,118 +287,123 @@ namespace pog3
         return c;
     }
 
-    struct Node 
-    {
-        char address_type;
-        referral::Address address;
-        Children children;
-        SubtreeContribution contribution;
-    };
-
-    using NodeStack = std::stack<Node>;
-    
     using AddressQueue = std::deque<AddressPair>;
 
+    using Level = std::pair<size_t, size_t>;
+    using Levels = std::vector<Level>;
+
     /**
-     * Computes the subtree contribution rooted at the address specified.
-     * This algorithm computes the subtree contribution by doing a post order
-     * traversal of the ambassador tree.
-     *
-     * TODO: Implement parallel version, maybe Coffman–Graham algorithm.
+     * Entrants are added in breadth first order from the genesis address so
+     * every level of the referral tree is a contiguous range of entrants.
      */
-    SubtreeContribution ContributionSubtreeIter(
-            CGSContext& context,
-            char address_type,
-            const referral::Address& address,
-            referral::ReferralsViewCache& db)
+    Levels GetLevels(const CGSContext& context)
     {
-        const auto c = context.subtree_contribution.find(address);
+        std::vector<size_t> depths(context.entrants.size(), 0);
+        Levels levels;
+
+        size_t start = 0;
+        for (size_t i = 0; i < context.entrants.size(); i++) {
+            if (depths[i] != depths[start]) {
+                assert(depths[i] == depths[start] + 1);
+                levels.emplace_back(start, i);
+                start = i;
+            }
 
-        if (c != context.subtree_contribution.end()) {
-            return c->second;
+            for (const auto child_idx : context.GetChildren(i)) {
+                assert(child_idx > i);
+                depths[child_idx] = depths[i] + 1;
+            }
         }
 
-        const auto& root_entrant = context.GetEntrant(address);
-
-        SubtreeContribution contribution;
-
-        NodeStack ns;
-        ns.push({
-                root_entrant.address_type,
-                address,
-                root_entrant.children,
-                {}});
-
-        while (!ns.empty()) {
-            auto& n = ns.top();
-            n.contribution.value += contribution.value;
-            n.contribution.tree_size += contribution.tree_size;
-
-            if (n.children.empty()) {
-                const auto& c = context.GetEntrant(n.address).contribution;
-                n.contribution.value += c.value;
-                n.contribution.tree_size++;
-
-                assert(n.contribution.value >= 0);
-
-                contribution = n.contribution;
-                context.subtree_contribution[n.address] = n.contribution;
+        if (start < context.entrants.size()) {
+            levels.emplace_back(start, context.entrants.size());
+        }
 
-                ns.pop();
+        return levels;
+    }
 
-            } else {
-                const auto child_address = n.children.back();
-                n.children.pop_back();
+    /**
+     * Computes the subtree contribution of every entrant with a bottom up
+     * pass over the referral tree. Levels are processed from the deepest up
+     * and the entrants within a level are processed in parallel since each one
+     * only reads the subtree contributions of its children in the level below.
+     *
+     * Children are summed in reverse order followed by the entrant's own
+     * contribution to keep the same rounding as the post order traversal
+     * this replaces.
+     */
+    template <class V>
+    void ComputeAllSubtreeContributions(
+            const CGSContext& context,
+            BasicScores<V>& scores)
+    {
+        assert(context.cgs_pool != nullptr);
+        assert(scores.contributions.size() == context.entrants.size());
 
-                contribution.value = 0;
-                contribution.tree_size = 0;
+        scores.subtree_contributions.assign(
+                context.entrants.size(),
+                BasicSubtreeContribution<V>{});
 
-                const auto& child_entrant = context.GetEntrant(child_address);
+        const auto levels = GetLevels(context);
 
-                ns.push({
-                        child_entrant.address_type,
-                        child_address,
-                        child_entrant.children,
-                        {}});
+        std::vector<std::future<void>> jobs;
+        for (auto level = levels.rbegin(); level != levels.rend(); level++) {
+            jobs.clear();
+            for (size_t b = level->first; b < level->second; b+=BATCH_SIZE) {
+                const auto end = std::min(level->second, b + BATCH_SIZE);
+                jobs.push_back(
+                        context.cgs_pool->push([b, end, &context, &scores](int id) {
+                            for (size_t i = b; i < end; i++) {
+                                const auto children = context.GetChildren(i);
+                                auto& contribution = scores.subtree_contributions[i];
+
+                                for (auto c = children.end(); c != children.begin();) {
+                                    const auto& child_contribution =
+                                        scores.subtree_contributions[*--c];
+
+                                    contribution.value += child_contribution.value;
+                                    contribution.tree_size += child_contribution.tree_size;
+                                }
+
+                                contribution.value += scores.contributions[i].value;
+                                contribution.tree_size++;
+
+                                assert(contribution.value >= 0);
+                            }
+                        }));
+            }
+            for (auto& j : jobs) {
+                j.wait();
             }
         }
-
-        return context.subtree_contribution[address];
-    }
-
-    ContributionAmount GetValue(const SubtreeContribution& t)
-    {
-        return t.value;
     }
 
+    template <class V>
     struct WeightedScores
     {
-        ContributionAmount value;
+        V value;
         size_t tree_size;
     };
 
-    WeightedScores WeightedScore(
-            CGSContext& context,
-            const char address_type,
-            const referral::Address& address,
-            referral::ReferralsViewCache& db)
+    template <class V>
+    WeightedScores<V> WeightedScore(
+            const CGSContext& context,
+            const BasicScores<V>& scores,
+            size_t entrant_idx)
     {
-        assert(context.tree_contribution.value > 0);
+        assert(scores.tree_contribution.value > 0);
+
+        const auto& subtree_contribution =
+            scores.subtree_contributions[entrant_idx];
 
-        const auto subtree_contribution =
-                ContributionSubtreeIter(
-                    context,
-                    address_type,
-                    address,
-                    db);
         assert(subtree_contribution.value >= 0);
-        assert(subtree_contribution.value <= context.tree_contribution.value);
+        assert(subtree_contribution.value <= scores.tree_contribution.value);
 
-        WeightedScores score;
-        score.value = ConvexF<ContributionAmount>(
-                subtree_contribution.value / context.tree_contribution.value,
-                context.B,
-                context.S);
+        WeightedScores<V> score;
+        score.value = ConvexF<V>(
+                subtree_contribution.value / scores.tree_contribution.value,
+                V{context.B},
+                V{context.S});
 
         score.tree_size = subtree_contribution.tree_size;
         
@@ -367,39 +412,32 @@ namespace pog3
         return score;
     }
 
+    template <class V>
     struct ExpectedValues
     {
-        ContributionAmount value;
+        V value;
         size_t tree_size;
     };
 
-    ExpectedValues ExpectedValue(
-            CGSContext& context,
-            const CachedEntrant& entrant,
-            referral::ReferralsViewCache& db)
+    template <class V>
+    ExpectedValues<V> ExpectedValue(
+            const CGSContext& context,
+            const BasicScores<V>& scores,
+            size_t entrant_idx)
     {
         //this case can occur on regtest if there is not enough data.
-        if (context.tree_contribution.value == 0) {
-            return {0, 0};
+        if (scores.tree_contribution.value == 0) {
+            return {V{0}, 0};
         }
 
-        assert(context.tree_contribution.value > 0);
+        assert(scores.tree_contribution.value > 0);
 
-        auto expected_value = WeightedScore(
-                context,
-                entrant.address_type,
-                entrant.address,
-                db);
+        auto expected_value = WeightedScore(context, scores, entrant_idx);
 
         assert(expected_value.value >= 0);
 
-        for (const auto& c:  entrant.children) {
-            const auto& child_entrant = context.GetEntrant(c);
-            auto child_score = WeightedScore(
-                    context,
-                    child_entrant.address_type,
-                    c,
-                    db);
+        for (const auto c : context.GetChildren(entrant_idx)) {
+            auto child_score = WeightedScore(context, scores, c);
 
             assert(child_score.value >= 0);
             expected_value.value -= child_score.value;
@@ -409,21 +447,20 @@ namespace pog3
         return { expected_value.value, expected_value.tree_size };
     }
 
+    template <class V>
     Entrant ComputeCGS(
-            CGSContext& context,
-            const CachedEntrant& entrant,
-            referral::ReferralsViewCache& db)
+            const CGSContext& context,
+            const BasicScores<V>& scores,
+            size_t entrant_idx)
     {
-        auto expected_value = ExpectedValue(
-                context,
-                entrant,
-                db);
+        const auto& entrant = context.entrants[entrant_idx];
+        auto expected_value = ExpectedValue(context, scores, entrant_idx);
 
-        const ContributionAmount cgs = context.tree_contribution.value * expected_value.value;
+        const V cgs = scores.tree_contribution.value * expected_value.value;
 
         assert(cgs >= 0);
 
-        auto floored_cgs = cgs.convert_to<CAmount>();
+        auto floored_cgs = ToAmount(cgs);
 
         const auto& balance = entrant.balances;
 
@@ -434,13 +471,21 @@ namespace pog3
                 balance.first,
                 floored_cgs,
                 entrant.height,
-                entrant.children.size(),
+                context.GetChildren(entrant_idx).size(),
                 expected_value.tree_size
         };
     }
 
+    Entrant ComputeCGS(
+            const CGSContext& context,
+            size_t entrant_idx)
+    {
+        return ComputeCGS(context, context.scores, entrant_idx);
+    }
+
     void ComputeAges(CGSContext& context) {
         assert(context.cgs_pool != nullptr);
+        assert(context.coin_age_scales);
 
         std::vector<std::future<void>> jobs;
         jobs.reserve(context.entrants.size() / BATCH_SIZE);
@@ -453,8 +498,8 @@ namespace pog3
                             auto& e = context.entrants[i];
                             e.balances = AgedBalance(
                                     context.tip_height,
-                                    e.coins,
-                                    context.coin_maturity,
+                                    context.GetCoins(i),
+                                    *context.coin_age_scales,
                                     BalanceDecay);
                         }
                     }));
@@ -478,38 +523,45 @@ namespace pog3
 
             const auto height = GetReferralHeight(db, p.second);
 
-            const auto& entrant = context.AddEntrant(
+            context.AddEntrant(
                     p.first,
                     p.second, 
-                    height,
-                    db.GetChildren(p.second));
+                    height);
 
-            for(const auto& c : entrant.children) {
+            AddEntrantCoins(context, p.second);
+
+            for(const auto& c : db.GetChildren(p.second)) {
                 const auto maybe_ref = db.GetReferral(c);
                 if (!maybe_ref) {
                     continue;
                 }
 
+                //Children are dequeued in the order they are queued so we
+                //know the index the child will get.
+                context.AddChild(context.entrants.size() + q.size());
                 q.push_back(std::make_pair(maybe_ref->addressType, maybe_ref->GetAddress()));
             }
 
         }
     }
 
+    template <class V>
     void ComputeAllContributions(
-            CGSContext& context,
-            referral::ReferralsViewCache& db) {
+            const CGSContext& context,
+            BasicScores<V>& scores) {
         assert(context.cgs_pool != nullptr);
 
+        scores.contributions.resize(context.entrants.size());
+
         std::vector<std::future<void>> jobs;
         jobs.reserve(context.entrants.size() / BATCH_SIZE);
         for(size_t b = 0; b < context.entrants.size(); b+=BATCH_SIZE) {
             jobs.push_back(
-                    context.cgs_pool->push([b, &context, &db](int id) {
+                    context.cgs_pool->push([b, &context, &scores](int id) {
                         const auto end = std::min(context.entrants.size(), b + BATCH_SIZE);
                         for(size_t i = b; i < end; i++) {
-                            auto& e = context.entrants[i];
-                            e.contribution = ContributionNode(context, e, db);
+                            scores.contributions[i] =
+                                ContributionNode<V>(context, context.entrants[i]);
                         }
                     }));
         }
@@ -518,9 +570,28 @@ namespace pog3
         }
     }
 
+    /**
+     * Computes the contributions and subtree contributions of the entrants.
+     * Their aged balances must already be computed.
+     */
+    template <class V>
+    void ComputeContributions(
+            const CGSContext& context,
+            const Consensus::Params& params,
+            BasicScores<V>& scores)
+    {
+        ComputeAllContributions(context, scores);
+        ComputeAllSubtreeContributions(context, scores);
+
+        assert(!context.entrants.empty());
+        assert(context.entrants[0].address == params.genesis_address);
+        scores.tree_contribution = scores.subtree_contributions[0];
+    }
+
+    template <class V>
     void ComputeAllScores(
-            CGSContext& context,
-            referral::ReferralsViewCache& db,
+            const CGSContext& context,
+            const BasicScores<V>& scores,
             const Consensus::Params& params,
             Entrants& entrants)
     {
@@ -537,21 +608,21 @@ namespace pog3
         //Important, 1 here to skip the genesis address
         for(size_t b = 1; b < context.entrants.size(); b+=BATCH_SIZE) {
             jobs.push_back(
-                    context.cgs_pool->push([b, minimum_stake , &context, &db](int id) {
+                    context.cgs_pool->push([b, minimum_stake , &context, &scores](int id) {
                         const auto end = std::min(context.entrants.size(), b + BATCH_SIZE);
                         Entrants es;
                         es.reserve(end - b);
                         for(size_t i = b; i < end; i++) {
                             const auto& e = context.entrants[i];
                             if(e.balances.second >= minimum_stake) {
-                                es.emplace_back(ComputeCGS(context, e, db));
+                                es.emplace_back(ComputeCGS(context, scores, i));
                             }
                         }
                         return es;
                     }));
         }
 
-        entrants.reserve(context.entrants.size()*BATCH_SIZE);
+        entrants.reserve(context.entrants.size());
 
         for(auto& j : jobs) {
             auto es = j.get();
@@ -559,53 +630,178 @@ namespace pog3
         }
     }
 
-    void GetAllRewardableEntrants(
+    void SetupContext(
             CGSContext& context,
-            referral::ReferralsViewCache& db,
             const Consensus::Params& params,
-            int height,
-            Entrants& entrants)
+            int height)
     {
-        assert(height >= 0);
-
         context.tip_height = height;
         context.coin_maturity = params.pog3_coin_maturity;
         context.new_coin_maturity = params.pog3_new_coin_maturity;
+        context.coin_age_scales = GetAgeScales(context.coin_maturity, height);
+        context.beacon_age_scales = GetAgeScales(context.new_coin_maturity, height);
         context.B = params.pog3_convex_b;
         context.S = params.pog3_convex_s;
+    }
+
+    void ComputeRewardableEntrants(
+            CGSContext& context,
+            referral::ReferralsViewCache& db,
+            const Consensus::Params& params,
+            Entrants& entrants)
+    {
+        ComputeAges(context);
+        ComputeContributions(context, params, context.scores);
+        ComputeAllScores(context, context.scores, params, entrants);
+    }
+
+    void ComputeFixedPointEntrants(
+            const CGSContext& context,
+            const Consensus::Params& params,
+            Entrants& entrants)
+    {
+        FixedScores scores;
+        ComputeContributions(context, params, scores);
+        ComputeAllScores(context, scores, params, entrants);
+    }
+
+    void RebuildAllRewardableEntrants(
+            CGSContext& context,
+            referral::ReferralsViewCache& db,
+            const Consensus::Params& params,
+            int height,
+            Entrants& entrants)
+    {
+        assert(height >= 0);
+
+        SetupContext(context, params, height);
         PrefillContributionsAndHeights(
                 context,
                 2,
                 params.genesis_address,
                 db);
-        GetAllCoins(context, height);
-        ComputeAges(context);
 
-        ComputeAllContributions(context, db);
-        context.tree_contribution = ContributionSubtreeIter(context, 2, params.genesis_address, db);
+        ComputeRewardableEntrants(context, db, params, entrants);
+    }
 
-        ComputeAllScores(context, db, params, entrants);
+    bool SameEntrants(const Entrants& a, const Entrants& b)
+    {
+        return a.size() == b.size() &&
+            std::equal(a.begin(), a.end(), b.begin(),
+                [](const Entrant& x, const Entrant& y) {
+                    return x.address_type == y.address_type &&
+                        x.address == y.address &&
+                        x.balance == y.balance &&
+                        x.aged_balance == y.aged_balance &&
+                        x.cgs == y.cgs &&
+                        x.beacon_height == y.beacon_height &&
+                        x.children == y.children &&
+                        x.network_size == y.network_size;
+                });
+    }
+
+    void GetAllRewardableEntrants(
+            CGSContext& context,
+            referral::ReferralsViewCache& db,
+            const Consensus::Params& params,
+            const uint256& tip_hash,
+            int height,
+            Entrants& entrants)
+    {
+        assert(height >= 0);
+
+        auto& state = GetCgsState();
+
+        SetupContext(context, params, height);
+        if (tip_hash.IsNull() || !state.Fill(context, db, params.genesis_address, tip_hash)) {
+            RebuildAllRewardableEntrants(context, db, params, height, entrants);
+            return;
+        }
+
+        ComputeRewardableEntrants(context, db, params, entrants);
+
+        if (!state.Verify()) {
+            return;
+        }
+
+        CGSContext rebuilt_context;
+        rebuilt_context.cgs_pool = context.cgs_pool;
+
+        Entrants rebuilt_entrants;
+        rebuilt_entrants.reserve(entrants.size());
+        RebuildAllRewardableEntrants(rebuilt_context, db, params, height, rebuilt_entrants);
+
+        if (rebuilt_context.scores.tree_contribution.value != context.scores.tree_contribution.value ||
+                !SameEntrants(rebuilt_entrants, entrants)) {
+            LogPrintf("%s: CGS state at %s diverged from a full rebuild at height %d (%d vs %d entrants), using the rebuild\n",
+                    __func__, tip_hash.GetHex(), height, entrants.size(), rebuilt_entrants.size());
+
+            state.Invalidate();
+            context = std::move(rebuilt_context);
+            entrants = std::move(rebuilt_entrants);
+        }
     }
 
     CachedEntrant& CGSContext::AddEntrant(
             char address_type,
             const referral::Address& address,
-            int height,
-            const Children& children)
+            int height)
     {
+        assert(entrants.size() < std::numeric_limits<EntrantIdx>::max());
 
         CachedEntrant e;
         e.address = address;
         e.address_type = address_type;
         e.height = height;
-        e.children = children;
 
         entrants.emplace_back(e);
+        child_offsets.push_back(child_offsets.back());
+        coin_offsets.push_back(coin_offsets.back());
+
         auto ei = entrant_idx.insert(std::make_pair(address, entrants.size() - 1));
         assert(ei.second);
         return entrants.back();
     }
 
+    void CGSContext::AddChild(size_t child_idx)
+    {
+        assert(!entrants.empty());
+        assert(child_idx < std::numeric_limits<EntrantIdx>::max());
+
+        children.push_back(child_idx);
+        child_offsets.back()++;
+    }
+
+    void CGSContext::AddCoin(const Coin& coin)
+    {
+        assert(!entrants.empty());
+        assert(coins.size() < std::numeric_limits<uint32_t>::max());
+
+        coins.push_back(coin);
+        coin_offsets.back()++;
+    }
+
+    Span<EntrantIdx> CGSContext::GetChildren(size_t idx) const
+    {
+        assert(idx + 1 < child_offsets.size());
+        const auto begin = children.data();
+        return {begin + child_offsets[idx], begin + child_offsets[idx + 1]};
+    }
+
+    Span<Coin> CGSContext::GetCoins(size_t idx) const
+    {
+        assert(idx + 1 < coin_offsets.size());
+        const auto begin = coins.data();
+        return {begin + coin_offsets[idx], begin + coin_offsets[idx + 1]};
+    }
+
+    size_t CGSContext::GetEntrantIdx(const referral::Address& a) const
+    {
+        const auto p = entrant_idx.find(a);
+        assert(p != entrant_idx.end());
+        return p->second;
+    }
+
     CachedEntrant& CGSContext::GetEntrant(const referral::Address& a)
     {
         auto p = entrant_idx.find(a);
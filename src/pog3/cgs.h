@@ -10,8 +10,10 @@
 #include "ctpl/ctpl.h"
 #include "referrals.h"
 #include "pog/wrs.h"
+#include "pog3/fixed.h"
 #include "coins.h"
 
+#include <memory>
 #include <vector>
 #include <boost/optional.hpp>
 
@@ -33,17 +35,38 @@ namespace pog3
     using MaybeEntrant = boost::optional<Entrant>;
 
     using ContributionAmount = pog::BigFloat;
-    struct Contribution
+
+    template <class V>
+    struct BasicContribution
     {
-        ContributionAmount value = 0.0;
+        V value = V{0};
     };
 
-    struct SubtreeContribution
+    template <class V>
+    struct BasicSubtreeContribution
     {
-        ContributionAmount value = 0.0;
+        V value = V{0};
         size_t tree_size = 0;
     };
 
+    /**
+     * Contributions of the entrants of a CGSContext, indexed like its
+     * entrants. The numeric type is a parameter so the computation can be
+     * checked against FixedAmount, consensus uses ContributionAmount.
+     */
+    template <class V>
+    struct BasicScores
+    {
+        std::vector<BasicContribution<V>> contributions;
+        std::vector<BasicSubtreeContribution<V>> subtree_contributions;
+        BasicSubtreeContribution<V> tree_contribution;
+    };
+
+    using Contribution = BasicContribution<ContributionAmount>;
+    using SubtreeContribution = BasicSubtreeContribution<ContributionAmount>;
+    using Scores = BasicScores<ContributionAmount>;
+    using FixedScores = BasicScores<FixedAmount>;
+
     //Aged and non-aged balance.
     using BalancePair = std::pair<CAmount, CAmount>;
     using BalancePairs = std::vector<BalancePair>;
@@ -65,37 +88,80 @@ namespace pog3
     using Addresses = std::vector<referral::Address>;
     using Children = Addresses;
 
+    //AgeScale of every age in blocks, for one maturity.
+    using AgeScaleTable = std::vector<double>;
+    using AgeScaleTablePtr = std::shared_ptr<const AgeScaleTable>;
+
+    using EntrantIdx = uint32_t;
+    using EntrantIdxs = std::vector<EntrantIdx>;
+    using Offsets = std::vector<uint32_t>;
+
     struct CachedEntrant
     {
         referral::Address address;
         char address_type;
-        Coins coins;
         BalancePair balances;
-        Contribution contribution;
         int height;
-        Children children;
     };
 
+    template <class T>
+    struct Span
+    {
+        const T* first;
+        const T* last;
+
+        const T* begin() const { return first; }
+        const T* end() const { return last; }
+        size_t size() const { return last - first; }
+        bool empty() const { return first == last; }
+    };
+
+    /**
+     * Entrants are stored in breadth first order from the genesis address.
+     * Their children and coins live in two flat arrays, children as entrant
+     * indices, with entrant i owning the range [offsets[i], offsets[i+1]).
+     * Addresses are only resolved to indices once, when the context is filled.
+     */
     struct CGSContext
     {
         int tip_height;
         int coin_maturity;
         int new_coin_maturity;
-        SubtreeContribution tree_contribution; 
+        AgeScaleTablePtr coin_age_scales;
+        AgeScaleTablePtr beacon_age_scales;
 
         std::vector<CachedEntrant> entrants;
         std::map<referral::Address, size_t> entrant_idx;
 
-        std::map<referral::Address, SubtreeContribution> subtree_contribution;
+        Offsets child_offsets{0};
+        EntrantIdxs children;
+
+        Offsets coin_offsets{0};
+        Coins coins;
+
+        Scores scores;
         double B;
         double S;
 
+        /**
+         * Adds an entrant after the last one. Its children and coins are then
+         * added with AddChild and AddCoin.
+         */
         CachedEntrant& AddEntrant(
                 char address_type,
                 const referral::Address& address,
-                int height,
-                const Children& children);
+                int height);
+
+        /** Adds a child to the last entrant added. */
+        void AddChild(size_t child_idx);
+
+        /** Adds a coin to the last entrant added. */
+        void AddCoin(const Coin& coin);
+
+        Span<EntrantIdx> GetChildren(size_t idx) const;
+        Span<Coin> GetCoins(size_t idx) const;
 
+        size_t GetEntrantIdx(const referral::Address&) const;
         CachedEntrant& GetEntrant(const referral::Address&);
         const CachedEntrant& GetEntrant(const referral::Address&) const;
 
@@ -104,18 +170,44 @@ namespace pog3
 
     using Entrants = std::vector<Entrant>;
 
+    /**
+     * tip_hash is the block the referral and unspent index DBs are at.
+     */
     void GetAllRewardableEntrants(
             CGSContext& context,
             referral::ReferralsViewCache&,
             const Consensus::Params&,
+            const uint256& tip_hash,
             int height,
             Entrants&);
 
 
-    Entrant ComputeCGS(
+    int GetReferralHeight(
+            referral::ReferralsViewCache& db,
+            const referral::Address& address);
+
+    /**
+     * Adds the coins of the address at or below the context tip height to
+     * the last entrant added to the context.
+     */
+    void AddEntrantCoins(
             CGSContext& context,
-            const CachedEntrant& entrant,
-            referral::ReferralsViewCache& db);
+            const referral::Address& address);
+
+    /** Computes the entrant at entrant_idx from the scores of the context. */
+    Entrant ComputeCGS(
+            const CGSContext& context,
+            size_t entrant_idx);
+
+    /**
+     * Recomputes the entrants of a context already filled by
+     * GetAllRewardableEntrants using FixedAmount instead of
+     * ContributionAmount. Used to check the two agree.
+     */
+    void ComputeFixedPointEntrants(
+            const CGSContext& context,
+            const Consensus::Params&,
+            Entrants&);
 
     void TestChain();
     void SetupCgsThreadPool(size_t threads);
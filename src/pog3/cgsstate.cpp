@@ -0,0 +1,217 @@
+// Copyright (c) 2017-2021 The Merit Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "pog3/cgsstate.h"
+#include "util.h"
+#include "validation.h"
+
+#include <deque>
+
+namespace pog3
+{
+    namespace
+    {
+        CGSState g_cgs_state;
+    }
+
+    CGSState& GetCgsState()
+    {
+        return g_cgs_state;
+    }
+
+    void CGSState::SetVerify(bool verify)
+    {
+        LOCK(m_cs);
+        m_verify = verify;
+    }
+
+    bool CGSState::Verify() const
+    {
+        LOCK(m_cs);
+        return m_verify;
+    }
+
+    void CGSState::Invalidate()
+    {
+        LOCK(m_cs);
+        Clear();
+    }
+
+    void CGSState::Clear()
+    {
+        m_nodes.clear();
+        m_tip.SetNull();
+        m_valid = false;
+    }
+
+    /**
+     * Walks the referral tree breadth first from the genesis address the same
+     * way PrefillContributionsAndHeights does.
+     */
+    bool CGSState::Rebuild(
+            referral::ReferralsViewCache& db,
+            const referral::Address& genesis_address,
+            const uint256& tip_hash)
+    {
+        Clear();
+
+        std::deque<AddressPair> q;
+        q.push_back(std::make_pair(2, genesis_address));
+        while (!q.empty()) {
+            const auto p = q.front();
+            q.pop_front();
+
+            auto& node = m_nodes[p.second];
+            node.address_type = p.first;
+            node.height = GetReferralHeight(db, p.second);
+            node.children = db.GetChildren(p.second);
+
+            for (const auto& c : node.children) {
+                const auto maybe_ref = db.GetReferral(c);
+                if (!maybe_ref) {
+                    continue;
+                }
+
+                q.push_back(std::make_pair(maybe_ref->addressType, maybe_ref->GetAddress()));
+            }
+        }
+
+        LogPrint(BCLog::POG, "%s: rebuilt CGS state at %s with %d beacons\n",
+                __func__, tip_hash.GetHex(), m_nodes.size());
+
+        m_tip = tip_hash;
+        m_valid = true;
+        return true;
+    }
+
+    bool CGSState::Walk(
+            referral::ReferralsViewCache& db,
+            const referral::Address& genesis_address,
+            const uint256& tip_hash,
+            const BeaconVisitor& visit)
+    {
+        //Heights are resolved through the block index, so cs_main is always
+        //taken before m_cs.
+        AssertLockHeld(cs_main);
+        LOCK(m_cs);
+
+        if (!m_valid || m_tip != tip_hash) {
+            if (!Rebuild(db, genesis_address, tip_hash)) {
+                return false;
+            }
+        }
+
+        Children children;
+        std::deque<AddressPair> q;
+        q.push_back(std::make_pair(2, genesis_address));
+        while (!q.empty()) {
+            const auto p = q.front();
+            q.pop_front();
+
+            auto n = m_nodes.find(p.second);
+            if (n == m_nodes.end()) {
+                LogPrintf("%s: CGS state is missing beacon %s, dropping it\n",
+                        __func__, p.second.GetHex());
+                Clear();
+                return false;
+            }
+
+            auto& node = n->second;
+
+            //The heights of beacons not yet known are resolved on every call
+            //by a walk of the DB, so do the same here.
+            if (node.height < 0) {
+                node.height = GetReferralHeight(db, p.second);
+            }
+
+            children.clear();
+            for (const auto& c : node.children) {
+                const auto child = m_nodes.find(c);
+                if (child == m_nodes.end()) {
+                    continue;
+                }
+
+                children.push_back(c);
+                q.push_back(std::make_pair(child->second.address_type, c));
+            }
+
+            visit(p.first, p.second, node.height, children);
+        }
+
+        return true;
+    }
+
+    bool CGSState::Fill(
+            CGSContext& context,
+            referral::ReferralsViewCache& db,
+            const referral::Address& genesis_address,
+            const uint256& tip_hash)
+    {
+        AssertLockHeld(cs_main);
+        assert(context.entrants.empty());
+
+        //Entrants get their index in the order they are queued in.
+        size_t next_idx = 1;
+        const bool filled = Walk(db, genesis_address, tip_hash,
+                [&context, &next_idx](
+                    char address_type,
+                    const referral::Address& address,
+                    int height,
+                    const Children& children) {
+                    context.AddEntrant(address_type, address, height);
+                    AddEntrantCoins(context, address);
+
+                    for (size_t i = 0; i < children.size(); i++) {
+                        context.AddChild(next_idx++);
+                    }
+                });
+
+        if (!filled) {
+            auto pool = context.cgs_pool;
+            context = CGSContext{};
+            context.cgs_pool = pool;
+        }
+
+        return filled;
+    }
+
+    void CGSState::BlockConnected(
+            const uint256& block_hash,
+            const uint256& prev_hash,
+            int height,
+            const referral::ReferralRefs& referrals)
+    {
+        AssertLockHeld(cs_main);
+        LOCK(m_cs);
+        if (!m_valid) {
+            return;
+        }
+
+        if (m_tip != prev_hash) {
+            Clear();
+            return;
+        }
+
+        //Beacons are appended to the children of their parent just like
+        //ReferralsViewDB::InsertReferral does. Beacons whose parent isn't
+        //reachable from the genesis address are never walked so they are skipped.
+        for (const auto& ref : referrals) {
+            const auto address = ref->GetAddress();
+            if (m_nodes.count(address) > 0) {
+                continue;
+            }
+
+            auto parent = m_nodes.find(ref->parentAddress);
+            if (parent == m_nodes.end()) {
+                continue;
+            }
+
+            parent->second.children.push_back(address);
+            m_nodes.emplace(address, Node{ref->addressType, height, {}});
+        }
+
+        m_tip = block_hash;
+    }
+
+} // namespace pog3
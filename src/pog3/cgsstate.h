@@ -0,0 +1,119 @@
+// Copyright (c) 2017-2021 The Merit Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MERIT_POG3_CGSSTATE_H
+#define MERIT_POG3_CGSSTATE_H
+
+#include "pog3/cgs.h"
+#include "primitives/referral.h"
+#include "referrals.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <functional>
+#include <map>
+#include <vector>
+
+/** Default for -cgsverify, cross check the CGS state against a full rebuild. */
+static const bool DEFAULT_CGS_VERIFY = false;
+
+namespace pog3
+{
+    /**
+     * CGSState keeps the part of the CGS computation that does not depend on
+     * the tip height alive across blocks: which beacons are reachable from the
+     * genesis address, their heights and their children. Coins are read per
+     * entrant from the address grouped unspent cache of the block tree DB.
+     *
+     * ConnectBlock feeds it the beacons of every block so
+     * GetAllRewardableEntrants does not have to walk the referral tree in the
+     * DB each time it is called. Aging, contributions and scores depend on
+     * the tip height and are still computed per call from this state.
+     *
+     * The tree is the same in every era so pog2::GetAllRewardableEntrants
+     * walks it too. That way the state built for the first pog2 block is
+     * carried block by block through the pog2 and pog3 eras during IBD.
+     *
+     * The state is tied to the block hash the referral DB was at when it was
+     * last updated. Any mismatch, or a disconnected block, drops it and the
+     * next call rebuilds it from the DB.
+     */
+    class CGSState
+    {
+    public:
+        using BeaconVisitor = std::function<void(
+                char address_type,
+                const referral::Address& address,
+                int height,
+                const Children& children)>;
+
+        /**
+         * Visits the beacons reachable from the genesis address breadth first,
+         * in the same order a walk of the referral DB would. The children
+         * given are the ones that are visited later. Returns false if the
+         * state could not be used, in which case it is dropped and the
+         * visitor must discard whatever it was given. cs_main must be held.
+         */
+        bool Walk(
+                referral::ReferralsViewCache& db,
+                const referral::Address& genesis_address,
+                const uint256& tip_hash,
+                const BeaconVisitor& visit);
+
+        /**
+         * Fills the entrants of the context in the same order and with the
+         * same values a walk of the DBs would. The tip_height of the context
+         * must already be set. Returns false if the context could not be filled,
+         * in which case the context is left empty. cs_main must be held.
+         */
+        bool Fill(
+                CGSContext& context,
+                referral::ReferralsViewCache& db,
+                const referral::Address& genesis_address,
+                const uint256& tip_hash);
+
+        /**
+         * Applies the beacons of a block connected on top of prev_hash. The
+         * referrals must be in the order they were inserted into the
+         * referral DB. cs_main must be held.
+         */
+        void BlockConnected(
+                const uint256& block_hash,
+                const uint256& prev_hash,
+                int height,
+                const referral::ReferralRefs& referrals);
+
+        /** Drops the state, it is rebuilt on next use. */
+        void Invalidate();
+
+        void SetVerify(bool verify);
+        bool Verify() const;
+
+    private:
+        struct Node
+        {
+            char address_type;
+            int height;
+            Children children;
+        };
+
+        bool Rebuild(
+                referral::ReferralsViewCache& db,
+                const referral::Address& genesis_address,
+                const uint256& tip_hash);
+
+        void Clear();
+
+        mutable CCriticalSection m_cs;
+        std::map<referral::Address, Node> m_nodes;
+        uint256 m_tip;
+        bool m_valid = false;
+        bool m_verify = DEFAULT_CGS_VERIFY;
+    };
+
+    CGSState& GetCgsState();
+
+} // namespace pog3
+
+#endif //MERIT_POG3_CGSSTATE_H
@@ -0,0 +1,206 @@
+// Copyright (c) 2017-2021 The Merit Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "pog3/fixed.h"
+
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+namespace pog3
+{
+    namespace
+    {
+        using Raw = FixedAmount::Raw;
+        using Wide = boost::multiprecision::int256_t;
+
+        const int F = FixedAmount::FRACTION_BITS;
+        const Raw ONE = Raw{1} << F;
+        const Raw TWO = ONE * 2;
+        const Wide MAX_RAW = (Wide{1} << 127) - 1;
+
+        Raw Abs(const Raw& r)
+        {
+            return r < 0 ? Raw{-r} : r;
+        }
+
+        Raw ShiftRight(const Raw& r, int bits)
+        {
+            assert(r >= 0);
+            assert(bits >= 0);
+            return bits >= 128 ? Raw{0} : Raw{r >> bits};
+        }
+
+        Raw MulMagnitude(const Raw& a, const Raw& b)
+        {
+            assert(a >= 0);
+            assert(b >= 0);
+
+            const Wide p = (Wide{a} * Wide{b}) >> F;
+            assert(p <= MAX_RAW);
+            return static_cast<Raw>(p);
+        }
+
+        /**
+         * 2^(2^-i) for i in [0, F], computed by repeated integer square roots
+         * of 2 so the table is the same everywhere.
+         */
+        std::vector<Raw> ComputeExp2Table()
+        {
+            std::vector<Raw> table;
+            table.reserve(F + 1);
+            table.push_back(TWO);
+            for (int i = 1; i <= F; i++) {
+                const Wide squared = Wide{table.back()} << F;
+                table.push_back(static_cast<Raw>(boost::multiprecision::sqrt(squared)));
+            }
+            return table;
+        }
+
+        const std::vector<Raw>& Exp2Table()
+        {
+            static const std::vector<Raw> table = ComputeExp2Table();
+            return table;
+        }
+    }
+
+    FixedAmount::FixedAmount(double v) : m_raw{0}
+    {
+        assert(std::isfinite(v));
+        if (v == 0) {
+            return;
+        }
+
+        //|v| = mantissa * 2^(exponent - 53) exactly.
+        int exponent = 0;
+        const double m = std::frexp(std::fabs(v), &exponent);
+        const Raw mantissa{static_cast<int64_t>(std::ldexp(m, 53))};
+
+        const int shift = exponent - 53 + F;
+        assert(shift + 53 < 127);
+
+        m_raw = shift >= 0 ? Raw{mantissa << shift} : ShiftRight(mantissa, -shift);
+        if (v < 0) {
+            m_raw = -m_raw;
+        }
+    }
+
+    FixedAmount FixedAmount::FromRaw(const Raw& raw)
+    {
+        FixedAmount f;
+        f.m_raw = raw;
+        return f;
+    }
+
+    CAmount FixedAmount::ToAmount() const
+    {
+        const auto integer = (Abs(m_raw) >> F).convert_to<CAmount>();
+        return m_raw < 0 ? -integer : integer;
+    }
+
+    double FixedAmount::ToDouble() const
+    {
+        return std::ldexp(m_raw.convert_to<double>(), -F);
+    }
+
+    FixedAmount& FixedAmount::operator*=(const FixedAmount& o)
+    {
+        const bool negative = (m_raw < 0) != (o.m_raw < 0);
+        m_raw = MulMagnitude(Abs(m_raw), Abs(o.m_raw));
+        if (negative) {
+            m_raw = -m_raw;
+        }
+        return *this;
+    }
+
+    FixedAmount& FixedAmount::operator/=(const FixedAmount& o)
+    {
+        assert(o.m_raw != 0);
+
+        const bool negative = (m_raw < 0) != (o.m_raw < 0);
+        const Wide q = (Wide{Abs(m_raw)} << F) / Wide{Abs(o.m_raw)};
+        assert(q <= MAX_RAW);
+
+        m_raw = static_cast<Raw>(q);
+        if (negative) {
+            m_raw = -m_raw;
+        }
+        return *this;
+    }
+
+    FixedAmount log2(const FixedAmount& x)
+    {
+        assert(x > 0);
+
+        //Normalize x to m * 2^k with m within [1, 2).
+        Raw m = x.GetRaw();
+        const int k = static_cast<int>(boost::multiprecision::msb(m)) - F;
+        m = k >= 0 ? ShiftRight(m, k) : Raw{m << -k};
+
+        Raw result = Raw{k < 0 ? -k : k} << F;
+        if (k < 0) {
+            result = -result;
+        }
+
+        //Each squaring of m yields the next bit of log2(m).
+        for (int bit = F - 1; bit >= 0; bit--) {
+            m = MulMagnitude(m, m);
+            if (m >= TWO) {
+                m >>= 1;
+                result += Raw{1} << bit;
+            }
+        }
+
+        return FixedAmount::FromRaw(result);
+    }
+
+    FixedAmount exp2(const FixedAmount& x)
+    {
+        //Split x into floor(x) and a fraction within [0, 1).
+        const auto& raw = x.GetRaw();
+        const Raw integer = raw >= 0 ?
+            Raw{raw >> F} :
+            Raw{-((-raw + ONE - 1) >> F)};
+        const Raw fraction = raw - integer * ONE;
+
+        assert(fraction >= 0);
+        assert(fraction < ONE);
+
+        const auto& table = Exp2Table();
+
+        Raw result = ONE;
+        for (int i = 1; i <= F; i++) {
+            if (boost::multiprecision::bit_test(fraction, F - i)) {
+                result = MulMagnitude(result, table[i]);
+            }
+        }
+
+        const auto n = integer.convert_to<int64_t>();
+        if (n >= 0) {
+            assert(n < 127 - F - 1);
+            result <<= static_cast<unsigned>(n);
+        } else {
+            result = n <= -128 ? Raw{0} : ShiftRight(result, static_cast<int>(-n));
+        }
+
+        return FixedAmount::FromRaw(result);
+    }
+
+    FixedAmount pow(const FixedAmount& x, const FixedAmount& y)
+    {
+        assert(x >= 0);
+
+        if (y == 0) {
+            return FixedAmount{1};
+        }
+
+        if (x == 0) {
+            assert(y > 0);
+            return FixedAmount{};
+        }
+
+        return exp2(y * log2(x));
+    }
+
+} // namespace pog3
@@ -0,0 +1,75 @@
+// Copyright (c) 2017-2021 The Merit Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MERIT_POG3_FIXED_H
+#define MERIT_POG3_FIXED_H
+
+#include "amount.h"
+
+#include <boost/multiprecision/cpp_int.hpp>
+
+namespace pog3
+{
+    /**
+     * Signed Q64.64 fixed point number used as a cheaper alternative to
+     * cpp_dec_float_50 in the CGS computation.
+     *
+     * All operations are done with integer arithmetic and truncate toward
+     * zero so results are identical on every platform. Doubles are converted
+     * exactly, not through their decimal representation.
+     */
+    class FixedAmount
+    {
+    public:
+        using Raw = boost::multiprecision::int128_t;
+
+        static const int FRACTION_BITS = 64;
+
+        FixedAmount() : m_raw{0} {}
+        FixedAmount(int v) : m_raw{Raw{v} << FRACTION_BITS} {}
+        FixedAmount(CAmount v) : m_raw{Raw{v} << FRACTION_BITS} {}
+        explicit FixedAmount(double v);
+
+        static FixedAmount FromRaw(const Raw& raw);
+        const Raw& GetRaw() const { return m_raw; }
+
+        /** Integer part, truncated toward zero. */
+        CAmount ToAmount() const;
+        double ToDouble() const;
+
+        FixedAmount& operator+=(const FixedAmount& o) { m_raw += o.m_raw; return *this; }
+        FixedAmount& operator-=(const FixedAmount& o) { m_raw -= o.m_raw; return *this; }
+        FixedAmount& operator*=(const FixedAmount& o);
+        FixedAmount& operator/=(const FixedAmount& o);
+
+        FixedAmount operator-() const { return FromRaw(-m_raw); }
+
+        friend FixedAmount operator+(FixedAmount a, const FixedAmount& b) { return a += b; }
+        friend FixedAmount operator-(FixedAmount a, const FixedAmount& b) { return a -= b; }
+        friend FixedAmount operator*(FixedAmount a, const FixedAmount& b) { return a *= b; }
+        friend FixedAmount operator/(FixedAmount a, const FixedAmount& b) { return a /= b; }
+
+        friend bool operator==(const FixedAmount& a, const FixedAmount& b) { return a.m_raw == b.m_raw; }
+        friend bool operator!=(const FixedAmount& a, const FixedAmount& b) { return a.m_raw != b.m_raw; }
+        friend bool operator<(const FixedAmount& a, const FixedAmount& b) { return a.m_raw < b.m_raw; }
+        friend bool operator<=(const FixedAmount& a, const FixedAmount& b) { return a.m_raw <= b.m_raw; }
+        friend bool operator>(const FixedAmount& a, const FixedAmount& b) { return a.m_raw > b.m_raw; }
+        friend bool operator>=(const FixedAmount& a, const FixedAmount& b) { return a.m_raw >= b.m_raw; }
+
+    private:
+        Raw m_raw;
+    };
+
+    /** log2(x) for x > 0. */
+    FixedAmount log2(const FixedAmount& x);
+
+    /** 2^x */
+    FixedAmount exp2(const FixedAmount& x);
+
+    /** x^y for x >= 0, computed as 2^(y * log2(x)). */
+    FixedAmount pow(const FixedAmount& x, const FixedAmount& y);
+
+} // namespace pog3
+
+#endif //MERIT_POG3_FIXED_H
@@ -10,6 +10,7 @@
 
 #include <algorithm>
 #include <iterator>
+#include <numeric>
 #include "referrals.h"
 
 namespace pog3
@@ -58,39 +59,31 @@ namespace pog3
      * blockchain gets, then there should be no issue handling growth.
      */
     CgsDistribution::CgsDistribution(pog3::Entrants cgses) :
-        m_inverted(cgses.size())
+        m_entrants(std::move(cgses)),
+        m_order(m_entrants.size()),
+        m_cdf(m_entrants.size())
     {
-        //index cgses by address id for convenience.
-        std::transform(
-                std::begin(cgses),
-                std::end(cgses),
-                std::inserter(m_cgses, std::end(m_cgses)),
-
-                [](const pog3::Entrant& v) {
-                    assert(v.cgs >= 0);
-                    return std::make_pair(v.address, v);
+        //Sort indices instead of copies of the entrants.
+        std::iota(std::begin(m_order), std::end(m_order), 0);
+        std::sort(std::begin(m_order), std::end(m_order),
+                [this](size_t a, size_t b) {
+                    const auto& x = m_entrants[a];
+                    const auto& y = m_entrants[b];
+                    return x.cgs == y.cgs ? x.address < y.address : x.cgs < y.cgs;
                 });
 
-        assert(m_cgses.size() == cgses.size());
-
-        std::sort(std::begin(cgses), std::end(cgses),
-                [](const pog3::Entrant& a, const pog3::Entrant& b) {
-                    return a.cgs == b.cgs ? a.address < b.address : a.cgs < b.cgs;
-                });
-
-        assert(m_inverted.size() == cgses.size());
-
         //compute CDF by adding up all the CGSs
         CAmount previous_cgs = 0;
-        std::transform(std::begin(cgses), std::end(cgses), std::begin(m_inverted),
-                [&previous_cgs](pog3::Entrant w) {
-                    w.cgs += previous_cgs;
-                    previous_cgs = w.cgs;
-                    return w;
+        std::transform(std::begin(m_order), std::end(m_order), std::begin(m_cdf),
+                [this, &previous_cgs](size_t i) {
+                    const auto cgs = m_entrants[i].cgs;
+                    assert(cgs >= 0);
+                    previous_cgs += cgs;
+                    return previous_cgs;
                 });
 
-        //back will always return because we assume m_cgses is non-empty
-        if(!m_inverted.empty()) m_max_cgs = m_inverted.back().cgs;
+        //back will always return because we assume m_entrants is non-empty
+        if(!m_cdf.empty()) m_max_cgs = m_cdf.back();
 
         assert(m_max_cgs >= 0);
     }
@@ -98,32 +91,29 @@ namespace pog3
     pog3::MaybeEntrant CgsDistribution::Sample(const uint256& hash) const
     {
         //It doesn't make sense to sample from an empty distribution.
-        assert(m_inverted.empty() == false);
+        assert(m_cdf.empty() == false);
         if(m_max_cgs == 0) {
             return {};
         }
 
         const auto selected_cgs = SipHashUint256(0, 0, hash) % m_max_cgs;
 
-        auto pos = std::lower_bound(std::begin(m_inverted), std::end(m_inverted),
+        auto pos = std::lower_bound(std::begin(m_cdf), std::end(m_cdf),
                 selected_cgs,
-                [](const pog3::Entrant& a, CAmount selected) {
-                    return a.cgs < selected;
+                [](CAmount cgs, CAmount selected) {
+                    return cgs < selected;
                 });
 
         assert(m_max_cgs >= 0);
         assert(selected_cgs < static_cast<uint64_t>(m_max_cgs));
-        assert(pos != std::end(m_inverted)); //it should be impossible to not find an cgs
-                                             //because selected_cgs must be less than max
-        auto selected_address = m_cgses.find(pos->address);
+        assert(pos != std::end(m_cdf)); //it should be impossible to not find an cgs
+                                        //because selected_cgs must be less than max
 
-        assert(selected_address != std::end(m_cgses)); //all cgses in m_inverted must be in
-                                                    //our index
-        return selected_address->second;
+        return m_entrants[m_order[std::distance(std::begin(m_cdf), pos)]];
     }
 
     size_t CgsDistribution::Size() const {
-        return m_inverted.size();
+        return m_order.size();
     }
 
     const pog3::Entrants& CgsDistribution::Entrants() const
@@ -0,0 +1,96 @@
+// Copyright (c) 2017-2021 The Merit Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "pog3/snapshot.h"
+#include "sync.h"
+#include "util.h"
+#include "validation.h"
+
+#include <algorithm>
+#include <deque>
+#include <numeric>
+
+namespace pog3
+{
+    namespace
+    {
+        //The RPCs use the lottery at the tip height and validation, as well
+        //as the miner, the one at the next height, so keep both around.
+        const size_t MAX_CGS_SNAPSHOTS = 2;
+
+        CCriticalSection cs_snapshots;
+        std::deque<CGSSnapshotRef> g_snapshots;
+    }
+
+    CGSSnapshotRef FindCgsSnapshot(const uint256& tip_hash, int height)
+    {
+        LOCK(cs_snapshots);
+        const auto s = std::find_if(g_snapshots.begin(), g_snapshots.end(),
+                [&tip_hash, height](const CGSSnapshotRef& s) {
+                    return s->height == height && s->tip_hash == tip_hash;
+                });
+
+        return s != g_snapshots.end() ? *s : CGSSnapshotRef{};
+    }
+
+    void ClearCgsSnapshots()
+    {
+        LOCK(cs_snapshots);
+        g_snapshots.clear();
+    }
+
+    CGSSnapshotRef GetCgsSnapshot(
+            referral::ReferralsViewCache& db,
+            const Consensus::Params& params,
+            const uint256& tip_hash,
+            int height)
+    {
+        AssertLockHeld(cs_main);
+        assert(height >= 0);
+
+        if (auto snapshot = FindCgsSnapshot(tip_hash, height)) {
+            return snapshot;
+        }
+
+        auto snapshot = std::make_shared<CGSSnapshot>();
+        snapshot->tip_hash = tip_hash;
+        snapshot->height = height;
+        snapshot->context.cgs_pool = GetCgsThreadPool();
+
+        GetAllRewardableEntrants(
+                snapshot->context,
+                db,
+                params,
+                tip_hash,
+                height,
+                snapshot->entrants);
+
+        const auto& entrants = snapshot->entrants;
+
+        snapshot->lottery_cgs = std::accumulate(entrants.begin(), entrants.end(), CAmount{0},
+                [](CAmount acc, const Entrant& e) {
+                    return acc + e.cgs;
+                });
+
+        auto& by_cgs = snapshot->by_cgs;
+        by_cgs.resize(entrants.size());
+        std::iota(by_cgs.begin(), by_cgs.end(), 0);
+        std::stable_sort(by_cgs.begin(), by_cgs.end(),
+                [&entrants](size_t a, size_t b) {
+                    return entrants[a].cgs < entrants[b].cgs;
+                });
+
+        LogPrint(BCLog::POG, "%s: computed CGS snapshot at %s for height %d with %d entrants\n",
+                __func__, tip_hash.GetHex(), height, entrants.size());
+
+        LOCK(cs_snapshots);
+        g_snapshots.push_front(snapshot);
+        if (g_snapshots.size() > MAX_CGS_SNAPSHOTS) {
+            g_snapshots.pop_back();
+        }
+
+        return snapshot;
+    }
+
+} // namespace pog3
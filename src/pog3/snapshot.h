@@ -0,0 +1,60 @@
+// Copyright (c) 2017-2021 The Merit Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MERIT_POG3_SNAPSHOT_H
+#define MERIT_POG3_SNAPSHOT_H
+
+#include "amount.h"
+#include "consensus/params.h"
+#include "pog3/cgs.h"
+#include "referrals.h"
+#include "uint256.h"
+
+#include <memory>
+#include <vector>
+
+namespace pog3
+{
+    /**
+     * The rewardable entrants of a lottery at a height computed from the
+     * referral and unspent index DBs at a tip. A snapshot is never modified
+     * once it is published so it can be read without holding cs_main.
+     */
+    struct CGSSnapshot
+    {
+        uint256 tip_hash;
+        int height;
+        CGSContext context;
+        Entrants entrants;
+
+        //Indices into entrants ordered by cgs, lowest first.
+        std::vector<size_t> by_cgs;
+        CAmount lottery_cgs = 0;
+    };
+
+    using CGSSnapshotRef = std::shared_ptr<const CGSSnapshot>;
+
+    /**
+     * Returns the snapshot of the lottery at the height given using the DBs,
+     * which must be at the block tip_hash. It is computed only if it is not
+     * already cached. cs_main must be held.
+     */
+    CGSSnapshotRef GetCgsSnapshot(
+            referral::ReferralsViewCache& db,
+            const Consensus::Params& params,
+            const uint256& tip_hash,
+            int height);
+
+    /**
+     * Returns the cached snapshot for the tip and height given, or null.
+     * Does not need cs_main.
+     */
+    CGSSnapshotRef FindCgsSnapshot(const uint256& tip_hash, int height);
+
+    /** Drops the cached snapshots, for when the DBs go back or are replaced. */
+    void ClearCgsSnapshots();
+
+} // namespace pog3
+
+#endif //MERIT_POG3_SNAPSHOT_H
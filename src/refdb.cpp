@@ -5,9 +5,16 @@
 #include "refdb.h"
 
 #include "base58.h"
+#include "hash.h"
+#include "random.h"
+#include "streams.h"
+#include "util.h"
 #include <boost/rational.hpp>
 #include <boost/multiprecision/cpp_int.hpp>
+#include <algorithm>
+#include <cctype>
 #include <limits>
+#include <map>
 
 namespace pog
 {
@@ -34,9 +41,141 @@ namespace referral
         const char DB_HEIGHT = 'b';
         const char DB_LOT_INV = 'L';
         const char DB_NEW_INVITE_REWARD = 'N';
+        const char DB_CHILD = 'C';
+        const char DB_CHILD_SEQ = 'q';
+        const char DB_NEXT_CHILD_SEQ = 'Q';
+        const char DB_LOADING_SNAPSHOT = 'S';
 
         const size_t MAX_LEVELS = std::numeric_limits<size_t>::max();
 
+        /**
+         * Exits with the chance set by -dbcrashratio, like the coins DB
+         * does while flushing, so tests can leave a snapshot load unfinished.
+         */
+        void MaybeSimulateCrash()
+        {
+            const int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
+            if (crash_simulate) {
+                static FastRandomContext rng;
+                if (rng.randrange(crash_simulate) == 0) {
+                    LogPrintf("Simulating a crash. Goodbye.\n");
+                    _Exit(0);
+                }
+            }
+        }
+
+        /**
+         * Key of one child of a parent. The sequence number is written big
+         * endian so iterating over the keys of a parent gives its children
+         * in the order they were added.
+         */
+        struct ChildKey
+        {
+            Address parent;
+            uint32_t seq;
+
+            template<typename Stream>
+            void Serialize(Stream& s) const
+            {
+                s << parent;
+                ser_writedata32be(s, seq);
+            }
+
+            template<typename Stream>
+            void Unserialize(Stream& s)
+            {
+                s >> parent;
+                seq = ser_readdata32be(s);
+            }
+        };
+
+        /**
+         * Moves all rows whose keys start with the prefix of first from one
+         * DB to another. Rows are written to the new DB before they are
+         * erased from the old one so a move that is interrupted is simply
+         * done again.
+         */
+        template <typename K, typename V>
+        bool MoveRows(CDBWrapper& from, CDBWrapper& to, const K& first, size_t& moved)
+        {
+            const size_t batch_size = 1 << 24;
+
+            std::unique_ptr<CDBIterator> iter{from.NewIterator()};
+            CDBBatch to_batch(to);
+            CDBBatch from_batch(from);
+
+            auto key = first;
+            iter->Seek(key);
+            while (iter->Valid() && iter->GetKey(key) && key.first == first.first) {
+                V value;
+                if (!iter->GetValue(value)) {
+                    return error("%s: cannot parse the value of a '%c' row", __func__, first.first);
+                }
+
+                to_batch.Write(key, value);
+                from_batch.Erase(key);
+                moved++;
+
+                if (to_batch.SizeEstimate() > batch_size) {
+                    if (!to.WriteBatch(to_batch, true) || !from.WriteBatch(from_batch)) {
+                        return false;
+                    }
+                    to_batch.Clear();
+                    from_batch.Clear();
+                }
+
+                iter->Next();
+            }
+
+            return to.WriteBatch(to_batch, true) && from.WriteBatch(from_batch);
+        }
+
+        template <typename V>
+        bool MoveRow(CDBWrapper& from, CDBWrapper& to, char key, size_t& moved)
+        {
+            V value;
+            if (!from.Read(key, value)) {
+                return true;
+            }
+
+            moved++;
+            return to.Write(key, value, true) && from.Erase(key);
+        }
+
+        const uint32_t SNAPSHOT_VERSION = 1;
+        const unsigned char SNAPSHOT_END = 0xff;
+
+        /**
+         * The bytes of a key or value as they are stored, so rows can be
+         * copied without knowing their types.
+         */
+        struct RawBytes
+        {
+            std::vector<unsigned char> bytes;
+
+            template<typename Stream>
+            void Serialize(Stream& s) const
+            {
+                s.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+            }
+
+            template<typename Stream>
+            void Unserialize(Stream& s)
+            {
+                bytes.resize(s.size());
+                s.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+            }
+        };
+
+        //Every referral row is keyed by a one letter DB_ prefix. The other
+        //rows are the obfuscation key of each DB and the marker of a
+        //snapshot being loaded, which are not copied.
+        bool IsReferralRow(const RawBytes& key)
+        {
+            return !key.bytes.empty() && std::isalpha(key.bytes[0]) &&
+                !(key.bytes.size() == 1 && key.bytes[0] == DB_LOADING_SNAPSHOT);
+        }
+
         bool comp(const LotteryEntrant& a, const LotteryEntrant& b) {
             return std::get<0>(a) < std::get<0>(b);
         }
@@ -49,6 +188,8 @@ namespace referral
     using AnvRat = boost::rational<int128_t>;
     using TransactionOutIndex = int;
     using ConfirmationVal = std::pair<char, Address>;
+    //Confirmation pair is an index plus count
+    using ConfirmationPair = std::pair<uint64_t, int>;
 
     namespace {
         class ReferralIdVisitor : public boost::static_visitor<MaybeReferral>
@@ -79,7 +220,10 @@ namespace referral
             size_t cache_size,
             bool memory,
             bool wipe,
-            const std::string& db_name) : m_db(GetDataDir() / db_name, cache_size, memory, wipe, true) {}
+            const std::string& db_name) :
+        m_db(GetDataDir() / db_name, cache_size / 2, memory, wipe, true, true),
+        m_anv_db(GetDataDir() / (db_name + "_anv"), cache_size / 4, memory, wipe, true),
+        m_lottery_db(GetDataDir() / (db_name + "_lottery"), cache_size / 4, memory, wipe, true, false, 64, 0) {}
 
     MaybeReferral ReferralsViewDB::GetReferral(const Address& address) const
     {
@@ -113,6 +257,10 @@ namespace referral
             return {};
         }
 
+        if (!HasAlias(maybe_normalized)) {
+            return {};
+        }
+
         Address address;
         if (m_db.Read(std::make_pair(DB_ALIAS, maybe_normalized), address)) {
             return IsConfirmed(address) ? GetReferral(address) : MaybeReferral{};
@@ -137,21 +285,447 @@ namespace referral
         return m_db.Read(std::make_pair(DB_PUBKEY, pubkey), address) ? MaybeAddress{address} : MaybeAddress{};
     }
 
-    MaybeAddressPair ReferralsViewDB::GetParentAddress(const Address& address) const
+    bool ReferralsViewDB::GetParentAddress(const Address& address, MaybeAddressPair& parent) const
+    {
+        LOCK(m_cs_parents);
+        if (!LoadParents()) {
+            return error("%s: cannot load the referral parents", __func__);
+        }
+
+        parent.reset();
+
+        const auto node = m_parents.nodes.find(address);
+        if (node == m_parents.nodes.end() || !node->second.parent) {
+            return true;
+        }
+
+        const auto& parent_address = *node->second.parent;
+        parent = AddressPair{m_parents.nodes.at(parent_address).address_type, parent_address};
+        return true;
+    }
+
+    void ReferralsViewDB::ParentTable::SetParent(const Address& address, const AddressPair& parent)
+    {
+        RemoveParent(address);
+
+        auto& parent_node = *nodes.emplace(parent.second, Node{}).first;
+        parent_node.second.address_type = parent.first;
+        parent_node.second.children++;
+
+        nodes[address].parent = &parent_node.first;
+    }
+
+    void ReferralsViewDB::ParentTable::RemoveParent(const Address& address)
     {
-        AddressPair parent;
-        return m_db.Read(std::make_pair(DB_PARENT_ADDRESS, address), parent) ?
-            MaybeAddressPair{parent} :
-            MaybeAddressPair{};
+        const auto node = nodes.find(address);
+        if (node == nodes.end() || !node->second.parent) {
+            return;
+        }
+
+        const auto parent = nodes.find(*node->second.parent);
+        assert(parent != nodes.end() && parent->second.children > 0);
+
+        node->second.parent = nullptr;
+        parent->second.children--;
+
+        if (node != parent && node->second.children == 0) {
+            nodes.erase(node);
+        }
+
+        if (parent->second.children == 0 && !parent->second.parent) {
+            nodes.erase(parent);
+        }
+    }
+
+    bool ReferralsViewDB::LoadParents() const
+    {
+        AssertLockHeld(m_cs_parents);
+        if (m_parents.loaded) {
+            return true;
+        }
+
+        ParentTable table;
+
+        std::unique_ptr<CDBIterator> iter{m_db.NewIterator()};
+        auto key = std::make_pair(DB_PARENT_ADDRESS, Address{});
+        iter->Seek(key);
+        while (iter->Valid() && iter->GetKey(key) && key.first == DB_PARENT_ADDRESS) {
+            AddressPair parent;
+            if (!iter->GetValue(parent)) {
+                return error("%s: cannot parse the parent of %s", __func__, key.second.GetHex());
+            }
+
+            table.SetParent(key.second, parent);
+            iter->Next();
+        }
+
+        LogPrint(BCLog::BEACONS, "%s: Loaded the parents of %d addresses\n", __func__, table.nodes.size());
+
+        table.loaded = true;
+        m_parents = std::move(table);
+        return true;
     }
 
     ChildAddresses ReferralsViewDB::GetChildren(const Address& address) const
     {
         ChildAddresses children;
-        m_db.Read(std::make_pair(DB_CHILDREN, address), children);
+
+        std::unique_ptr<CDBIterator> iter{m_db.NewIterator()};
+        auto key = std::make_pair(DB_CHILD, ChildKey{address, 0});
+        iter->Seek(key);
+        while (iter->Valid() &&
+                iter->GetKey(key) &&
+                key.first == DB_CHILD &&
+                key.second.parent == address) {
+            Address child;
+            if (!iter->GetValue(child)) {
+                break;
+            }
+
+            children.push_back(child);
+            iter->Next();
+        }
+
         return children;
     }
 
+    /**
+     * Children are stored one key each so adding a child to a wide parent
+     * does not rewrite all of its other children.
+     */
+    bool ReferralsViewDB::AddChild(const Address& parent, const Address& child)
+    {
+        uint32_t seq = 0;
+        m_db.Read(std::make_pair(DB_NEXT_CHILD_SEQ, parent), seq);
+
+        CDBBatch batch(m_db);
+        batch.Write(std::make_pair(DB_CHILD, ChildKey{parent, seq}), child);
+        batch.Write(std::make_pair(DB_CHILD_SEQ, child), seq);
+        batch.Write(std::make_pair(DB_NEXT_CHILD_SEQ, parent), seq + 1);
+        return m_db.WriteBatch(batch);
+    }
+
+    bool ReferralsViewDB::RemoveChild(const Address& parent, const Address& child)
+    {
+        uint32_t seq;
+        if (!m_db.Read(std::make_pair(DB_CHILD_SEQ, child), seq)) {
+            return true;
+        }
+
+        CDBBatch batch(m_db);
+        batch.Erase(std::make_pair(DB_CHILD, ChildKey{parent, seq}));
+        batch.Erase(std::make_pair(DB_CHILD_SEQ, child));
+        return m_db.WriteBatch(batch);
+    }
+
+    /**
+     * Upgrades the referral DB from older formats. Currently implemented:
+     * - from one DB_CHILDREN vector per parent to one key per child.
+     * - from one database to separate keyspaces, moving the ANV rows to the
+     *   _anv database and the lottery and confirmation rows to the _lottery
+     *   database.
+     */
+    bool ReferralsViewDB::Upgrade()
+    {
+        return UpgradeChildren() && SplitKeyspaces();
+    }
+
+    std::array<CDBWrapper*, 3> ReferralsViewDB::Keyspaces() const
+    {
+        return {{&m_db, &m_anv_db, &m_lottery_db}};
+    }
+
+    bool ReferralsViewDB::DumpSnapshot(const fs::path& path, ReferralSnapshot& snapshot) const
+    {
+        const auto tmp_path = path.string() + ".new";
+
+        try {
+            FILE* filestr = fsbridge::fopen(tmp_path, "wb");
+            if (!filestr) {
+                return error("%s: cannot open %s", __func__, tmp_path);
+            }
+
+            CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+            CHashWriter hasher(SER_GETHASH, 0);
+
+            file << SNAPSHOT_VERSION << snapshot.block_hash << snapshot.height;
+            hasher << SNAPSHOT_VERSION << snapshot.block_hash << snapshot.height;
+
+            snapshot.rows = 0;
+            const auto keyspaces = Keyspaces();
+            for (unsigned char k = 0; k < keyspaces.size(); k++) {
+                std::unique_ptr<CDBIterator> iter{keyspaces[k]->NewIterator()};
+                for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+                    RawBytes key;
+                    RawBytes value;
+                    if (!iter->GetKey(key) || !IsReferralRow(key)) {
+                        continue;
+                    }
+
+                    if (!iter->GetValue(value)) {
+                        return error("%s: cannot read a row of keyspace %d", __func__, k);
+                    }
+
+                    file << k << key.bytes << value.bytes;
+                    hasher << k << key.bytes << value.bytes;
+                    snapshot.rows++;
+                }
+            }
+
+            hasher << snapshot.rows;
+            snapshot.hash = hasher.GetHash();
+            file << SNAPSHOT_END << snapshot.rows << snapshot.hash;
+
+            FileCommit(file.Get());
+            file.fclose();
+            RenameOver(tmp_path, path);
+        } catch (const std::exception& e) {
+            return error("%s: failed to write %s: %s", __func__, path.string(), e.what());
+        }
+
+        LogPrintf("Dumped referral snapshot of %d rows at %s with hash %s\n",
+                snapshot.rows, snapshot.block_hash.GetHex(), snapshot.hash.GetHex());
+        return true;
+    }
+
+    bool ReferralsViewDB::ReadSnapshot(const fs::path& path, bool write, ReferralSnapshot& snapshot)
+    {
+        const size_t batch_size = 1 << 24;
+
+        try {
+            CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+            if (file.IsNull()) {
+                return error("%s: cannot open %s", __func__, path.string());
+            }
+
+            CHashWriter hasher(SER_GETHASH, 0);
+
+            uint32_t version;
+            file >> version;
+            if (version != SNAPSHOT_VERSION) {
+                return error("%s: unknown snapshot version %d", __func__, version);
+            }
+
+            file >> snapshot.block_hash >> snapshot.height;
+            hasher << version << snapshot.block_hash << snapshot.height;
+
+            const auto keyspaces = Keyspaces();
+            std::vector<std::unique_ptr<CDBBatch>> batches;
+            for (auto db : keyspaces) {
+                batches.emplace_back(new CDBBatch{*db});
+            }
+
+            uint64_t rows = 0;
+            while (true) {
+                unsigned char k;
+                file >> k;
+                if (k == SNAPSHOT_END) {
+                    break;
+                }
+
+                if (k >= keyspaces.size()) {
+                    return error("%s: unknown keyspace %d", __func__, k);
+                }
+
+                RawBytes key;
+                RawBytes value;
+                file >> key.bytes >> value.bytes;
+                hasher << k << key.bytes << value.bytes;
+                rows++;
+
+                if (!write) {
+                    continue;
+                }
+
+                auto& batch = *batches[k];
+                batch.Write(key, value);
+                if (batch.SizeEstimate() > batch_size) {
+                    if (!keyspaces[k]->WriteBatch(batch)) {
+                        return false;
+                    }
+                    batch.Clear();
+                }
+            }
+
+            hasher << rows;
+            file >> snapshot.rows >> snapshot.hash;
+            if (rows != snapshot.rows || hasher.GetHash() != snapshot.hash) {
+                return error("%s: %s does not match its hash", __func__, path.string());
+            }
+
+            for (size_t k = 0; write && k < keyspaces.size(); k++) {
+                if (!keyspaces[k]->WriteBatch(*batches[k], true)) {
+                    return false;
+                }
+            }
+        } catch (const std::exception& e) {
+            return error("%s: failed to read %s: %s", __func__, path.string(), e.what());
+        }
+
+        return true;
+    }
+
+    bool ReferralsViewDB::LoadSnapshot(
+            const fs::path& path,
+            const uint256& block_hash,
+            const uint256& hash,
+            ReferralSnapshot& snapshot)
+    {
+        if (!ReadSnapshot(path, false, snapshot)) {
+            return false;
+        }
+
+        if (snapshot.block_hash != block_hash) {
+            return error("%s: the snapshot is of block %s, not %s", __func__,
+                    snapshot.block_hash.GetHex(), block_hash.GetHex());
+        }
+
+        if (!hash.IsNull() && snapshot.hash != hash) {
+            return error("%s: the snapshot hash is %s, not %s", __func__,
+                    snapshot.hash.GetHex(), hash.GetHex());
+        }
+
+        //The rows are replaced over many batches, so a crash part way leaves
+        //a DB that is neither the old one nor the snapshot. The marker is
+        //cleared only once the last batch is synced.
+        if (!m_db.Write(DB_LOADING_SNAPSHOT, block_hash, true)) {
+            return error("%s: cannot mark the snapshot as loading", __func__);
+        }
+
+        //Erase every row so nothing is left over that is not in the snapshot.
+        const size_t batch_size = 1 << 24;
+        for (auto db : Keyspaces()) {
+            std::unique_ptr<CDBIterator> iter{db->NewIterator()};
+            CDBBatch batch(*db);
+            for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+                RawBytes key;
+                if (!iter->GetKey(key) || !IsReferralRow(key)) {
+                    continue;
+                }
+
+                batch.Erase(key);
+                if (batch.SizeEstimate() > batch_size) {
+                    if (!db->WriteBatch(batch)) {
+                        return false;
+                    }
+                    batch.Clear();
+                }
+            }
+
+            if (!db->WriteBatch(batch)) {
+                return false;
+            }
+            MaybeSimulateCrash();
+        }
+
+        {
+            LOCK(m_cs_lottery);
+            m_lottery = LotteryReservoir{};
+        }
+        {
+            LOCK(m_cs_aliases);
+            m_aliases_loaded = false;
+            m_aliases.clear();
+        }
+        {
+            LOCK(m_cs_confirmations);
+            m_confirmations = ConfirmationIndex{};
+        }
+        {
+            LOCK(m_cs_parents);
+            m_parents = ParentTable{};
+        }
+
+        if (!ReadSnapshot(path, true, snapshot)) {
+            return false;
+        }
+
+        if (!m_db.Erase(DB_LOADING_SNAPSHOT, true)) {
+            return error("%s: cannot clear the snapshot loading marker", __func__);
+        }
+
+        LogPrintf("Loaded referral snapshot of %d rows at %s with hash %s\n",
+                snapshot.rows, snapshot.block_hash.GetHex(), snapshot.hash.GetHex());
+        return true;
+    }
+
+    bool ReferralsViewDB::IsLoadingSnapshot() const
+    {
+        return m_db.Exists(DB_LOADING_SNAPSHOT);
+    }
+
+    bool ReferralsViewDB::UpgradeChildren()
+    {
+        std::unique_ptr<CDBIterator> iter{m_db.NewIterator()};
+        auto key = std::make_pair(DB_CHILDREN, Address{});
+        iter->Seek(key);
+        if (!iter->Valid() || !iter->GetKey(key) || key.first != DB_CHILDREN) {
+            return true;
+        }
+
+        LogPrintf("Upgrading referral children index...\n");
+
+        const size_t batch_size = 1 << 24;
+        size_t parents = 0;
+        CDBBatch batch(m_db);
+        while (iter->Valid() && iter->GetKey(key) && key.first == DB_CHILDREN) {
+            ChildAddresses children;
+            if (!iter->GetValue(children)) {
+                return error("%s: cannot parse children of %s", __func__, key.second.GetHex());
+            }
+
+            const auto& parent = key.second;
+            for (uint32_t seq = 0; seq < children.size(); seq++) {
+                batch.Write(std::make_pair(DB_CHILD, ChildKey{parent, seq}), children[seq]);
+                batch.Write(std::make_pair(DB_CHILD_SEQ, children[seq]), seq);
+            }
+
+            batch.Write(std::make_pair(DB_NEXT_CHILD_SEQ, parent), static_cast<uint32_t>(children.size()));
+            batch.Erase(key);
+            parents++;
+
+            if (batch.SizeEstimate() > batch_size) {
+                if (!m_db.WriteBatch(batch)) {
+                    return false;
+                }
+                batch.Clear();
+            }
+
+            iter->Next();
+        }
+
+        if (!m_db.WriteBatch(batch)) {
+            return false;
+        }
+
+        LogPrintf("Upgraded the children of %d referrals\n", parents);
+        return true;
+    }
+
+    bool ReferralsViewDB::SplitKeyspaces()
+    {
+        size_t moved = 0;
+        const bool ok =
+            MoveRows<std::pair<char, Address>, ANVTuple>(
+                    m_db, m_anv_db, std::make_pair(DB_ANV, Address{}), moved) &&
+            MoveRow<uint64_t>(m_db, m_lottery_db, DB_LOT_SIZE, moved) &&
+            MoveRows<std::pair<char, uint64_t>, LotteryEntrant>(
+                    m_db, m_lottery_db, std::make_pair(DB_LOT_VAL, uint64_t{0}), moved) &&
+            MoveRows<std::pair<char, Address>, uint64_t>(
+                    m_db, m_lottery_db, std::make_pair(DB_LOT_INV, Address{}), moved) &&
+            MoveRow<uint64_t>(m_db, m_lottery_db, DB_CONFIRMATION_TOTAL, moved) &&
+            MoveRows<std::pair<char, Address>, ConfirmationPair>(
+                    m_db, m_lottery_db, std::make_pair(DB_CONFIRMATION, Address{}), moved) &&
+            MoveRows<std::pair<char, uint64_t>, ConfirmationVal>(
+                    m_db, m_lottery_db, std::make_pair(DB_CONFIRMATION_IDX, uint64_t{0}), moved);
+
+        if (moved > 0) {
+            LogPrintf("Moved %d ANV and lottery records out of the referrals database\n", moved);
+        }
+
+        return ok;
+    }
+
     bool ReferralsViewDB::InsertReferral(
             int height,
             const Referral& referral,
@@ -182,7 +756,7 @@ namespace referral
         }
 
         ANVTuple anv{referral.addressType, referral.GetAddress(), AnvInternal{0, 1}};
-        if (!m_db.Write(std::make_pair(DB_ANV, referral.GetAddress()), anv)) {
+        if (!m_anv_db.Write(std::make_pair(DB_ANV, referral.GetAddress()), anv)) {
             return false;
         }
 
@@ -204,6 +778,8 @@ namespace referral
             if (!m_db.Write(std::make_pair(DB_ALIAS, maybe_normalized), referral.GetAddress())) {
                 return false;
             }
+
+            AddAlias(maybe_normalized);
         }
 
         // Typically because the referral should be written in order we should
@@ -219,14 +795,16 @@ namespace referral
             if (!m_db.Write(std::make_pair(DB_PARENT_ADDRESS, referral.GetAddress()), parent_addr_pair))
                 return false;
 
-            // Now we update the children of the parent address by inserting into the
-            // child address array for the parent.
-            ChildAddresses children;
-            m_db.Read(std::make_pair(DB_CHILDREN, referral.parentAddress), children);
-
-            children.push_back(referral.GetAddress());
+            {
+                LOCK(m_cs_parents);
+                if (m_parents.loaded) {
+                    m_parents.SetParent(referral.GetAddress(), parent_addr_pair);
+                }
+            }
 
-            if (!m_db.Write(std::make_pair(DB_CHILDREN, referral.parentAddress), children))
+            // Now we update the children of the parent address by appending
+            // to the children of the parent.
+            if (!AddChild(referral.parentAddress, referral.GetAddress()))
                 return false;
 
             LogPrint(BCLog::BEACONS, "Inserted referral %s parent %s\n",
@@ -269,14 +847,14 @@ namespace referral
             return false;
         }
 
-        ChildAddresses children;
-        m_db.Read(std::make_pair(DB_CHILDREN, referral.parentAddress), children);
-
-        children.erase(std::remove(std::begin(children), std::end(children),
-                    referral.GetAddress()),
-                std::end(children));
+        {
+            LOCK(m_cs_parents);
+            if (m_parents.loaded) {
+                m_parents.RemoveParent(referral.GetAddress());
+            }
+        }
 
-        if (!m_db.Write(std::make_pair(DB_CHILDREN, referral.parentAddress), children)) {
+        if (!RemoveChild(referral.parentAddress, referral.GetAddress())) {
             return false;
         }
 
@@ -305,46 +883,128 @@ namespace referral
      * to account for values at the sub-micro level. This design discourages
      * creating long chains of referrals and rewards those who grow wider trees.
      */
-
     bool ReferralsViewDB::UpdateANV(
             char address_type,
             const Address& start_address,
             CAmount change)
     {
+        return UpdateANVs({ANVChange{address_type, start_address, change}});
+    }
 
-        AnvRat change_rat = int128_t{change};
+    /**
+     * Applies all the ANV changes of a block at once. Since the rational sums
+     * are exact the result is the same as calling UpdateANV for each change
+     * in order, but an ancestor shared by many changes is read and written
+     * once instead of once per change, in a single batch.
+     *
+     * The changes are first added to the addresses they are for. These and
+     * their ancestors are then visited deepest first so each address passes
+     * half of everything it received on to its parent in one step.
+     */
+    bool ReferralsViewDB::UpdateANVs(const ANVChanges& changes)
+    {
+        struct Node
+        {
+            MaybeAddress parent;
+            size_t depth = 0;
+            AnvRat change = 0;
+        };
+
+        std::map<Address, Node> nodes;
+        std::vector<Address> path;
 
-        LogPrint(BCLog::BEACONS, "\tUpdateANV: %s + %d\n",
-                CMeritAddress(address_type, start_address).ToString(), change);
+        for (const auto& c : changes) {
+            const auto& start_address = std::get<1>(c);
+            const auto change = std::get<2>(c);
+            if (change == 0) {
+                continue;
+            }
 
-        MaybeAddress address = start_address;
-        size_t level = 0;
+            LogPrint(BCLog::BEACONS, "\tUpdateANV: %s + %d\n",
+                    CMeritAddress(std::get<0>(c), start_address).ToString(), change);
+
+            //Walk up until the root or an address whose path is already known.
+            path.clear();
+            MaybeAddress address = start_address;
+            while (address && nodes.count(*address) == 0) {
+                assert(path.size() < MAX_LEVELS && "reached max levels. Referral DB cycle detected");
+
+                MaybeAddressPair parent;
+                if (!GetParentAddress(*address, parent)) {
+                    return false;
+                }
+
+                path.push_back(*address);
+                auto& node = nodes[*address];
+                if (parent) {
+                    node.parent = parent->second;
+                }
+                address = node.parent;
+            }
+
+            // We should never have cycles in the DB.
+            // Hacked? Bug?
+            assert((!address || std::find(path.begin(), path.end(), *address) == path.end()) &&
+                    "Referral DB cycle detected");
+
+            size_t depth = address ? nodes[*address].depth + 1 : 0;
+            for (auto a = path.rbegin(); a != path.rend(); a++) {
+                nodes[*a].depth = depth++;
+            }
+
+            nodes[start_address].change += AnvRat{int128_t{change}};
+        }
+
+        std::vector<std::pair<size_t, Address>> order;
+        order.reserve(nodes.size());
+        for (const auto& n : nodes) {
+            order.emplace_back(n.second.depth, n.first);
+        }
+
+        std::sort(order.begin(), order.end(),
+                [](const std::pair<size_t, Address>& a, const std::pair<size_t, Address>& b) {
+                    return a.first > b.first;
+                });
+
+        CDBBatch batch(m_anv_db);
+        for (const auto& o : order) {
+            const auto& address = o.second;
+            const auto& node = nodes[address];
 
-        //MAX_LEVELS guards against cycles in DB
-        while (address && change != 0 && level < MAX_LEVELS) {
             //it's possible address didn't exist yet so an ANV of 0 is assumed.
             ANVTuple anv;
-            if (!m_db.Read(std::make_pair(DB_ANV, *address), anv)) {
-                LogPrint(BCLog::BEACONS, "\tFailed to read ANV for %s\n", address->GetHex());
+            if (!m_anv_db.Read(std::make_pair(DB_ANV, address), anv)) {
+                LogPrint(BCLog::BEACONS, "\tFailed to read ANV for %s\n", address.GetHex());
                 return false;
             }
 
             assert(std::get<0>(anv) != 0);
             assert(!std::get<1>(anv).IsNull());
 
-            LogPrint(BCLog::BEACONS, 
-                    "\t\t %d %s %d/%d + %d\n",
-                    level,
-                    CMeritAddress(std::get<0>(anv), std::get<1>(anv)).ToString(),
-                    std::get<0>((std::get<2>(anv))),
-                    std::get<1>((std::get<2>(anv))),
-                    change);
+            if (node.parent) {
+                const auto parent = nodes.find(*node.parent);
+                assert(parent != nodes.end());
+                parent->second.change += node.change / 2;
+            }
+
+            if (node.change == 0) {
+                continue;
+            }
 
             auto& anv_in = std::get<2>(anv);
 
+            LogPrint(BCLog::BEACONS,
+                    "\t\t %d %s %d/%d + %d/%d\n",
+                    o.first,
+                    CMeritAddress(std::get<0>(anv), std::get<1>(anv)).ToString(),
+                    anv_in.first,
+                    anv_in.second,
+                    node.change.numerator(),
+                    node.change.denominator());
+
             AnvRat anv_rat{anv_in.first, anv_in.second};
 
-            anv_rat += change_rat;
+            anv_rat += node.change;
 
             //boost rational stores the values in normalized form and these sould not overflow
             anv_in.first = anv_rat.numerator();
@@ -353,28 +1013,10 @@ namespace referral
             assert(anv_in.first >= 0);
             assert(anv_in.second > 0);
 
-            if (!m_db.Write(std::make_pair(DB_ANV, *address), anv)) {
-                //TODO: Do we rollback anv computation for already processed address?
-                // likely if we can't write then rollback will fail too.
-                // figure out how to mark database as corrupt.
-                return false;
-            }
-
-            const auto parent = GetParentAddress(*address);
-            if (parent) {
-                address_type = parent->first;
-                address = parent->second;
-            } else {
-                address.reset();
-            }
-            level++;
-            change_rat /= 2;
+            batch.Write(std::make_pair(DB_ANV, address), anv);
         }
 
-        // We should never have cycles in the DB.
-        // Hacked? Bug?
-        assert(level < MAX_LEVELS && "reached max levels. Referral DB cycle detected");
-        return true;
+        return m_anv_db.WriteBatch(batch);
     }
 
     CAmount AnvInToAnvPub(const AnvInternal& in)
@@ -386,7 +1028,7 @@ namespace referral
     MaybeAddressANV ReferralsViewDB::GetANV(const Address& address) const
     {
         ANVTuple anv;
-        if (!m_db.Read(std::make_pair(DB_ANV, address), anv)) {
+        if (!m_anv_db.Read(std::make_pair(DB_ANV, address), anv)) {
             return MaybeAddressANV{};
         }
 
@@ -400,7 +1042,7 @@ namespace referral
 
     AddressANVs ReferralsViewDB::GetAllANVs() const
     {
-        std::unique_ptr<CDBIterator> iter{m_db.NewIterator()};
+        std::unique_ptr<CDBIterator> iter{m_anv_db.NewIterator()};
         iter->SeekToFirst();
 
         AddressANVs anvs;
@@ -438,13 +1080,15 @@ namespace referral
             int height,
             referral::AddressANVs& entrants) const
     {
+        LOCK(m_cs_lottery);
+        if (!LoadLottery()) {
+            return;
+        }
+
         const auto heap_size = GetLotteryHeapSize();
         bool found_genesis = false;
         for (uint64_t i = 0; i < heap_size; i++) {
-            LotteryEntrant v;
-            if (!m_db.Read(std::make_pair(DB_LOT_VAL, i), v)) {
-                break;
-            }
+            const auto& v = m_lottery.heap[i];
 
             auto maybe_anv = GetANV(std::get<2>(v));
             if (!maybe_anv) {
@@ -468,24 +1112,138 @@ namespace referral
         }
     }
 
-    bool ReferralsViewDB::FindLotteryPos(const Address& address, uint64_t& pos) const
+    bool ReferralsViewDB::LoadLottery() const
     {
-        if (m_db.Read(std::make_pair(DB_LOT_INV, address), pos)) {
+        AssertLockHeld(m_cs_lottery);
+        if (m_lottery.loaded) {
             return true;
         }
 
-        const auto heap_size = GetLotteryHeapSize();
-        for (uint64_t i = 0; i < heap_size; i++) {
+        LotteryReservoir lottery;
+        m_lottery_db.Read(DB_LOT_SIZE, lottery.size);
+
+        //Rows past the end of the heap are left behind when it shrinks and
+        //can still be read through stale positions, so load those too.
+        lottery.heap.reserve(lottery.size);
+        for (uint64_t i = 0; ; i++) {
             LotteryEntrant v;
-            if (!m_db.Read(std::make_pair(DB_LOT_VAL, i), v)) {
+            if (!m_lottery_db.Read(std::make_pair(DB_LOT_VAL, i), v)) {
+                if (i < lottery.size) {
+                    LogPrintf("%s: Failed to read lottery reservoir position %d\n", __func__, i);
+                    return false;
+                }
+                break;
+            }
+            lottery.heap.push_back(v);
+        }
+
+        std::unique_ptr<CDBIterator> iter{m_lottery_db.NewIterator()};
+        auto key = std::make_pair(DB_LOT_INV, Address{});
+        iter->Seek(key);
+        while (iter->Valid() && iter->GetKey(key) && key.first == DB_LOT_INV) {
+            uint64_t pos;
+            if (!iter->GetValue(pos)) {
+                LogPrintf("%s: Failed to read lottery reservoir position of %s\n",
+                        __func__, key.second.GetHex());
                 return false;
             }
 
-            if (std::get<2>(v) == address) {
+            lottery.positions[key.second] = pos;
+            iter->Next();
+        }
+
+        LogPrint(BCLog::BEACONS, "%s: Loaded lottery reservoir of %d with %d positions\n",
+                __func__, lottery.size, lottery.positions.size());
+
+        lottery.loaded = true;
+        m_lottery = std::move(lottery);
+        return true;
+    }
+
+    bool ReferralsViewDB::FlushLottery()
+    {
+        LOCK(m_cs_lottery);
+        if (!m_lottery.loaded) {
+            return true;
+        }
+
+        CDBBatch batch(m_lottery_db);
+        for (const auto pos : m_lottery.dirty_slots) {
+            batch.Write(std::make_pair(DB_LOT_VAL, pos), m_lottery.heap[pos]);
+        }
+
+        for (const auto& address : m_lottery.dirty_positions) {
+            const auto p = m_lottery.positions.find(address);
+            if (p != m_lottery.positions.end()) {
+                batch.Write(std::make_pair(DB_LOT_INV, address), p->second);
+            } else {
+                batch.Erase(std::make_pair(DB_LOT_INV, address));
+            }
+        }
+
+        if (m_lottery.size_dirty) {
+            batch.Write(DB_LOT_SIZE, m_lottery.size);
+        }
+
+        if (!m_lottery_db.WriteBatch(batch)) {
+            return false;
+        }
+
+        m_lottery.dirty_slots.clear();
+        m_lottery.dirty_positions.clear();
+        m_lottery.size_dirty = false;
+        return true;
+    }
+
+    void ReferralsViewDB::SetLotterySlot(uint64_t pos, const LotteryEntrant& v)
+    {
+        AssertLockHeld(m_cs_lottery);
+        assert(pos <= m_lottery.heap.size());
+
+        if (pos == m_lottery.heap.size()) {
+            m_lottery.heap.push_back(v);
+        } else {
+            m_lottery.heap[pos] = v;
+        }
+        m_lottery.dirty_slots.insert(pos);
+    }
+
+    void ReferralsViewDB::SetLotteryPos(const Address& address, uint64_t pos) const
+    {
+        AssertLockHeld(m_cs_lottery);
+        m_lottery.positions[address] = pos;
+        m_lottery.dirty_positions.insert(address);
+    }
+
+    void ReferralsViewDB::EraseLotteryPos(const Address& address)
+    {
+        AssertLockHeld(m_cs_lottery);
+        m_lottery.positions.erase(address);
+        m_lottery.dirty_positions.insert(address);
+    }
+
+    void ReferralsViewDB::SetLotteryHeapSize(uint64_t size)
+    {
+        AssertLockHeld(m_cs_lottery);
+        m_lottery.size = size;
+        m_lottery.size_dirty = true;
+    }
+
+    bool ReferralsViewDB::FindLotteryPos(const Address& address, uint64_t& pos) const
+    {
+        AssertLockHeld(m_cs_lottery);
+
+        const auto p = m_lottery.positions.find(address);
+        if (p != m_lottery.positions.end()) {
+            pos = p->second;
+            return true;
+        }
+
+        const auto heap_size = GetLotteryHeapSize();
+        for (uint64_t i = 0; i < heap_size; i++) {
+            if (std::get<2>(m_lottery.heap[i]) == address) {
                 pos = i;
-                if (!m_db.Write(std::make_tuple(DB_LOT_INV, address), pos)) {
-                    return false;
-                }
+                SetLotteryPos(address, pos);
                 return true;
             }
         }
@@ -517,6 +1275,9 @@ namespace referral
             const uint64_t max_reservoir_size,
             LotteryUndos& undos)
     {
+        LOCK(m_cs_lottery);
+        if (!LoadLottery()) return false;
+
         auto maybe_anv = GetANV(*address);
         if (!maybe_anv) return false;
 
@@ -631,7 +1392,11 @@ namespace referral
                 }
             }
 
-            const auto parent = GetParentAddress(*address);
+            MaybeAddressPair parent;
+            if (!GetParentAddress(*address, parent)) {
+                return false;
+            }
+
             if (parent) {
                 address_type = parent->first;
                 address = parent->second;
@@ -648,6 +1413,9 @@ namespace referral
             const LotteryUndo& undo,
             const uint64_t max_reservoir_size)
     {
+        LOCK(m_cs_lottery);
+        if (!LoadLottery()) return false;
+
         if (!RemoveFromLottery(undo.replaced_with)) {
             return false;
         }
@@ -671,19 +1439,16 @@ namespace referral
 
     uint64_t ReferralsViewDB::GetLotteryHeapSize() const
     {
-        uint64_t size = 0;
-        m_db.Read(DB_LOT_SIZE, size);
-        return size;
+        AssertLockHeld(m_cs_lottery);
+        return m_lottery.size;
     }
 
     MaybeLotteryEntrant ReferralsViewDB::GetMinLotteryEntrant() const
     {
-        LotteryEntrant v;
-
-        const uint64_t first = 0;
-        return m_db.Read(std::make_pair(DB_LOT_VAL, first), v) ?
-            MaybeLotteryEntrant{v} :
-            MaybeLotteryEntrant{};
+        AssertLockHeld(m_cs_lottery);
+        return m_lottery.heap.empty() ?
+            MaybeLotteryEntrant{} :
+            MaybeLotteryEntrant{m_lottery.heap.front()};
     }
 
     /**
@@ -699,6 +1464,8 @@ namespace referral
             const Address& address,
             const uint64_t max_reservoir_size)
     {
+        AssertLockHeld(m_cs_lottery);
+
         auto heap_size = GetLotteryHeapSize();
         assert(heap_size < max_reservoir_size);
 
@@ -708,10 +1475,7 @@ namespace referral
         while (pos != 0) {
             const auto parent_pos = (pos - 1) / 2;
 
-            LotteryEntrant parent_value;
-            if (!m_db.Read(std::make_pair(DB_LOT_VAL, parent_pos), parent_value)) {
-                return false;
-            }
+            const LotteryEntrant parent_value = m_lottery.heap[parent_pos];
 
             //We found our spot
             if (comp(parent_value, new_entry)) {
@@ -719,30 +1483,19 @@ namespace referral
             }
 
             //Push our parent down since we are moving up.
-            if (!m_db.Write(std::make_tuple(DB_LOT_VAL, pos), parent_value)) {
-                return false;
-            }
-
-            if (!m_db.Write(std::make_tuple(DB_LOT_INV, std::get<2>(parent_value)), pos)) {
-                return false;
-            }
+            SetLotterySlot(pos, parent_value);
+            SetLotteryPos(std::get<2>(parent_value), pos);
 
             pos = parent_pos;
         }
 
         //write final value
         LogPrint(BCLog::BEACONS, "\tAdding to Reservoir %s at pos %d\n", CMeritAddress(address_type, address).ToString(), pos);
-        if (!m_db.Write(std::make_pair(DB_LOT_VAL, pos), new_entry)) {
-            return false;
-        }
-
-        if (!m_db.Write(std::make_tuple(DB_LOT_INV, address), pos)) {
-            return false;
-        }
+        SetLotterySlot(pos, new_entry);
+        SetLotteryPos(address, pos);
 
         uint64_t new_size = heap_size + 1;
-        if (!m_db.Write(DB_LOT_SIZE, new_size))
-            return false;
+        SetLotteryHeapSize(new_size);
 
         assert(new_size <= max_reservoir_size);
         return true;
@@ -764,23 +1517,21 @@ namespace referral
 
     bool ReferralsViewDB::RemoveFromLottery(uint64_t current)
     {
+        AssertLockHeld(m_cs_lottery);
+
         LogPrint(BCLog::BEACONS, "\tPopping from lottery reservoir position %d\n", current);
         auto heap_size = GetLotteryHeapSize();
         if (heap_size == 0) return false;
 
-        LotteryEntrant last;
-        if (!m_db.Read(std::make_pair(DB_LOT_VAL, heap_size - 1), last)) {
+        //Positions may be stale, like the rows they mirror.
+        if (current >= m_lottery.heap.size()) {
             return false;
         }
 
-        LotteryEntrant current_val;
-        if (!m_db.Read(std::make_pair(DB_LOT_VAL, current), current_val)) {
-            return false;
-        }
+        const LotteryEntrant last = m_lottery.heap[heap_size - 1];
+        const LotteryEntrant& current_val = m_lottery.heap[current];
 
-        if (!m_db.Erase(std::make_tuple(DB_LOT_INV, std::get<2>(current_val)))) {
-            return false;
-        }
+        EraseLotteryPos(std::get<2>(current_val));
 
         LotteryEntrant smallest_val = last;
 
@@ -791,11 +1542,7 @@ namespace referral
             uint64_t right = 2 * current + 2;
 
             if (left < heap_size) {
-                LotteryEntrant left_val;
-                if (!m_db.Read(std::make_pair(DB_LOT_VAL, left), left_val)) {
-                    return false;
-                }
-
+                const auto& left_val = m_lottery.heap[left];
                 if (comp(left_val, smallest_val)) {
                     smallest = left;
                     smallest_val = left_val;
@@ -803,11 +1550,7 @@ namespace referral
             }
 
             if (right < heap_size) {
-                LotteryEntrant right_val;
-                if (!m_db.Read(std::make_pair(DB_LOT_VAL, right), right_val)) {
-                    return false;
-                }
-
+                const auto& right_val = m_lottery.heap[right];
                 if (comp(right_val, smallest_val)) {
                     smallest = right;
                     smallest_val = right_val;
@@ -816,13 +1559,8 @@ namespace referral
 
             if (smallest != current) {
                 //write the current element with the smallest
-                if (!m_db.Write(std::make_pair(DB_LOT_VAL, current), smallest_val)) {
-                    return false;
-                }
-
-                if (!m_db.Write(std::make_tuple(DB_LOT_INV, std::get<2>(smallest_val)), current)) {
-                        return false;
-                }
+                SetLotterySlot(current, smallest_val);
+                SetLotteryPos(std::get<2>(smallest_val), current);
 
                 //now go down the smallest path
                 current = smallest;
@@ -833,18 +1571,11 @@ namespace referral
 
         //finally write the value in the correct spot and reduce the heap
         //size by 1
-        if (!m_db.Write(std::make_pair(DB_LOT_VAL, current), last)) {
-            return false;
-        }
-
-        if (!m_db.Write(std::make_tuple(DB_LOT_INV, std::get<2>(last)), current)) {
-            return false;
-        }
+        SetLotterySlot(current, last);
+        SetLotteryPos(std::get<2>(last), current);
 
         uint64_t new_size = heap_size - 1;
-        if (!m_db.Write(DB_LOT_SIZE, new_size)) {
-            return false;
-        }
+        SetLotteryHeapSize(new_size);
 
         LogPrint(BCLog::BEACONS, "\tPopped from lottery reservoir, last ended up at %d\n", current);
         return true;
@@ -911,8 +1642,56 @@ namespace referral
         return true;
     }
 
-    //Confirmation pair is an index plus count
-    using ConfirmationPair = std::pair<uint64_t, int>;
+    bool ReferralsViewDB::LoadConfirmations() const
+    {
+        AssertLockHeld(m_cs_confirmations);
+        if (m_confirmations.loaded) {
+            return true;
+        }
+
+        ConfirmationIndex index;
+        m_lottery_db.Read(DB_CONFIRMATION_TOTAL, index.total);
+
+        std::unique_ptr<CDBIterator> iter{m_lottery_db.NewIterator()};
+        auto key = std::make_pair(DB_CONFIRMATION, Address{});
+        iter->Seek(key);
+        while (iter->Valid() && iter->GetKey(key) && key.first == DB_CONFIRMATION) {
+            ConfirmationPair confirmation;
+            if (!iter->GetValue(confirmation)) {
+                LogPrintf("%s: Failed to read confirmation of %s\n", __func__, key.second.GetHex());
+                return false;
+            }
+
+            index.by_address[key.second] = confirmation;
+            iter->Next();
+        }
+
+        index.by_index.resize(index.total);
+
+        auto idx_key = std::make_pair(DB_CONFIRMATION_IDX, uint64_t{0});
+        iter->Seek(idx_key);
+        while (iter->Valid() && iter->GetKey(idx_key) && idx_key.first == DB_CONFIRMATION_IDX) {
+            ConfirmationVal val;
+            if (!iter->GetValue(val)) {
+                LogPrintf("%s: Failed to read confirmation index %d\n", __func__, idx_key.second);
+                return false;
+            }
+
+            const auto confirmation = index.by_address.find(val.second);
+            if (idx_key.second < index.total && confirmation != index.by_address.end()) {
+                index.by_index[idx_key.second] =
+                    ConfirmedAddress{val.first, val.second, confirmation->second.second};
+            }
+
+            iter->Next();
+        }
+
+        LogPrint(BCLog::BEACONS, "%s: Loaded %d confirmations\n", __func__, index.total);
+
+        index.loaded = true;
+        m_confirmations = std::move(index);
+        return true;
+    }
 
     bool ReferralsViewDB::UpdateConfirmation(
             char address_type,
@@ -920,20 +1699,25 @@ namespace referral
             CAmount amount,
             CAmount &updated_amount)
     {
-        uint64_t total_confirmations = 0;
-        m_db.Read(DB_CONFIRMATION_TOTAL, total_confirmations);
+        LOCK(m_cs_confirmations);
+        if (!LoadConfirmations()) {
+            return false;
+        }
+
+        auto& index = m_confirmations;
+        const uint64_t total_confirmations = index.total;
 
         ConfirmationPair confirmation;
-        if (!m_db.Read(
-                    std::make_pair(DB_CONFIRMATION, address),
-                    confirmation)) {
+        const auto existing = index.by_address.find(address);
+        const bool is_new = existing == index.by_address.end();
+        if (is_new) {
             confirmation.first = total_confirmations;
             confirmation.second = amount;
             updated_amount = confirmation.second;
 
             //We have a new confirmed address so add it to the end of the invite lottery
             //and index it.
-            if (!m_db.Write(
+            if (!m_lottery_db.Write(
                         std::make_pair(DB_CONFIRMATION_IDX, total_confirmations),
                         std::make_pair(
                             address_type,
@@ -941,10 +1725,11 @@ namespace referral
                 return false;
             }
 
-            if (!m_db.Write(DB_CONFIRMATION_TOTAL, total_confirmations + 1)) {
+            if (!m_lottery_db.Write(DB_CONFIRMATION_TOTAL, total_confirmations + 1)) {
                 return false;
             }
         } else {
+            confirmation = existing->second;
             confirmation.second += amount;
             updated_amount = confirmation.second;
 
@@ -953,15 +1738,19 @@ namespace referral
             //DisconnectBlock correctly.
             assert(total_confirmations > 0);
             if (confirmation.second == 0 && confirmation.first == total_confirmations - 1) {
-                if (!m_db.Write(DB_CONFIRMATION_TOTAL, total_confirmations - 1)) {
+                if (!m_lottery_db.Write(DB_CONFIRMATION_TOTAL, total_confirmations - 1)) {
                     return false;
                 }
-                if (!m_db.Erase(std::make_pair(DB_CONFIRMATION, address))) {
+                if (!m_lottery_db.Erase(std::make_pair(DB_CONFIRMATION, address))) {
                     return false;
                 }
-                if (!m_db.Erase(std::make_pair(DB_CONFIRMATION_IDX, confirmation.first))) {
+                if (!m_lottery_db.Erase(std::make_pair(DB_CONFIRMATION_IDX, confirmation.first))) {
                     return false;
                 }
+
+                index.total = total_confirmations - 1;
+                index.by_index.resize(index.total);
+                index.by_address.erase(existing);
                 return true;
             }
 
@@ -970,12 +1759,23 @@ namespace referral
             }
         }
 
-        if (!m_db.Write(
+        if (!m_lottery_db.Write(
                     std::make_pair(DB_CONFIRMATION, address),
                     confirmation)) {
             return false;
         }
 
+        index.by_address[address] = confirmation;
+
+        if (is_new) {
+            index.total = total_confirmations + 1;
+            index.by_index.resize(index.total);
+            index.by_index[confirmation.first] =
+                ConfirmedAddress{address_type, address, confirmation.second};
+        } else if (auto& slot = index.by_index[confirmation.first]) {
+            slot->invites = confirmation.second;
+        }
+
         return true;
     }
 
@@ -994,18 +1794,48 @@ namespace referral
         }
 
         return maybe_normalized.size() > 0 &&
+            HasAlias(maybe_normalized) &&
             m_db.Exists(std::make_pair(DB_ALIAS, maybe_normalized));
     }
 
+    bool ReferralsViewDB::HasAlias(const std::string& key) const
+    {
+        LOCK(m_cs_aliases);
+        if (!m_aliases_loaded) {
+            std::unique_ptr<CDBIterator> iter{m_db.NewIterator()};
+            auto alias_key = std::make_pair(DB_ALIAS, std::string{});
+            iter->Seek(alias_key);
+            while (iter->Valid() && iter->GetKey(alias_key) && alias_key.first == DB_ALIAS) {
+                m_aliases.insert(alias_key.second);
+                iter->Next();
+            }
+
+            LogPrint(BCLog::BEACONS, "%s: Loaded %d aliases\n", __func__, m_aliases.size());
+            m_aliases_loaded = true;
+        }
+
+        return m_aliases.count(key) > 0;
+    }
+
+    void ReferralsViewDB::AddAlias(const std::string& key)
+    {
+        //Aliases written before the index is loaded are picked up by the load.
+        LOCK(m_cs_aliases);
+        if (m_aliases_loaded) {
+            m_aliases.insert(key);
+        }
+    }
+
     bool ReferralsViewDB::IsConfirmed(const referral::Address& address) const
     {
-        ConfirmationPair confirmation;
-        if (!m_db.Read(
-                    std::make_pair(DB_CONFIRMATION, address),
-                    confirmation)) {
+        LOCK(m_cs_confirmations);
+        if (!LoadConfirmations()) {
             return false;
         }
-        return confirmation.second > 0;
+
+        const auto confirmation = m_confirmations.by_address.find(address);
+        return confirmation != m_confirmations.by_address.end() &&
+            confirmation->second.second > 0;
     }
 
     bool ReferralsViewDB::IsConfirmed(const std::string& alias, bool normalize_alias) const
@@ -1080,40 +1910,37 @@ namespace referral
 
     uint64_t ReferralsViewDB::GetTotalConfirmations() const
     {
-        uint64_t total = 0;
-        m_db.Read(DB_CONFIRMATION_TOTAL, total);
-        return total;
+        LOCK(m_cs_confirmations);
+        if (!LoadConfirmations()) {
+            return 0;
+        }
+
+        return m_confirmations.total;
     }
 
     MaybeConfirmedAddress ReferralsViewDB::GetConfirmation(uint64_t idx) const
     {
-        ConfirmationVal val;
-        if (!m_db.Read(std::make_pair(DB_CONFIRMATION_IDX, idx), val)) {
+        LOCK(m_cs_confirmations);
+        if (!LoadConfirmations() || idx >= m_confirmations.by_index.size()) {
             return MaybeConfirmedAddress{};
         }
 
-        ConfirmationPair pair{0,0};
-
-        if (!m_db.Read(
-                    std::make_pair(DB_CONFIRMATION, val.second),
-                    pair)) {
-            return MaybeConfirmedAddress{};
-        }
-
-        return MaybeConfirmedAddress{{val.first, val.second, pair.second}};
+        return m_confirmations.by_index[idx];
     }
 
     MaybeConfirmedAddress ReferralsViewDB::GetConfirmation(char address_type, const Address& address) const
     {
-        ConfirmationPair pair{0,0};
+        LOCK(m_cs_confirmations);
+        if (!LoadConfirmations()) {
+            return MaybeConfirmedAddress{};
+        }
 
-        if (!m_db.Read(
-                    std::make_pair(DB_CONFIRMATION, address),
-                    pair)) {
+        const auto confirmation = m_confirmations.by_address.find(address);
+        if (confirmation == m_confirmations.by_address.end()) {
             return MaybeConfirmedAddress{};
         }
 
-        return MaybeConfirmedAddress{{address_type, address, pair.second}};
+        return MaybeConfirmedAddress{{address_type, address, confirmation->second.second}};
     }
 
     bool ReferralsViewDB::SetNewInviteRewardedHeight(const Address& a, int height)
@@ -7,17 +7,42 @@
 
 #include "dbwrapper.h"
 #include "amount.h"
+#include "fs.h"
+#include "hash.h"
+#include "random.h"
 #include "serialize.h"
 #include "primitives/referral.h"
 #include "primitives/transaction.h"
 #include "consensus/params.h"
 #include "pog/wrs.h"
+#include "sync.h"
 
 #include <boost/optional.hpp>
+#include <array>
+#include <limits>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace referral
 {
+template <unsigned int BITS>
+class SaltedHasher
+{
+private:
+    /** Salt, not const so tables using it can be moved into place. */
+    uint64_t k0, k1;
+
+public:
+    SaltedHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+    size_t operator()(const base_blob<BITS>& data) const
+    {
+        return CSipHasher(k0, k1).Write(data.begin(), data.size()).Finalize();
+    }
+};
+
 using Address = uint160;
 using MaybeReferral = boost::optional<Referral>;
 using MaybeAddress = boost::optional<Address>;
@@ -30,6 +55,8 @@ using MaybeLotteryEntrant = boost::optional<LotteryEntrant>;
 using AddressPair = std::pair<char, Address>;
 using MaybeAddressPair = boost::optional<AddressPair>;
 using TransactionHash = uint256;
+using ANVChange = std::tuple<char, Address, CAmount>;
+using ANVChanges = std::vector<ANVChange>;
 
 struct AddressANV
 {
@@ -74,10 +101,28 @@ struct LotteryUndo
 
 using LotteryUndos = std::vector<LotteryUndo>;
 
+/**
+ * A snapshot of every row of the referral databases at a block. It is
+ * committed to by the hash of the block, the height and all the rows.
+ */
+struct ReferralSnapshot
+{
+    uint256 block_hash;
+    int height = 0;
+    uint64_t rows = 0;
+    uint256 hash;
+};
+
 class ReferralsViewDB
 {
 protected:
+    //The referrals and their indices. These are written once and read by key.
     mutable CDBWrapper m_db;
+    //The ANVs, rewritten for every ancestor of an address whose balance changes.
+    mutable CDBWrapper m_anv_db;
+    //The pog1 lottery reservoir and the invite lottery confirmations. These
+    //are rewritten often and only read as a whole when loaded.
+    mutable CDBWrapper m_lottery_db;
 public:
     explicit ReferralsViewDB(
             size_t cache_size,
@@ -96,11 +141,19 @@ public:
             const ReferralId&,
             bool normalize_alias) const;
 
-    MaybeAddressPair GetParentAddress(const Address&) const;
+    /** Upgrades the DB from older formats, a no-op if already upgraded. */
+    bool Upgrade();
+
+    /**
+     * Sets parent to the parent of the address, or to none for a root.
+     * Returns false if the parents could not be read.
+     */
+    bool GetParentAddress(const Address&, MaybeAddressPair& parent) const;
     MaybeAddress GetAddressByPubKey(const CPubKey&) const;
     ChildAddresses GetChildren(const Address&) const;
 
     bool UpdateANV(char address_type, const Address&, CAmount);
+    bool UpdateANVs(const ANVChanges&);
     MaybeAddressANV GetANV(const Address&) const;
     AddressANVs GetAllANVs() const;
     bool OrderReferrals(referral::ReferralRefs& refs);
@@ -133,6 +186,32 @@ public:
             const LotteryUndo&,
             const uint64_t max_reservoir_size);
 
+    /** Writes the lottery reservoir changes made since the last flush. */
+    bool FlushLottery();
+
+    /**
+     * Writes every row to a snapshot file for the block and height in
+     * snapshot and sets the number of rows and the hash committing to them.
+     */
+    bool DumpSnapshot(const fs::path& path, ReferralSnapshot& snapshot) const;
+
+    /**
+     * Replaces every row with the rows of a snapshot file of the block
+     * given. The whole file is checked against the hash it ends with, and
+     * against hash unless it is null, before anything is replaced.
+     */
+    bool LoadSnapshot(
+            const fs::path& path,
+            const uint256& block_hash,
+            const uint256& hash,
+            ReferralSnapshot& snapshot);
+
+    /**
+     * True if loading a snapshot started but did not finish, in which case
+     * the rows are incomplete and the DB must be rebuilt.
+     */
+    bool IsLoadingSnapshot() const;
+
     //Daedalus code.
     bool Exists(const Address&) const;
 
@@ -155,6 +234,102 @@ public:
     int GetNewInviteRewardedHeight(const Address&) const;
 
 private:
+    std::array<CDBWrapper*, 3> Keyspaces() const;
+    bool ReadSnapshot(const fs::path& path, bool write, ReferralSnapshot& snapshot);
+
+    bool UpgradeChildren();
+    bool SplitKeyspaces();
+
+    bool AddChild(const Address& parent, const Address& child);
+    bool RemoveChild(const Address& parent, const Address& child);
+
+    /**
+     * The pog1 lottery reservoir as loaded from its DB_LOT_* rows. It is
+     * changed in memory and written back by FlushLottery. The positions
+     * mirror the DB_LOT_INV rows exactly, stale ones included, because they
+     * decide whether an address is already in the lottery.
+     */
+    struct LotteryReservoir
+    {
+        bool loaded = false;
+        uint64_t size = 0;
+        LotteryEntrants heap;
+        std::unordered_map<Address, uint64_t, SaltedHasher<160>> positions;
+
+        bool size_dirty = false;
+        std::set<uint64_t> dirty_slots;
+        std::set<Address> dirty_positions;
+    };
+
+    mutable CCriticalSection m_cs_lottery;
+    mutable LotteryReservoir m_lottery;
+
+    /**
+     * The keys of all DB_ALIAS rows, loaded on first use, so looking up an
+     * alias nobody has taken never reads the DB.
+     */
+    mutable CCriticalSection m_cs_aliases;
+    mutable bool m_aliases_loaded = false;
+    mutable std::unordered_set<std::string> m_aliases;
+
+    bool HasAlias(const std::string& key) const;
+    void AddAlias(const std::string& key);
+
+    /**
+     * The invite lottery confirmations as loaded from the DB_CONFIRMATION*
+     * rows. They are kept up to date by UpdateConfirmation so drawing a
+     * confirmed address by index doesn't read the DB. by_index holds total
+     * entries and by_address maps an address to its index and invites.
+     */
+    struct ConfirmationIndex
+    {
+        bool loaded = false;
+        uint64_t total = 0;
+        std::vector<MaybeConfirmedAddress> by_index;
+        std::unordered_map<Address, std::pair<uint64_t, int>, SaltedHasher<160>> by_address;
+    };
+
+    mutable CCriticalSection m_cs_confirmations;
+    mutable ConfirmationIndex m_confirmations;
+
+    bool LoadConfirmations() const;
+
+protected:
+    /**
+     * The DB_PARENT_ADDRESS rows in memory so walks to the root don't read
+     * the DB once per level. An address has a node while it has a parent or
+     * children, and a node points at the key of its parent's node, which
+     * doesn't move when the map grows. That is one hash map node of about
+     * 70 bytes per beacon, with the bucket and allocator overhead.
+     */
+    struct ParentTable
+    {
+        struct Node
+        {
+            const Address* parent = nullptr;
+            uint32_t children = 0;
+            char address_type = 0;
+        };
+
+        bool loaded = false;
+        std::unordered_map<Address, Node, SaltedHasher<160>> nodes;
+
+        void SetParent(const Address&, const AddressPair& parent);
+        void RemoveParent(const Address&);
+    };
+
+    mutable CCriticalSection m_cs_parents;
+    mutable ParentTable m_parents;
+
+    bool LoadParents() const;
+
+private:
+    bool LoadLottery() const;
+    void SetLotterySlot(uint64_t pos, const LotteryEntrant&);
+    void SetLotteryPos(const Address&, uint64_t pos) const;
+    void EraseLotteryPos(const Address&);
+    void SetLotteryHeapSize(uint64_t size);
+
     uint64_t GetLotteryHeapSize() const;
     MaybeLotteryEntrant GetMinLotteryEntrant() const;
     bool FindLotteryPos(const Address& address, uint64_t& pos) const;
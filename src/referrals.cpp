@@ -8,11 +8,51 @@
 
 namespace referral
 {
-    ReferralsViewCache::ReferralsViewCache(ReferralsViewDB* db) : m_db{db}
+    namespace
+    {
+        //The signature and alias of a referral are allocated separately.
+        const size_t REFERRAL_EXTRA_BYTES = 96;
+    }
+
+    //Most of the memory goes to the referrals, the rest is split evenly.
+    ReferralsViewCache::ReferralsViewCache(ReferralsViewDB* db, size_t cache_size) :
+        m_db{db},
+        m_referrals{cache_size / 2, REFERRAL_EXTRA_BYTES},
+        m_hashes{cache_size / 8},
+        m_aliases{cache_size / 8},
+        m_confirmations{cache_size / 8},
+        m_heights{cache_size / 8}
     {
         assert(db);
     };
 
+    namespace
+    {
+        template <typename Cache>
+        ReferralsViewCache::CacheStats GetStats(const std::string& name, const Cache& cache)
+        {
+            return {
+                name,
+                cache.Size(),
+                cache.MaxSize(),
+                cache.Hits(),
+                cache.Misses(),
+                cache.Evictions()
+            };
+        }
+    }
+
+    ReferralsViewCache::CacheStatsList ReferralsViewCache::GetCacheStats() const
+    {
+        return {
+            GetStats("referrals", m_referrals),
+            GetStats("hashes", m_hashes),
+            GetStats("aliases", m_aliases),
+            GetStats("confirmations", m_confirmations),
+            GetStats("heights", m_heights)
+        };
+    }
+
     namespace {
         class ReferralIdVisitor : public boost::static_visitor<MaybeReferral>
         {
@@ -40,12 +80,8 @@ namespace referral
 
     MaybeReferral ReferralsViewCache::GetReferral(const Address& address) const
     {
-        {
-            LOCK(m_cs_cache);
-            auto it = referrals_index.find(address);
-            if (it != referrals_index.end()) {
-                return *it;
-            }
+        if (auto ref = m_referrals.Get(address)) {
+            return ref;
         }
 
         if (auto ref = m_db->GetReferral(address)) {
@@ -58,11 +94,9 @@ namespace referral
 
     MaybeReferral ReferralsViewCache::GetReferral(const uint256& hash) const
     {
-        {
-            LOCK(m_cs_cache);
-            auto it = referrals_index.get<by_hash>().find(hash);
-            if (it != referrals_index.get<by_hash>().end()) {
-                return *it;
+        if (const auto address = m_hashes.Get(hash)) {
+            if (auto ref = m_referrals.Get(*address)) {
+                return ref;
             }
         }
 
@@ -86,18 +120,12 @@ namespace referral
             return {};
         }
 
-        {
-            LOCK(m_cs_cache);
-            auto it = alias_index.find(maybe_normalized);
-
-            if (it != alias_index.end()) {
-                return GetReferral(it->second);
-            }
+        if (const auto address = m_aliases.Get(maybe_normalized)) {
+            return GetReferral(*address);
         }
 
         if (auto ref = m_db->GetReferral(maybe_normalized, false)) {
-            LOCK(m_cs_cache);
-            alias_index[maybe_normalized] = ref->GetAddress();
+            m_aliases.Put(maybe_normalized, ref->GetAddress());
             InsertReferralIntoCache(*ref);
             return ref;
         }
@@ -111,28 +139,26 @@ namespace referral
     }
 
     int ReferralsViewCache::GetReferralHeight(const Address& address) const {
-        const auto height_p = height_index.find(address);
-        if(height_p != height_index.end()) {
-            return height_p->second;
+        if (const auto height = m_heights.Get(address)) {
+            return *height;
         }
 
         const auto height = m_db->GetReferralHeight(address);
         if(height > 0) {
-            height_index[address] = height;
+            m_heights.Put(address, height);
         }
         return height;
     }
 
     bool ReferralsViewCache::SetReferralHeight(int height, const Address& address) {
-        height_index[address] = height;
+        m_heights.Put(address, height);
         return m_db->SetReferralHeight(height, address);
     }
 
     bool ReferralsViewCache::Exists(const uint256& hash) const
     {
-        {
-            LOCK(m_cs_cache);
-            if (referrals_index.get<by_hash>().count(hash) > 0) {
+        if (const auto address = m_hashes.Get(hash)) {
+            if (m_referrals.Contains(*address)) {
                 return true;
             }
         }
@@ -147,12 +173,10 @@ namespace referral
 
     bool ReferralsViewCache::Exists(const Address& address) const
     {
-        {
-            LOCK(m_cs_cache);
-            if (referrals_index.count(address) > 0) {
-                return true;
-            }
+        if (m_referrals.Contains(address)) {
+            return true;
         }
+
         if (auto ref = m_db->GetReferral(address)) {
             InsertReferralIntoCache(*ref);
             return true;
@@ -172,16 +196,12 @@ namespace referral
             return false;
         }
 
-        {
-            LOCK(m_cs_cache);
-            if (alias_index.count(maybe_normalized) > 0) {
-                return true;
-            }
+        if (m_aliases.Contains(maybe_normalized)) {
+            return true;
         }
 
         if (auto ref = m_db->GetReferral(maybe_normalized, false)) {
-            LOCK(m_cs_cache);
-            alias_index[maybe_normalized] = ref->GetAddress();
+            m_aliases.Put(maybe_normalized, ref->GetAddress());
             InsertReferralIntoCache(*ref);
 
             return true;
@@ -192,11 +212,11 @@ namespace referral
 
     void ReferralsViewCache::InsertReferralIntoCache(const Referral& ref) const
     {
-        LOCK(m_cs_cache);
         const auto height = m_db->GetReferralHeight(ref.GetAddress());
-        referrals_index.insert(ref);
+        m_referrals.Put(ref.GetAddress(), ref);
+        m_hashes.Put(ref.GetHash(), ref.GetAddress());
         if(height > 0) {
-            height_index[ref.GetAddress()] = height;
+            m_heights.Put(ref.GetAddress(), height);
         }
     }
 
@@ -204,20 +224,29 @@ namespace referral
         auto normalized_alias = ref.alias;
         NormalizeAlias(normalized_alias);
 
-        if (alias_index.erase(normalized_alias) == 0) {
-            alias_index.erase(ref.alias);
-        }
+        m_aliases.Erase(normalized_alias);
+        m_aliases.Erase(ref.alias);
     }
 
     bool ReferralsViewCache::RemoveReferral(const Referral& ref) const
     {
-        referrals_index.erase(ref.GetAddress());
-        height_index.erase(ref.GetAddress());
+        m_referrals.Erase(ref.GetAddress());
+        m_hashes.Erase(ref.GetHash());
+        m_heights.Erase(ref.GetAddress());
         RemoveAliasFromCache(ref);
 
         return m_db->RemoveReferral(ref);
     }
 
+    void ReferralsViewCache::Flush()
+    {
+        m_referrals.Clear();
+        m_hashes.Clear();
+        m_aliases.Clear();
+        m_confirmations.Clear();
+        m_heights.Clear();
+    }
+
     bool ReferralsViewCache::UpdateConfirmation(char address_type, const Address& address, CAmount amount)
     {
         assert(m_db);
@@ -227,7 +256,7 @@ namespace referral
             return false;
         }
 
-        confirmations_index[address] = updated_amount;
+        m_confirmations.Put(address, updated_amount);
 
         auto ref = GetReferral(address);
 
@@ -247,10 +276,8 @@ namespace referral
     {
         assert(m_db);
 
-        auto it = confirmations_index.find(address);
-
-        if (it != confirmations_index.end()) {
-            return it->second > 0;
+        if (const auto confirmations = m_confirmations.Get(address)) {
+            return *confirmations > 0;
         }
 
         return m_db->IsConfirmed(address);
@@ -266,10 +293,8 @@ namespace referral
             NormalizeAlias(normalized_alias);
         }
 
-        auto it = alias_index.find(normalized_alias);
-
-        if (it != alias_index.end()) {
-            return IsConfirmed(it->second);
+        if (const auto address = m_aliases.Get(normalized_alias)) {
+            return IsConfirmed(*address);
         }
 
         return m_db->IsConfirmed(normalized_alias, false);
@@ -285,10 +310,8 @@ namespace referral
             return MaybeConfirmedAddress{};
         }
 
-        auto it = confirmations_index.find(address);
-
-        if (it != confirmations_index.end()) {
-            return MaybeConfirmedAddress{{ref->addressType, address, it->second}};
+        if (const auto confirmations = m_confirmations.Get(address)) {
+            return MaybeConfirmedAddress{{ref->addressType, address, *confirmations}};
         }
 
         return m_db->GetConfirmation(ref->addressType, address);
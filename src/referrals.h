@@ -6,6 +6,7 @@
 #define REFERRALS_H
 
 #include "hash.h"
+#include "lrucache.h"
 #include "primitives/referral.h"
 #include "random.h"
 #include "refdb.h"
@@ -27,52 +28,36 @@ using namespace boost::multi_index;
 
 namespace referral
 {
-template <unsigned int BITS>
-class SaltedHasher
+/** Default for -refcache, the memory of the referral cache in MiB. */
+static const int64_t DEFAULT_REFERRAL_CACHE = 64;
+
+/**
+ * Referral, alias, confirmation and height lookups of the referral DB kept in
+ * bounded, sharded LRU caches. Everything cached is also in the DB so entries
+ * can be evicted at any time.
+ */
+class ReferralsViewCache
 {
-private:
-    /** Salt */
-    const uint64_t k0, k1;
-
 public:
-    SaltedHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
-
-    size_t operator()(const base_blob<BITS>& data) const
+    struct CacheStats
     {
-        return CSipHasher(k0, k1).Write(data.begin(), data.size()).Finalize();
-    }
-};
+        std::string name;
+        size_t size;
+        size_t max_size;
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+    };
 
-// multi_index tags
-struct by_address {
-};
-struct by_hash {
-};
-
-using ReferralIndex = multi_index_container<
-    Referral,
-    indexed_by<
-        // stored by beaconed address
-        hashed_unique<tag<by_address>, const_mem_fun<Referral, const Address&, &Referral::GetAddress>, SaltedHasher<160>>,
-        // stored by hash
-        // use non-unique here to support empty tags.
-        // otherwise it won't add such referrals to index
-        // uniqueness is provided by validation
-        hashed_non_unique<tag<by_hash>, const_mem_fun<Referral, const uint256&, &Referral::GetHash>, SaltedHasher<256>>>>;
-
-using AliasIndex = std::unordered_map<std::string, Address>;
-using ConfirmationsIndex = std::unordered_map<Address, int>;
-using HeightIndex = std::unordered_map<Address, int>;
+    using CacheStatsList = std::vector<CacheStats>;
 
-class ReferralsViewCache
-{
 private:
-    mutable CCriticalSection m_cs_cache;
     ReferralsViewDB* m_db;
-    mutable ReferralIndex referrals_index;
-    mutable AliasIndex alias_index;
-    mutable ConfirmationsIndex confirmations_index;
-    mutable ConfirmationsIndex height_index;
+    ShardedLRUCache<Address, Referral, SaltedHasher<160>> m_referrals;
+    ShardedLRUCache<uint256, Address, SaltedHasher<256>> m_hashes;
+    ShardedLRUCache<std::string, Address> m_aliases;
+    ShardedLRUCache<Address, int, SaltedHasher<160>> m_confirmations;
+    ShardedLRUCache<Address, int, SaltedHasher<160>> m_heights;
     mutable AddressANVs all_rewardable_anvs;
     mutable std::mutex cache_mutex;
 
@@ -80,7 +65,9 @@ private:
     void RemoveAliasFromCache(const Referral&) const;
 
 public:
-    ReferralsViewCache(ReferralsViewDB*);
+    ReferralsViewCache(ReferralsViewDB*, size_t cache_size = DEFAULT_REFERRAL_CACHE << 20);
+
+    CacheStatsList GetCacheStats() const;
 
     /** Get referral by address */
     MaybeReferral GetReferral(const Address&) const;
@@ -112,7 +99,7 @@ public:
     /** Remove referral from cache */
     bool RemoveReferral(const Referral&) const;
 
-    /** Flush referrals to disk and clear cache */
+    /** Clear the cache. Referrals are always written through to disk. */
     void Flush();
 
     /** Update number of confirmations for referral */
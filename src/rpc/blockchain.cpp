@@ -17,6 +17,8 @@
 #include "core_io.h"
 #include "policy/feerate.h"
 #include "policy/policy.h"
+#include "pog3/cgsstate.h"
+#include "pog3/snapshot.h"
 #include "primitives/transaction.h"
 #include "rpc/server.h"
 #include "script/script.h"
@@ -32,6 +34,7 @@
 #include "net_processing.h"
 #include "netmessagemaker.h"
 #include "hash.h"
+#include "init.h"
 #include "base58.h"
 
 #include <stdint.h>
@@ -1823,6 +1826,110 @@ UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+UniValue dumpreferralsnapshot(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "dumpreferralsnapshot \"path\"\n"
+            "\nWrites the referral database at the active tip to a snapshot file.\n"
+            "The file must not exist yet. Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"      (string, required) The snapshot file, relative to the data directory if not absolute\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blockhash\": \"hex\",  (string) The block the snapshot is of\n"
+            "  \"height\": n,          (numeric) The height of the block\n"
+            "  \"rows\": n,            (numeric) The number of database rows in the snapshot\n"
+            "  \"hash\": \"hex\"        (string) The hash committing to the snapshot\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumpreferralsnapshot", "\"referrals.snapshot\"")
+            + HelpExampleRpc("dumpreferralsnapshot", "\"referrals.snapshot\"")
+        );
+    }
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+
+    // Don't overwrite a file that is there already, like dumpwallet.
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists. If you are sure this is what you want, move it out of the way first");
+    }
+
+    LOCK(cs_main);
+
+    referral::ReferralSnapshot snapshot;
+    snapshot.block_hash = chainActive.Tip()->GetBlockHash();
+    snapshot.height = chainActive.Height();
+
+    if (!prefviewdb->DumpSnapshot(path, snapshot)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to dump the referral snapshot");
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("blockhash", snapshot.block_hash.GetHex()));
+    ret.push_back(Pair("height", snapshot.height));
+    ret.push_back(Pair("rows", static_cast<int64_t>(snapshot.rows)));
+    ret.push_back(Pair("hash", snapshot.hash.GetHex()));
+    return ret;
+}
+
+UniValue loadreferralsnapshot(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2) {
+        throw std::runtime_error(
+            "loadreferralsnapshot \"path\" ( \"hash\" )\n"
+            "\nReplaces the referral database with a snapshot file of the active tip.\n"
+            "The snapshot is checked against the hash it was written with before anything\n"
+            "is replaced. If replacing fails part way the node shuts down and has to be\n"
+            "restarted with -reindex-chainstate. Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"      (string, required) The snapshot file, relative to the data directory if not absolute\n"
+            "2. \"hash\"      (string, optional) The hash the snapshot must have\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blockhash\": \"hex\",  (string) The block the snapshot is of\n"
+            "  \"height\": n,          (numeric) The height of the block\n"
+            "  \"rows\": n,            (numeric) The number of database rows in the snapshot\n"
+            "  \"hash\": \"hex\"        (string) The hash committing to the snapshot\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("loadreferralsnapshot", "\"referrals.snapshot\"")
+            + HelpExampleRpc("loadreferralsnapshot", "\"referrals.snapshot\"")
+        );
+    }
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+
+    uint256 hash;
+    if (request.params.size() > 1) {
+        hash = ParseHashV(request.params[1], "hash");
+    }
+
+    LOCK(cs_main);
+
+    referral::ReferralSnapshot snapshot;
+    if (!prefviewdb->LoadSnapshot(path, chainActive.Tip()->GetBlockHash(), hash, snapshot)) {
+        if (prefviewdb->IsLoadingSnapshot()) {
+            // Some rows were replaced already, the node can't go on with them.
+            StartShutdown();
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Loading the referral snapshot failed part way, shutting down. Restart with -reindex-chainstate");
+        }
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to load the referral snapshot, see the log for details");
+    }
+
+    prefviewcache->Flush();
+    pog3::GetCgsState().Invalidate();
+    pog3::ClearCgsSnapshots();
+    ClearCachedRewardAmbassadors();
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("blockhash", snapshot.block_hash.GetHex()));
+    ret.push_back(Pair("height", snapshot.height));
+    ret.push_back(Pair("rows", static_cast<int64_t>(snapshot.rows)));
+    ret.push_back(Pair("hash", snapshot.hash.GetHex()));
+    return ret;
+}
+
 UniValue relaymempool(const JSONRPCRequest& request)
 {
     if (request.fHelp)
@@ -1915,6 +2022,8 @@ static const CRPCCommand commands[] =
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
+    { "blockchain",         "dumpreferralsnapshot",   &dumpreferralsnapshot,   {"path"} },
+    { "blockchain",         "loadreferralsnapshot",   &loadreferralsnapshot,   {"path","hash"} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
 
     { "blockchain",         "preciousblock",          &preciousblock,          {"blockhash"} },
@@ -133,6 +133,7 @@ UniValue generateBlocks(
     auto consensusParams = Params().GetConsensus();
 
     ctpl::thread_pool pool{nThreads};
+    CuckooSolver solver{pool};
 
     do {
         const auto pblocktemplate =
@@ -159,7 +160,7 @@ UniValue generateBlocks(
                     consensusParams,
                     nThreads,
                     cycle_found,
-                    pool)) {
+                    solver)) {
 
             ++pblock->nNonce;
             --nMaxTries;
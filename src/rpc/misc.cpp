@@ -25,6 +25,7 @@
 
 #include "pog/anv.h"
 #include "pog3/cgs.h"
+#include "pog3/snapshot.h"
 #include "pog/select.h"
 #include "rpc/safemode.h"
 
@@ -595,6 +596,25 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCReferralCacheInfo()
+{
+    UniValue obj(UniValue::VOBJ);
+    if (!prefviewcache) {
+        return obj;
+    }
+
+    for (const auto& stats : prefviewcache->GetCacheStats()) {
+        UniValue cache(UniValue::VOBJ);
+        cache.push_back(Pair("size", uint64_t(stats.size)));
+        cache.push_back(Pair("max_size", uint64_t(stats.max_size)));
+        cache.push_back(Pair("hits", stats.hits));
+        cache.push_back(Pair("misses", stats.misses));
+        cache.push_back(Pair("evictions", stats.evictions));
+        obj.push_back(Pair(stats.name, cache));
+    }
+    return obj;
+}
+
 #ifdef HAVE_MALLOC_INFO
 static std::string RPCMallocInfo()
 {
@@ -636,6 +656,15 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"referrals\": {            (json object) Information about the in-memory referral caches\n"
+            "    \"name\": {               (json object) One of referrals, hashes, aliases, confirmations or heights\n"
+            "      \"size\": xxxxx,        (numeric) Number of entries cached\n"
+            "      \"max_size\": xxxxx,    (numeric) Maximum number of entries cached\n"
+            "      \"hits\": xxxxx,        (numeric) Number of lookups found in the cache\n"
+            "      \"misses\": xxxxx,      (numeric) Number of lookups that went to the database\n"
+            "      \"evictions\": xxxxx,   (numeric) Number of entries evicted to stay within -refcache\n"
+            "    },...\n"
             "  }\n"
             "}\n"
             "\nResult (mode \"mallocinfo\"):\n"
@@ -647,6 +676,7 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.push_back(Pair("locked", RPCLockedMemoryInfo()));
+        obj.push_back(Pair("referrals", RPCReferralCacheInfo()));
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
@@ -1362,6 +1392,32 @@ UniValue RankComputationsNotReady() {
     return result;
 }
 
+/**
+ * Returns the CGS snapshot of the active tip. cs_main is only held to read
+ * the tip and, if nothing computed the snapshot yet, to compute it.
+ */
+pog3::CGSSnapshotRef GetTipCgsSnapshot()
+{
+    uint256 tip_hash;
+    int height;
+    {
+        LOCK(cs_main);
+        tip_hash = chainActive.Tip()->GetBlockHash();
+        height = chainActive.Height();
+    }
+
+    if (auto snapshot = pog3::FindCgsSnapshot(tip_hash, height)) {
+        return snapshot;
+    }
+
+    LOCK(cs_main);
+    return pog3::GetCgsSnapshot(
+            *prefviewcache,
+            Params().GetConsensus(),
+            chainActive.Tip()->GetBlockHash(),
+            chainActive.Height());
+}
+
 UniValue getaddressrank(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 1)
@@ -1400,29 +1456,18 @@ UniValue getaddressrank(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid or unconfirmed addresses were passed");
     }
 
-    LOCK(cs_main);
-
-    const auto params = Params().GetConsensus();
-
-    pog3::Entrants all_entrants;
-    pog3::CGSContext context;
-    context.cgs_pool = pog3::GetCgsThreadPool();
-
-    pog3::GetAllRewardableEntrants(context, *prefviewcache, params, chainActive.Height(), all_entrants);
+    const auto snapshot = GetTipCgsSnapshot();
+    const auto& context = snapshot->context;
 
     std::vector<CAmount> cgs;
     for (const auto& a : validAddresses) {
-     const auto& e = context.GetEntrant(a.first);
-     auto node = pog3::ComputeCGS(context, e, *prefviewcache);
+     const auto idx = context.GetEntrantIdx(a.first);
+     auto node = pog3::ComputeCGS(context, idx);
      cgs.push_back(node.cgs);
     }
 
-    CAmount lottery_cgs = 0;
-    auto cgs_ranks = CGSRanks(
-            cgs,
-            chainActive.Height(),
-            Params().GetConsensus(),
-            lottery_cgs);
+    const auto lottery_cgs = snapshot->lottery_cgs;
+    auto cgs_ranks = CGSRanks(cgs, *snapshot);
 
     //Hack to keep ANVRanks  (2nlog(n)) vs (nlogn + n) we rewrite the address
     //because among addresses of equal rank, ANVRAnks may return an entry with a different address.
@@ -1469,13 +1514,9 @@ UniValue getaddressleaderboard(const JSONRPCRequest& request)
         total = std::max(1, request.params[0].get_int());
     }
 
-    LOCK(cs_main);
-    CAmount lottery_cgs = 0;
-    auto cgs_ranks = TopCGSRanks(
-            total,
-            chainActive.Height(),
-            Params().GetConsensus(),
-            lottery_cgs);
+    const auto snapshot = GetTipCgsSnapshot();
+    const auto lottery_cgs = snapshot->lottery_cgs;
+    auto cgs_ranks = TopCGSRanks(total, *snapshot);
 
     UniValue result(UniValue::VOBJ);
     UniValue cgs_rankarr = RanksToUniValue(lottery_cgs, cgs_ranks.first, cgs_ranks.second, true);
@@ -1518,6 +1559,8 @@ UniValue simulatelottery(const JSONRPCRequest& request)
             "\nExamples:\n" +
             HelpExampleCli("simulatelottery", "4") + HelpExampleRpc("getaddressleaderboard", "100"));
 
+    LOCK(cs_main);
+
     auto seed = chainActive.Tip()->GetBlockHash();
     auto height = chainActive.Tip()->nHeight;
 
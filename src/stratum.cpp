@@ -0,0 +1,679 @@
+// Copyright (c) 2017-2021 The Merit Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "stratum.h"
+
+#include "arith_uint256.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "cuckoo/cuckoo.h"
+#include "hash.h"
+#include "miner.h"
+#include "netbase.h"
+#include "pow.h"
+#include "rpc/protocol.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "validation.h"
+#include "validationinterface.h"
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <univalue.h>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/listener.h>
+#include <event2/thread.h>
+#include <event2/util.h>
+
+const std::string DEFAULT_STRATUM_BIND = "127.0.0.1";
+
+/** Nonces every session gets of a job. A job is split into 2^32 / this. */
+static const uint64_t STRATUM_NONCE_RANGE = 1 << 24;
+/** Sessions that can be connected at once, one per nonce range. */
+static const size_t STRATUM_MAX_SESSIONS = (1ull << 32) / STRATUM_NONCE_RANGE;
+/** Jobs on the current tip that solutions are still accepted for. */
+static const size_t STRATUM_MAX_JOBS = 16;
+/** Seconds between checks whether the block template went stale. */
+static const int STRATUM_REFRESH_INTERVAL = 5;
+/** Longest line a solver may send, the cycle of a solution fits easily. */
+static const size_t STRATUM_MAX_LINE_LENGTH = 16384;
+
+/** A block template solvers are working on. */
+struct StratumJob
+{
+    std::string id;
+    std::unique_ptr<CBlockTemplate> block_template;
+    int height;
+    int64_t created;
+    unsigned int transactions_updated;
+
+    //Nonces and cycle hashes already submitted so a share counts once.
+    std::set<std::pair<uint32_t, uint256>> solutions;
+};
+
+using StratumJobRef = std::shared_ptr<StratumJob>;
+
+/** A connected solver. */
+struct StratumSession
+{
+    uint64_t id;
+    size_t slot;
+    std::string peer;
+    struct bufferevent* bev;
+    bool subscribed = false;
+    arith_uint256 share_target;
+    uint64_t shares = 0;
+};
+
+class StratumServer : public CValidationInterface
+{
+public:
+    StratumServer(
+            const CChainParams& chainparams,
+            struct event_base* base,
+            const CScript& coinbase_script,
+            const arith_uint256& share_target);
+    ~StratumServer();
+
+    bool Bind(const CService& address);
+
+    /** Makes and pushes a new job from the event thread, safe to call from any thread. */
+    void RequestNewJob();
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override;
+
+private:
+    static void accept_cb(struct evconnlistener*, evutil_socket_t, struct sockaddr*, int, void* ctx);
+    static void read_cb(struct bufferevent* bev, void* ctx);
+    static void event_cb(struct bufferevent* bev, short what, void* ctx);
+    static void new_job_cb(evutil_socket_t, short, void* ctx);
+    static void refresh_cb(evutil_socket_t, short, void* ctx);
+
+    void Accept(evutil_socket_t fd, struct sockaddr* addr);
+    void Disconnect(StratumSession& session);
+    void ReadLine(StratumSession& session, const std::string& line);
+    void Send(StratumSession& session, const UniValue& message);
+
+    UniValue Subscribe(StratumSession& session);
+    UniValue SetShareBits(StratumSession& session, const UniValue& params);
+    UniValue Submit(StratumSession& session, const UniValue& params);
+
+    bool NewJob();
+    void Refresh();
+    void SendJob(StratumSession& session, const StratumJob& job, bool clean);
+    StratumJobRef FindJob(const std::string& id) const;
+
+    const CChainParams& m_chainparams;
+    struct event_base* m_base;
+    struct evconnlistener* m_listener = nullptr;
+    struct event* m_new_job_event = nullptr;
+    struct event* m_refresh_event = nullptr;
+
+    const CScript m_coinbase_script;
+    const arith_uint256 m_default_share_target;
+    unsigned int m_extra_nonce = 0;
+
+    uint64_t m_next_session_id = 1;
+    uint64_t m_next_job_id = 1;
+    std::map<struct bufferevent*, std::unique_ptr<StratumSession>> m_sessions;
+    std::vector<bool> m_slots;
+    std::deque<StratumJobRef> m_jobs;
+};
+
+static std::string BitsToHex(uint32_t bits)
+{
+    return strprintf("%08x", bits);
+}
+
+static bool ParseShareBits(
+        const std::string& hex,
+        const Consensus::Params& params,
+        arith_uint256& target)
+{
+    if (hex.empty() || hex.size() > 8 || !IsHex(std::string(hex.size() % 2, '0') + hex)) {
+        return false;
+    }
+
+    bool negative;
+    bool overflow;
+    target.SetCompact(static_cast<uint32_t>(std::stoul(hex, nullptr, 16)), &negative, &overflow);
+    if (negative || overflow || target == 0) {
+        return false;
+    }
+
+    target = std::min(target, UintToArith256(params.powLimit.uHashLimit));
+    return true;
+}
+
+StratumServer::StratumServer(
+        const CChainParams& chainparams,
+        struct event_base* base,
+        const CScript& coinbase_script,
+        const arith_uint256& share_target) :
+    m_chainparams{chainparams},
+    m_base{base},
+    m_coinbase_script{coinbase_script},
+    m_default_share_target{share_target},
+    m_slots(STRATUM_MAX_SESSIONS, false)
+{
+    m_new_job_event = event_new(m_base, -1, 0, new_job_cb, this);
+    m_refresh_event = event_new(m_base, -1, EV_PERSIST, refresh_cb, this);
+
+    struct timeval interval = {STRATUM_REFRESH_INTERVAL, 0};
+    event_add(m_refresh_event, &interval);
+}
+
+StratumServer::~StratumServer()
+{
+    for (auto& session : m_sessions) {
+        bufferevent_free(session.first);
+    }
+    m_sessions.clear();
+
+    if (m_listener) {
+        evconnlistener_free(m_listener);
+    }
+    event_free(m_refresh_event);
+    event_free(m_new_job_event);
+}
+
+bool StratumServer::Bind(const CService& address)
+{
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    if (!address.GetSockAddr((struct sockaddr*)&sockaddr, &len)) {
+        return false;
+    }
+
+    m_listener = evconnlistener_new_bind(
+            m_base,
+            accept_cb,
+            this,
+            LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE,
+            -1,
+            (struct sockaddr*)&sockaddr,
+            len);
+
+    return m_listener != nullptr;
+}
+
+void StratumServer::RequestNewJob()
+{
+    event_active(m_new_job_event, 0, 0);
+}
+
+void StratumServer::UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload)
+{
+    if (!fInitialDownload) {
+        RequestNewJob();
+    }
+}
+
+void StratumServer::accept_cb(struct evconnlistener*, evutil_socket_t fd, struct sockaddr* addr, int, void* ctx)
+{
+    static_cast<StratumServer*>(ctx)->Accept(fd, addr);
+}
+
+void StratumServer::read_cb(struct bufferevent* bev, void* ctx)
+{
+    auto self = static_cast<StratumServer*>(ctx);
+    auto it = self->m_sessions.find(bev);
+    assert(it != self->m_sessions.end());
+    auto& session = *it->second;
+
+    struct evbuffer* input = bufferevent_get_input(bev);
+    size_t n_read_out = 0;
+    char* line;
+    while ((line = evbuffer_readln(input, &n_read_out, EVBUFFER_EOL_CRLF)) != nullptr) {
+        std::string s(line, n_read_out);
+        free(line);
+
+        self->ReadLine(session, s);
+
+        //The session is gone if the line made us drop it.
+        if (!self->m_sessions.count(bev)) {
+            return;
+        }
+    }
+
+    if (evbuffer_get_length(input) > STRATUM_MAX_LINE_LENGTH) {
+        LogPrint(BCLog::STRATUM, "stratum: line from %s too long, disconnecting\n", session.peer);
+        self->Disconnect(session);
+    }
+}
+
+void StratumServer::event_cb(struct bufferevent* bev, short what, void* ctx)
+{
+    auto self = static_cast<StratumServer*>(ctx);
+    if (what & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) {
+        auto it = self->m_sessions.find(bev);
+        if (it != self->m_sessions.end()) {
+            self->Disconnect(*it->second);
+        }
+    }
+}
+
+void StratumServer::new_job_cb(evutil_socket_t, short, void* ctx)
+{
+    static_cast<StratumServer*>(ctx)->NewJob();
+}
+
+void StratumServer::refresh_cb(evutil_socket_t, short, void* ctx)
+{
+    static_cast<StratumServer*>(ctx)->Refresh();
+}
+
+void StratumServer::Accept(evutil_socket_t fd, struct sockaddr* addr)
+{
+    CService peer;
+    peer.SetSockAddr(addr);
+
+    const auto slot = std::find(m_slots.begin(), m_slots.end(), false);
+    if (slot == m_slots.end()) {
+        LogPrintf("stratum: too many solvers, rejecting %s\n", peer.ToString());
+        evutil_closesocket(fd);
+        return;
+    }
+
+    struct bufferevent* bev = bufferevent_socket_new(m_base, fd, BEV_OPT_CLOSE_ON_FREE);
+    if (!bev) {
+        evutil_closesocket(fd);
+        return;
+    }
+
+    std::unique_ptr<StratumSession> session{new StratumSession};
+    session->id = m_next_session_id++;
+    session->slot = slot - m_slots.begin();
+    session->peer = peer.ToString();
+    session->bev = bev;
+    session->share_target = m_default_share_target;
+    *slot = true;
+
+    LogPrint(BCLog::STRATUM, "stratum: session %d connected from %s\n", session->id, session->peer);
+
+    m_sessions.emplace(bev, std::move(session));
+
+    bufferevent_setcb(bev, read_cb, nullptr, event_cb, this);
+    bufferevent_enable(bev, EV_READ | EV_WRITE);
+}
+
+void StratumServer::Disconnect(StratumSession& session)
+{
+    LogPrint(BCLog::STRATUM, "stratum: session %d from %s disconnected after %d shares\n",
+            session.id, session.peer, session.shares);
+
+    m_slots[session.slot] = false;
+
+    //Erasing the session frees it, so keep the bufferevent around until then.
+    auto bev = session.bev;
+    m_sessions.erase(bev);
+    bufferevent_free(bev);
+}
+
+void StratumServer::Send(StratumSession& session, const UniValue& message)
+{
+    const auto line = message.write() + "\n";
+    bufferevent_write(session.bev, line.data(), line.size());
+}
+
+void StratumServer::ReadLine(StratumSession& session, const std::string& line)
+{
+    UniValue request;
+    if (!request.read(line) || !request.isObject()) {
+        Send(session, JSONRPCReplyObj(NullUniValue, JSONRPCError(RPC_PARSE_ERROR, "Parse error"), NullUniValue));
+        return;
+    }
+
+    const UniValue id = find_value(request, "id");
+    const UniValue& method = find_value(request, "method");
+    const UniValue& params = find_value(request, "params");
+
+    if (!method.isStr()) {
+        Send(session, JSONRPCReplyObj(NullUniValue, JSONRPCError(RPC_INVALID_REQUEST, "Method must be a string"), id));
+        return;
+    }
+
+    try {
+        UniValue result;
+        if (method.get_str() == "subscribe") {
+            result = Subscribe(session);
+        } else if (method.get_str() == "set_share_bits") {
+            result = SetShareBits(session, params);
+        } else if (method.get_str() == "submit") {
+            result = Submit(session, params);
+        } else {
+            throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found");
+        }
+
+        Send(session, JSONRPCReplyObj(result, NullUniValue, id));
+    } catch (const UniValue& error) {
+        Send(session, JSONRPCReplyObj(NullUniValue, error, id));
+    } catch (const std::exception& e) {
+        Send(session, JSONRPCReplyObj(NullUniValue, JSONRPCError(RPC_MISC_ERROR, e.what()), id));
+    }
+
+    //A subscription is answered before the first job is pushed.
+    if (method.get_str() == "subscribe" && session.subscribed) {
+        if (m_jobs.empty()) {
+            NewJob();
+        } else {
+            SendJob(session, *m_jobs.back(), true);
+        }
+    }
+}
+
+UniValue StratumServer::Subscribe(StratumSession& session)
+{
+    session.subscribed = true;
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("session", session.id));
+    result.push_back(Pair("nonce_start", session.slot * STRATUM_NONCE_RANGE));
+    result.push_back(Pair("nonce_count", STRATUM_NONCE_RANGE));
+    result.push_back(Pair("share_target", ArithToUint256(session.share_target).GetHex()));
+    return result;
+}
+
+UniValue StratumServer::SetShareBits(StratumSession& session, const UniValue& params)
+{
+    if (!params.isArray() || params.size() != 1 || !params[0].isStr()) {
+        throw JSONRPCError(RPC_INVALID_PARAMS, "Expected [\"bits\"]");
+    }
+
+    arith_uint256 target;
+    if (!ParseShareBits(params[0].get_str(), m_chainparams.GetConsensus(), target)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid share bits");
+    }
+
+    session.share_target = target;
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("share_target", ArithToUint256(target).GetHex()));
+    return result;
+}
+
+UniValue StratumServer::Submit(StratumSession& session, const UniValue& params)
+{
+    if (!session.subscribed) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Not subscribed");
+    }
+
+    if (!params.isObject()) {
+        throw JSONRPCError(RPC_INVALID_PARAMS, "Expected {\"job_id\", \"nonce\", \"cycle\"}");
+    }
+
+    const auto& job_id = find_value(params, "job_id");
+    const auto& nonce_value = find_value(params, "nonce");
+    const auto& cycle_value = find_value(params, "cycle");
+    if (!job_id.isStr() || !nonce_value.isNum() || !cycle_value.isArray()) {
+        throw JSONRPCError(RPC_INVALID_PARAMS, "Expected {\"job_id\", \"nonce\", \"cycle\"}");
+    }
+
+    const auto job = FindJob(job_id.get_str());
+    if (!job) {
+        throw JSONRPCError(RPC_VERIFY_REJECTED, "stale-job");
+    }
+
+    const int64_t nonce = nonce_value.get_int64();
+    if (nonce < 0 || static_cast<uint64_t>(nonce) / STRATUM_NONCE_RANGE != session.slot) {
+        throw JSONRPCError(RPC_VERIFY_REJECTED, "nonce-out-of-range");
+    }
+
+    const auto& consensus = m_chainparams.GetConsensus();
+    std::shared_ptr<CBlock> block = std::make_shared<CBlock>(job->block_template->block);
+    block->nNonce = static_cast<uint32_t>(nonce);
+
+    for (size_t i = 0; i < cycle_value.size(); i++) {
+        const int64_t edge = cycle_value[i].get_int64();
+        if (edge < 0 || edge > std::numeric_limits<uint32_t>::max()) {
+            throw JSONRPCError(RPC_VERIFY_REJECTED, "bad-cycle");
+        }
+        block->sCycle.insert(static_cast<uint32_t>(edge));
+    }
+
+    if (block->sCycle.size() != cycle_value.size() || block->sCycle.size() != consensus.nCuckooProofSize) {
+        throw JSONRPCError(RPC_VERIFY_REJECTED, "bad-cycle");
+    }
+
+    const auto block_hash = block->GetHash();
+    const std::vector<uint32_t> cycle{block->sCycle.begin(), block->sCycle.end()};
+    const int code = VerifyCycle(block_hash, block->nEdgeBits, consensus.nCuckooProofSize, cycle);
+    if (code != POW_OK) {
+        throw JSONRPCError(RPC_VERIFY_REJECTED, strprintf("bad-cycle: %s", errstr[code]));
+    }
+
+    const auto cycle_hash = SerializeHash(block->sCycle);
+    if (!job->solutions.emplace(block->nNonce, cycle_hash).second) {
+        throw JSONRPCError(RPC_VERIFY_REJECTED, "duplicate");
+    }
+
+    const bool is_block = CheckProofOfWork(cycle_hash, block->nBits, consensus);
+    if (!is_block && UintToArith256(cycle_hash) > session.share_target) {
+        throw JSONRPCError(RPC_VERIFY_REJECTED, "low-difficulty-share");
+    }
+
+    session.shares++;
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("share", true));
+    result.push_back(Pair("block", is_block));
+
+    if (is_block) {
+        LogPrintf("stratum: session %d found block %s at height %d\n", session.id, block_hash.GetHex(), job->height);
+
+        const bool accepted = ProcessNewBlock(m_chainparams, block, true, nullptr, false);
+        result.push_back(Pair("block_hash", block_hash.GetHex()));
+        result.push_back(Pair("accepted", accepted));
+    }
+
+    return result;
+}
+
+StratumJobRef StratumServer::FindJob(const std::string& id) const
+{
+    for (const auto& job : m_jobs) {
+        if (job->id == id) {
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+bool StratumServer::NewJob()
+{
+    if (IsInitialBlockDownload()) {
+        return false;
+    }
+
+    StratumJobRef job = std::make_shared<StratumJob>();
+    job->transactions_updated = mempool.GetTransactionsUpdated();
+    job->created = GetTime();
+    job->block_template = BlockAssembler(m_chainparams).CreateNewBlock(m_coinbase_script);
+    if (!job->block_template) {
+        LogPrintf("stratum: unable to create a block template\n");
+        return false;
+    }
+
+    auto& block = job->block_template->block;
+    {
+        LOCK(cs_main);
+        const auto it = mapBlockIndex.find(block.hashPrevBlock);
+        if (it == mapBlockIndex.end()) {
+            return false;
+        }
+
+        job->height = it->second->nHeight + 1;
+        IncrementExtraNonce(&block, it->second, m_extra_nonce);
+    }
+
+    job->id = strprintf("%x", m_next_job_id++);
+
+    //Solutions to jobs on another tip would be orphans.
+    const bool clean = m_jobs.empty() || m_jobs.back()->block_template->block.hashPrevBlock != block.hashPrevBlock;
+    if (clean) {
+        m_jobs.clear();
+    } else if (m_jobs.size() >= STRATUM_MAX_JOBS) {
+        m_jobs.pop_front();
+    }
+    m_jobs.push_back(job);
+
+    LogPrint(BCLog::STRATUM, "stratum: job %s at height %d with %d transactions\n",
+            job->id, job->height, block.vtx.size());
+
+    for (auto& session : m_sessions) {
+        if (session.second->subscribed) {
+            SendJob(*session.second, *job, clean);
+        }
+    }
+
+    return true;
+}
+
+void StratumServer::Refresh()
+{
+    if (m_jobs.empty()) {
+        NewJob();
+        return;
+    }
+
+    const auto& job = *m_jobs.back();
+    uint256 tip;
+    {
+        LOCK(cs_main);
+        tip = chainActive.Tip()->GetBlockHash();
+    }
+
+    const bool tip_changed = tip != job.block_template->block.hashPrevBlock;
+    const bool template_stale =
+        mempool.GetTransactionsUpdated() != job.transactions_updated &&
+        GetTime() - job.created > m_chainparams.MininBlockStaleTime();
+
+    if (tip_changed || template_stale) {
+        NewJob();
+    }
+}
+
+void StratumServer::SendJob(StratumSession& session, const StratumJob& job, bool clean)
+{
+    const auto& block = job.block_template->block;
+
+    CDataStream header(SER_GETHASH, PROTOCOL_VERSION);
+    header << static_cast<const CBlockHeader&>(block);
+
+    UniValue params(UniValue::VOBJ);
+    params.push_back(Pair("job_id", job.id));
+    params.push_back(Pair("clean", clean));
+    params.push_back(Pair("height", job.height));
+    params.push_back(Pair("header", HexStr(header.begin(), header.end())));
+    params.push_back(Pair("version", block.nVersion));
+    params.push_back(Pair("prev_hash", block.hashPrevBlock.GetHex()));
+    params.push_back(Pair("merkle_root", block.hashMerkleRoot.GetHex()));
+    params.push_back(Pair("time", static_cast<int64_t>(block.nTime)));
+    params.push_back(Pair("bits", BitsToHex(block.nBits)));
+    params.push_back(Pair("edge_bits", block.nEdgeBits));
+    params.push_back(Pair("proof_size", m_chainparams.GetConsensus().nCuckooProofSize));
+    params.push_back(Pair("nonce_start", session.slot * STRATUM_NONCE_RANGE));
+    params.push_back(Pair("nonce_count", STRATUM_NONCE_RANGE));
+    params.push_back(Pair("target", ArithToUint256(arith_uint256().SetCompact(block.nBits)).GetHex()));
+    params.push_back(Pair("share_target", ArithToUint256(session.share_target).GetHex()));
+
+    Send(session, JSONRPCRequestObj("job", params, NullUniValue));
+}
+
+static struct event_base* gBase = nullptr;
+static boost::thread stratumThread;
+static std::unique_ptr<StratumServer> g_stratum;
+
+static void StratumThread()
+{
+    event_base_dispatch(gBase);
+}
+
+bool StartStratumServer(const CChainParams& chainparams)
+{
+    assert(!gBase);
+
+    const auto address = gArgs.GetArg("-stratumaddress", "");
+    const auto destination = LookupDestination(address);
+    if (!IsValidDestination(destination)) {
+        LogPrintf("stratum: -stratumaddress '%s' is not a valid address\n", address);
+        return false;
+    }
+
+    arith_uint256 share_target = UintToArith256(chainparams.GetConsensus().powLimit.uHashLimit);
+    if (gArgs.IsArgSet("-stratumsharebits") &&
+            !ParseShareBits(gArgs.GetArg("-stratumsharebits", ""), chainparams.GetConsensus(), share_target)) {
+        LogPrintf("stratum: invalid -stratumsharebits\n");
+        return false;
+    }
+
+    CService bind;
+    const auto bind_address = gArgs.GetArg("-stratumbind", DEFAULT_STRATUM_BIND);
+    if (!Lookup(bind_address.c_str(), bind, gArgs.GetArg("-stratumport", DEFAULT_STRATUM_PORT), false)) {
+        LogPrintf("stratum: invalid -stratumbind '%s'\n", bind_address);
+        return false;
+    }
+
+#ifdef WIN32
+    evthread_use_windows_threads();
+#else
+    evthread_use_pthreads();
+#endif
+    gBase = event_base_new();
+    if (!gBase) {
+        LogPrintf("stratum: Unable to create event_base\n");
+        return false;
+    }
+
+    g_stratum.reset(new StratumServer{chainparams, gBase, GetScriptForDestination(destination), share_target});
+    if (!g_stratum->Bind(bind)) {
+        LogPrintf("stratum: unable to bind to %s\n", bind.ToString());
+        g_stratum.reset();
+        event_base_free(gBase);
+        gBase = nullptr;
+        return false;
+    }
+
+    LogPrintf("stratum: listening for solvers on %s\n", bind.ToString());
+
+    RegisterValidationInterface(g_stratum.get());
+    g_stratum->RequestNewJob();
+
+    stratumThread = boost::thread(boost::bind(&TraceThread<void (*)()>, "stratum", &StratumThread));
+    return true;
+}
+
+void InterruptStratumServer()
+{
+    if (gBase) {
+        LogPrintf("stratum: Thread interrupt\n");
+        //Unlike a loop break, an exit scheduled before the loop started
+        //still ends it once it does.
+        event_base_loopexit(gBase, nullptr);
+    }
+}
+
+void StopStratumServer()
+{
+    if (gBase) {
+        UnregisterValidationInterface(g_stratum.get());
+        stratumThread.join();
+        g_stratum.reset();
+        event_base_free(gBase);
+        gBase = nullptr;
+    }
+}
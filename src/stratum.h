@@ -0,0 +1,27 @@
+// Copyright (c) 2017-2021 The Merit Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/**
+ * Push based server handing out Cuckoo Cycle mining jobs to external solvers
+ * over TCP, one JSON object per line. See doc/stratum.md for the protocol.
+ */
+#ifndef MERIT_STRATUM_H
+#define MERIT_STRATUM_H
+
+#include <string>
+
+class CChainParams;
+
+static const bool DEFAULT_STRATUM_ENABLE = false;
+static const int DEFAULT_STRATUM_PORT = 8449;
+extern const std::string DEFAULT_STRATUM_BIND;
+
+/** Start the job server, -stratumaddress must name the coinbase address. */
+bool StartStratumServer(const CChainParams& chainparams);
+/** Interrupt the job server thread */
+void InterruptStratumServer();
+/** Stop the job server and drop all solver connections */
+void StopStratumServer();
+
+#endif // MERIT_STRATUM_H
@@ -0,0 +1,201 @@
+// Copyright (c) 2017-2021 The Merit Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "arith_uint256.h"
+#include "chainparams.h"
+#include "cuckoo/cuckoo.h"
+#include "cuckoo/mean_cuckoo.h"
+#include "cuckoo/miner.h"
+#include "primitives/block.h"
+#include "test/test_merit.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(cuckoo_tests, BasicTestingSetup)
+
+namespace
+{
+    /** Mines a header at the minimum difficulty and edge bits of params. */
+    CBlockHeader MineHeader(const Consensus::Params& params, uint32_t time, ctpl::thread_pool& pool)
+    {
+        CBlockHeader header;
+        header.nVersion = 1;
+        header.nTime = time;
+        header.nBits = UintToArith256(params.powLimit.uHashLimit).GetCompact();
+        header.nEdgeBits = params.powLimit.nEdgeBitsLimit;
+
+        CuckooSolver solver{pool};
+        for (header.nNonce = 0;; header.nNonce++) {
+            std::set<uint32_t> cycle;
+            bool cycle_found;
+            if (cuckoo::FindProofOfWorkAdvanced(
+                        header.GetHash(),
+                        header.nBits,
+                        header.nEdgeBits,
+                        cycle,
+                        params,
+                        1,
+                        cycle_found,
+                        solver)) {
+                header.sCycle = cycle;
+                return header;
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(siphash24N_matches_siphash24)
+{
+    const siphash_keys keys{0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL};
+
+    //Counts around the width of the SIMD lanes, so the remainder that is
+    //hashed one at a time gets checked too.
+    for (size_t count : {0, 1, 2, 7, 8, 9, 15, 16, 17, 23, 84}) {
+        std::vector<uint64_t> nonces(count);
+        for (size_t i = 0; i < count; i++) {
+            nonces[i] = i * 0x9e3779b97f4a7c15ULL;
+        }
+
+        //One more than needed to catch writes past the end.
+        std::vector<uint64_t> hashes(count + 1, 0);
+        siphash24N(&keys, nonces.data(), count, hashes.data());
+
+        for (size_t i = 0; i < count; i++) {
+            BOOST_CHECK_EQUAL(hashes[i], siphash24(&keys, nonces[i]));
+        }
+        BOOST_CHECK_EQUAL(hashes[count], 0U);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(verify_cycle)
+{
+    const auto chainparams = CreateChainParams(CBaseChainParams::REGTEST);
+    const auto& params = chainparams->GetConsensus();
+
+    ctpl::thread_pool pool{1};
+    const auto header = MineHeader(params, 1, pool);
+    const auto hash = header.GetHash();
+
+    std::vector<uint32_t> cycle{header.sCycle.begin(), header.sCycle.end()};
+    BOOST_CHECK_EQUAL(VerifyCycle(hash, header.nEdgeBits, params.nCuckooProofSize, cycle), POW_OK);
+
+    //The reference solver finds the same cycle.
+    std::set<uint32_t> found;
+    BOOST_CHECK(FindCycle(hash, header.nEdgeBits, params.nCuckooProofSize, found));
+    BOOST_CHECK(found == header.sCycle);
+
+    auto unordered = cycle;
+    std::swap(unordered[0], unordered[1]);
+    BOOST_CHECK_EQUAL(VerifyCycle(hash, header.nEdgeBits, params.nCuckooProofSize, unordered), POW_TOO_SMALL);
+
+    auto too_big = cycle;
+    too_big.back() = 1 << header.nEdgeBits;
+    BOOST_CHECK_EQUAL(VerifyCycle(hash, header.nEdgeBits, params.nCuckooProofSize, too_big), POW_TOO_BIG);
+
+    auto other_hash = hash;
+    *other_hash.begin() ^= 1;
+    BOOST_CHECK(VerifyCycle(other_hash, header.nEdgeBits, params.nCuckooProofSize, cycle) != POW_OK);
+}
+
+BOOST_AUTO_TEST_CASE(solver_reuse)
+{
+    const auto chainparams = CreateChainParams(CBaseChainParams::REGTEST);
+    const auto& params = chainparams->GetConsensus();
+    const uint8_t edge_bits = params.powLimit.nEdgeBitsLimit;
+
+    ctpl::thread_pool pool{2};
+    CuckooSolver solver{pool};
+
+    //A reused solver must find the same cycles as a fresh one, including
+    //right after a graph without a cycle, and after its edge bits or thread
+    //count change.
+    CBlockHeader header;
+    header.nVersion = 1;
+    header.nBits = UintToArith256(params.powLimit.uHashLimit).GetCompact();
+
+    size_t cycles = 0;
+    bool cycle_after_miss = false;
+    bool last_found = true;
+    for (header.nNonce = 0; header.nNonce < 1000 && (cycles < 3 || !cycle_after_miss); header.nNonce++) {
+        const auto hash = header.GetHash();
+        const uint8_t bits = header.nNonce % 5 == 4 ? edge_bits + 1 : edge_bits;
+        const size_t threads = header.nNonce % 3 == 2 ? 2 : 1;
+
+        std::set<uint32_t> reused_cycle;
+        const bool reused_found = solver.FindCycle(hash, bits, params.nCuckooProofSize, reused_cycle, threads);
+
+        std::set<uint32_t> fresh_cycle;
+        const bool fresh_found = FindCycleAdvanced(hash, bits, params.nCuckooProofSize, fresh_cycle, threads, pool);
+
+        BOOST_CHECK_EQUAL(reused_found, fresh_found);
+        BOOST_CHECK(reused_cycle == fresh_cycle);
+
+        if (reused_found) {
+            std::vector<uint32_t> cycle{reused_cycle.begin(), reused_cycle.end()};
+            BOOST_CHECK_EQUAL(VerifyCycle(hash, bits, params.nCuckooProofSize, cycle), POW_OK);
+            cycles++;
+            cycle_after_miss |= !last_found;
+        }
+        last_found = reused_found;
+    }
+
+    BOOST_CHECK(cycles >= 3);
+    BOOST_CHECK(cycle_after_miss);
+}
+
+BOOST_AUTO_TEST_CASE(verify_pow_batch)
+{
+    const auto chainparams = CreateChainParams(CBaseChainParams::REGTEST);
+    const auto& params = chainparams->GetConsensus();
+
+    ctpl::thread_pool pool{3};
+    const auto a = MineHeader(params, 1, pool);
+    const auto b = MineHeader(params, 2, pool);
+    BOOST_CHECK(cuckoo::VerifyProofOfWork(a.GetHash(), a.nBits, a.nEdgeBits, a.sCycle, params));
+    BOOST_CHECK(cuckoo::VerifyProofOfWork(b.GetHash(), b.nBits, b.nEdgeBits, b.sCycle, params));
+
+    //Enough headers to be split over all the threads of the pool.
+    std::vector<CBlockHeader> headers;
+    for (size_t i = 0; i < 100; i++) {
+        headers.push_back(i % 2 ? a : b);
+    }
+
+    //A cycle of another graph, a cycle that is too short and edge bits
+    //that are not allowed.
+    std::vector<CBlockHeader> bad_headers{a, a, a};
+    bad_headers[0].nTime = 3;
+    bad_headers[1].sCycle.erase(bad_headers[1].sCycle.begin());
+    bad_headers[2].nEdgeBits = params.powLimit.nEdgeBitsLimit - 1;
+    for (const auto& bad : bad_headers) {
+        BOOST_CHECK(!cuckoo::VerifyProofOfWork(bad.GetHash(), bad.nBits, bad.nEdgeBits, bad.sCycle, params));
+    }
+
+    ctpl::thread_pool no_threads;
+    for (auto* p : {&pool, &no_threads}) {
+        BOOST_CHECK_EQUAL(cuckoo::VerifyProofOfWorkBatch({}, params, *p), 0U);
+        BOOST_CHECK_EQUAL(cuckoo::VerifyProofOfWorkBatch({a}, params, *p), 1U);
+        BOOST_CHECK_EQUAL(cuckoo::VerifyProofOfWorkBatch({bad_headers[0]}, params, *p), 0U);
+        BOOST_CHECK_EQUAL(cuckoo::VerifyProofOfWorkBatch(headers, params, *p), headers.size());
+
+        for (const auto& bad : bad_headers) {
+            for (size_t pos : {0, 1, 33, 34, 50, 98, 99}) {
+                auto batch = headers;
+                batch[pos] = bad;
+                BOOST_CHECK_EQUAL(cuckoo::VerifyProofOfWorkBatch(batch, params, *p), pos);
+
+                //A later bad header, in the same chunk or another one, does
+                //not hide the first.
+                for (size_t later : {pos + 1, pos + 40}) {
+                    if (later < batch.size()) {
+                        auto twice = batch;
+                        twice[later] = bad;
+                        BOOST_CHECK_EQUAL(cuckoo::VerifyProofOfWorkBatch(twice, params, *p), pos);
+                    }
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,201 @@
+// Copyright (c) 2017-2021 The Merit Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "lrucache.h"
+#include "test/test_merit.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+    /** Puts key k in shard k % SHARDS so tests can fill a shard. */
+    struct IdentityHasher
+    {
+        size_t operator()(int key) const { return static_cast<size_t>(key); }
+    };
+
+    using Cache = ShardedLRUCache<int, int, IdentityHasher>;
+
+    const int SHARDS = Cache::SHARDS;
+    const size_t MB = 1 << 20;
+
+    /**
+     * The budget of a cache of megabyte entries that holds the given number
+     * of entries per shard. Megabyte entries dwarf the node sizes so the
+     * budget of just under n + 1 of them fits exactly n.
+     */
+    size_t Budget(size_t shard_entries)
+    {
+        return SHARDS * (shard_entries + 1) * MB - 1;
+    }
+
+    /** The nth key of shard 0. */
+    int Key(int n)
+    {
+        return n * SHARDS;
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(lrucache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(max_size)
+{
+    BOOST_CHECK_EQUAL((Cache{Budget(1), MB}.MaxSize()), SHARDS);
+    BOOST_CHECK_EQUAL((Cache{Budget(3), MB}.MaxSize()), 3 * SHARDS);
+    BOOST_CHECK_EQUAL((Cache{Budget(100), MB}.MaxSize()), 100 * SHARDS);
+
+    //A budget too small for an entry per shard still keeps one.
+    BOOST_CHECK_EQUAL(Cache{0}.MaxSize(), SHARDS);
+    BOOST_CHECK_EQUAL((Cache{SHARDS * MB, MB}.MaxSize()), SHARDS);
+
+    //Without extra bytes an entry costs a few dozen bytes.
+    const Cache small{SHARDS * 1000};
+    BOOST_CHECK(small.MaxSize() > SHARDS);
+    BOOST_CHECK(small.MaxSize() < SHARDS * 1000 / (2 * sizeof(int)));
+}
+
+BOOST_AUTO_TEST_CASE(eviction_order)
+{
+    Cache cache{Budget(3), MB};
+
+    for (int n = 0; n < 3; n++) {
+        cache.Put(Key(n), n);
+    }
+    BOOST_CHECK_EQUAL(cache.Size(), 3);
+
+    //Reading the oldest makes the second the least recently used.
+    BOOST_CHECK_EQUAL(*cache.Get(Key(0)), 0);
+    cache.Put(Key(3), 3);
+    BOOST_CHECK_EQUAL(cache.Size(), 3);
+    BOOST_CHECK(cache.Contains(Key(0)));
+    BOOST_CHECK(!cache.Contains(Key(1)));
+    BOOST_CHECK(cache.Contains(Key(2)));
+    BOOST_CHECK(cache.Contains(Key(3)));
+
+    //The Contains calls above touched 0, 2 and 3 in that order.
+    cache.Put(Key(4), 4);
+    BOOST_CHECK(!cache.Contains(Key(0)));
+    BOOST_CHECK(cache.Contains(Key(2)));
+    BOOST_CHECK(cache.Contains(Key(3)));
+    BOOST_CHECK(cache.Contains(Key(4)));
+
+    //A full shard doesn't evict from the others.
+    for (int k = 1; k < SHARDS; k++) {
+        cache.Put(k, k);
+    }
+    BOOST_CHECK_EQUAL(cache.Size(), 3 + SHARDS - 1);
+    BOOST_CHECK(cache.Contains(Key(2)));
+    BOOST_CHECK(cache.Contains(Key(3)));
+    BOOST_CHECK(cache.Contains(Key(4)));
+}
+
+BOOST_AUTO_TEST_CASE(put_replaces)
+{
+    Cache cache{Budget(2), MB};
+
+    cache.Put(Key(0), 0);
+    cache.Put(Key(1), 1);
+
+    //Replacing doesn't evict and makes the key the most recently used.
+    cache.Put(Key(0), 10);
+    BOOST_CHECK_EQUAL(cache.Size(), 2);
+    BOOST_CHECK_EQUAL(cache.Evictions(), 0);
+    BOOST_CHECK_EQUAL(*cache.Get(Key(0)), 10);
+
+    cache.Put(Key(1), 11);
+    cache.Put(Key(2), 12);
+    BOOST_CHECK_EQUAL(cache.Evictions(), 1);
+    BOOST_CHECK(!cache.Contains(Key(0)));
+    BOOST_CHECK_EQUAL(*cache.Get(Key(1)), 11);
+    BOOST_CHECK_EQUAL(*cache.Get(Key(2)), 12);
+}
+
+BOOST_AUTO_TEST_CASE(erase)
+{
+    Cache cache{Budget(2), MB};
+
+    cache.Put(Key(0), 0);
+    cache.Put(Key(1), 1);
+    cache.Erase(Key(0));
+    cache.Erase(Key(5));
+    BOOST_CHECK_EQUAL(cache.Size(), 1);
+    BOOST_CHECK(!cache.Get(Key(0)));
+
+    //The erased entry's room is free again.
+    cache.Put(Key(2), 2);
+    BOOST_CHECK_EQUAL(cache.Evictions(), 0);
+    BOOST_CHECK(cache.Contains(Key(1)));
+    BOOST_CHECK(cache.Contains(Key(2)));
+
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.Size(), 0);
+    BOOST_CHECK(!cache.Contains(Key(1)));
+}
+
+BOOST_AUTO_TEST_CASE(counters)
+{
+    Cache cache{Budget(2), MB};
+
+    BOOST_CHECK(!cache.Get(Key(0)));
+    cache.Put(Key(0), 0);
+    BOOST_CHECK(cache.Get(Key(0)));
+    BOOST_CHECK(cache.Contains(Key(0)));
+    BOOST_CHECK(!cache.Contains(Key(1)));
+    BOOST_CHECK_EQUAL(cache.Hits(), 2);
+    BOOST_CHECK_EQUAL(cache.Misses(), 2);
+    BOOST_CHECK_EQUAL(cache.Evictions(), 0);
+
+    for (int n = 1; n < 6; n++) {
+        cache.Put(Key(n), n);
+    }
+    BOOST_CHECK_EQUAL(cache.Evictions(), 4);
+    BOOST_CHECK_EQUAL(cache.Hits(), 2);
+    BOOST_CHECK_EQUAL(cache.Misses(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_get_put)
+{
+    Cache cache{Budget(8), MB};
+    const int KEYS = 1000;
+    const int ROUNDS = 20000;
+
+    //Boost checks aren't thread safe so the threads only count bad values.
+    std::atomic<int> bad_values{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&cache, &bad_values, t] {
+            for (int i = 0; i < ROUNDS; i++) {
+                const int key = (i * 7 + t * 13) % KEYS;
+                if (i % 3 == 0) {
+                    cache.Put(key, key);
+                } else if (i % 17 == 0) {
+                    cache.Erase(key);
+                } else {
+                    const auto value = cache.Get(key);
+                    if (value && *value != key) {
+                        bad_values++;
+                    }
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    BOOST_CHECK_EQUAL(bad_values.load(), 0);
+    BOOST_CHECK(cache.Size() <= cache.MaxSize());
+    for (int key = 0; key < KEYS; key++) {
+        const auto value = cache.Get(key);
+        if (value) {
+            BOOST_CHECK_EQUAL(*value, key);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,142 @@
+// Copyright (c) 2017-2021 The Merit Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "hash.h"
+#include "pog/select.h"
+#include "pog2/select.h"
+#include "pog3/select.h"
+#include "test/test_merit.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+    const int ENTRANTS = 40;
+
+    referral::Address TestAddress(int i)
+    {
+        CHashWriter hasher{SER_GETHASH, 0};
+        hasher << std::string{"address"} << i;
+        const auto hash = hasher.GetHash();
+        return referral::Address{std::vector<unsigned char>{hash.begin(), hash.begin() + 20}};
+    }
+
+    uint256 TestHash(int i)
+    {
+        CHashWriter hasher{SER_GETHASH, 0};
+        hasher << std::string{"sample"} << i;
+        return hasher.GetHash();
+    }
+
+    //Many entrants share a weight, so the order by address matters, and
+    //some have none.
+    CAmount TestWeight(int i)
+    {
+        return i % 7 == 0 ? 0 : ((i * 7919) % 11 + 1) * 1000;
+    }
+
+    int EntrantIndex(const referral::Address& address)
+    {
+        for (int i = 0; i < ENTRANTS; i++) {
+            if (TestAddress(i) == address) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    template <typename Entrants>
+    Entrants TestEntrants(int offset, CAmount scale)
+    {
+        Entrants entrants;
+        for (int i = 0; i < ENTRANTS; i++) {
+            typename Entrants::value_type entrant{};
+            entrant.address_type = 1;
+            entrant.address = TestAddress(i);
+            entrant.cgs = TestWeight(i + offset) * scale;
+            entrants.push_back(entrant);
+        }
+        return entrants;
+    }
+
+    template <typename Distribution>
+    void CheckCgsWinners(const Distribution& distribution, const std::vector<int>& winners)
+    {
+        for (size_t n = 0; n < winners.size(); n++) {
+            const auto winner = distribution.Sample(TestHash(n));
+            BOOST_REQUIRE(winner);
+            BOOST_CHECK_EQUAL(EntrantIndex(winner->address), winners[n]);
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(pog_select_tests, BasicTestingSetup)
+
+//The winners are the ones the distributions picked before they sampled
+//through indices, when they looked the winner up by address in a map.
+
+BOOST_AUTO_TEST_CASE(anv_distribution)
+{
+    referral::AddressANVs anvs;
+    for (int i = 0; i < ENTRANTS; i++) {
+        anvs.push_back({1, TestAddress(i), TestWeight(i)});
+    }
+
+    //Before 16000 entrants with the same ANV are in the order of the legacy sort.
+    const std::vector<int> legacy_winners{
+        12, 34, 3, 18, 24, 16, 8, 13, 34, 5, 18, 23, 24, 2, 13, 17,
+        1, 34, 37, 1, 37, 23, 24, 23, 24, 19, 13, 36, 16, 27, 4, 36,
+        17, 1, 34, 1, 6, 39, 18, 16, 33, 25, 30, 27, 3, 12, 26, 3,
+        20, 38, 6, 13, 2, 12, 5, 37, 23, 23, 15, 18, 13, 15, 27, 30};
+
+    const std::vector<int> winners{
+        23, 1, 36, 29, 24, 5, 19, 2, 1, 16, 29, 34, 24, 13, 2, 6,
+        12, 1, 4, 12, 4, 34, 24, 34, 24, 8, 2, 25, 5, 27, 37, 25,
+        6, 12, 1, 12, 17, 39, 29, 5, 33, 3, 30, 27, 36, 23, 26, 36,
+        9, 38, 17, 2, 13, 23, 16, 4, 34, 34, 15, 29, 2, 15, 27, 30};
+
+    for (const auto& test : {std::make_pair(15999, legacy_winners), std::make_pair(16000, winners)}) {
+        const pog::AnvDistribution distribution{test.first, anvs};
+        BOOST_CHECK_EQUAL(distribution.Size(), anvs.size());
+
+        for (size_t n = 0; n < test.second.size(); n++) {
+            const auto& winner = distribution.Sample(TestHash(n));
+            BOOST_CHECK_EQUAL(EntrantIndex(winner.address), test.second[n]);
+            BOOST_CHECK_EQUAL(winner.anv, TestWeight(EntrantIndex(winner.address)));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(pog2_cgs_distribution)
+{
+    const pog2::CgsDistribution distribution{TestEntrants<pog2::Entrants>(0, 1)};
+    BOOST_CHECK_EQUAL(distribution.Size(), static_cast<size_t>(ENTRANTS));
+
+    CheckCgsWinners(distribution, {
+        23, 1, 36, 29, 24, 5, 19, 2, 1, 16, 29, 34, 24, 13, 2, 6,
+        12, 1, 4, 12, 4, 34, 24, 34, 24, 8, 2, 25, 5, 27, 37, 25,
+        6, 12, 1, 12, 17, 39, 29, 5, 33, 3, 30, 27, 36, 23, 26, 36,
+        9, 38, 17, 2, 13, 23, 16, 4, 34, 34, 15, 29, 2, 15, 27, 30});
+
+    //Nothing to win when no entrant has any cgs.
+    auto entrants = TestEntrants<pog2::Entrants>(0, 0);
+    BOOST_CHECK(!pog2::CgsDistribution{entrants}.Sample(TestHash(0)));
+}
+
+BOOST_AUTO_TEST_CASE(pog3_cgs_distribution)
+{
+    const pog3::CgsDistribution distribution{TestEntrants<pog3::Entrants>(3, 3)};
+    BOOST_CHECK_EQUAL(distribution.Size(), static_cast<size_t>(ENTRANTS));
+
+    CheckCgsWinners(distribution, {
+        1, 12, 21, 21, 20, 26, 38, 2, 33, 23, 1, 1, 23, 22, 15, 22,
+        35, 9, 38, 33, 9, 14, 33, 26, 0, 12, 22, 26, 12, 3, 38, 10,
+        26, 22, 10, 21, 0, 15, 28, 9, 21, 22, 12, 34, 2, 20, 33, 24,
+        12, 31, 27, 15, 7, 21, 31, 20, 24, 28, 21, 34, 33, 36, 23, 9});
+
+    auto entrants = TestEntrants<pog3::Entrants>(3, 0);
+    BOOST_CHECK(!pog3::CgsDistribution{entrants}.Sample(TestHash(0)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
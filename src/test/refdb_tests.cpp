@@ -0,0 +1,916 @@
+// Copyright (c) 2017-2021 The Merit Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "hash.h"
+#include "key.h"
+#include "pog/wrs.h"
+#include "refdb.h"
+#include "test/test_merit.h"
+#include "util.h"
+
+#include <map>
+#include <memory>
+#include <set>
+
+#include <boost/multiprecision/cpp_int.hpp>
+#include <boost/rational.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace referral;
+
+namespace
+{
+    using int128_t = boost::multiprecision::int128_t;
+    using AnvRat = boost::rational<int128_t>;
+    using Anvs = std::map<Address, AnvRat>;
+    using Parents = std::map<Address, Address>;
+
+    const char DB_ANV = 'a';
+    const char DB_LOT_SIZE = 's';
+    const char DB_LOT_VAL = 'v';
+    const char DB_LOT_INV = 'L';
+    const char DB_CONFIRMATION = 'i';
+    const char DB_CONFIRMATION_IDX = 'n';
+    const char DB_CONFIRMATION_TOTAL = 'u';
+    const char DB_CHILDREN = 'c';
+    const char DB_CHILD = 'C';
+    const char DB_CHILD_SEQ = 'q';
+    const char DB_NEXT_CHILD_SEQ = 'Q';
+    const char DB_PARENT_ADDRESS = 'p';
+
+    /** A key or value as the bytes it is stored as. */
+    struct RawBytes
+    {
+        std::vector<unsigned char> bytes;
+
+        template<typename Stream>
+        void Serialize(Stream& s) const
+        {
+            s.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        }
+
+        template<typename Stream>
+        void Unserialize(Stream& s)
+        {
+            bytes.resize(s.size());
+            s.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+        }
+    };
+
+    using Rows = std::map<std::vector<unsigned char>, std::vector<unsigned char>>;
+
+    /** Reads the rows of a DB with keys starting with one of the prefixes. */
+    Rows ReadRows(CDBWrapper& db, const std::string& prefixes)
+    {
+        Rows rows;
+        std::unique_ptr<CDBIterator> iter{db.NewIterator()};
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            RawBytes key;
+            RawBytes value;
+            BOOST_REQUIRE(iter->GetKey(key));
+            if (key.bytes.empty() || prefixes.find(key.bytes[0]) == std::string::npos) {
+                continue;
+            }
+            BOOST_REQUIRE(iter->GetValue(value));
+            rows[key.bytes] = value.bytes;
+        }
+        return rows;
+    }
+
+    /**
+     * Gives access to the rows of the referral DBs, to check them against
+     * what the code kept in them before.
+     */
+    class TestReferralsViewDB : public ReferralsViewDB
+    {
+    public:
+        TestReferralsViewDB(const std::string& name, bool wipe) :
+            ReferralsViewDB{1 << 20, false, wipe, name} {}
+
+        Anvs ReadAnvs() const
+        {
+            Anvs anvs;
+            std::unique_ptr<CDBIterator> iter{m_anv_db.NewIterator()};
+            auto key = std::make_pair(DB_ANV, Address{});
+            for (iter->Seek(key); iter->Valid() && iter->GetKey(key) && key.first == DB_ANV; iter->Next()) {
+                std::tuple<char, Address, std::pair<int128_t, int128_t>> anv;
+                BOOST_REQUIRE(iter->GetValue(anv));
+                BOOST_CHECK(std::get<1>(anv) == key.second);
+                anvs[key.second] = AnvRat{std::get<2>(anv).first, std::get<2>(anv).second};
+            }
+            return anvs;
+        }
+
+        Rows ReadReferralRows(const std::string& prefixes) const
+        {
+            return ReadRows(m_db, prefixes);
+        }
+
+        /**
+         * Rewrites the children the way they were kept before, one
+         * DB_CHILDREN vector per parent in the order they were added.
+         */
+        void DowngradeChildren()
+        {
+            std::map<Address, ChildAddresses> children;
+            CDBBatch batch(m_db);
+            for (const auto& row : ReadRows(m_db, {DB_CHILD, DB_CHILD_SEQ, DB_NEXT_CHILD_SEQ})) {
+                if (row.first[0] == DB_CHILD) {
+                    const Address parent{std::vector<unsigned char>{row.first.begin() + 1, row.first.begin() + 21}};
+                    children[parent].emplace_back(row.second);
+                }
+                batch.Erase(RawBytes{row.first});
+            }
+
+            for (const auto& c : children) {
+                batch.Write(std::make_pair(DB_CHILDREN, c.first), c.second);
+            }
+            BOOST_REQUIRE(m_db.WriteBatch(batch));
+        }
+
+        /**
+         * The addresses of the parent table, loading it if it isn't loaded
+         * yet. Checks that every node points at an existing parent node and
+         * has a parent or children.
+         */
+        std::set<Address> ParentNodes() const
+        {
+            LOCK(m_cs_parents);
+            BOOST_REQUIRE(LoadParents());
+
+            std::map<Address, uint32_t> children;
+            for (const auto& node : m_parents.nodes) {
+                if (node.second.parent) {
+                    BOOST_CHECK(m_parents.nodes.count(*node.second.parent));
+                    children[*node.second.parent]++;
+                }
+            }
+
+            std::set<Address> addresses;
+            for (const auto& node : m_parents.nodes) {
+                BOOST_CHECK(node.second.parent || node.second.children > 0);
+                BOOST_CHECK_EQUAL(node.second.children, children[node.first]);
+                addresses.insert(node.first);
+            }
+            return addresses;
+        }
+
+        /** The addresses in the DB_PARENT_ADDRESS rows, as children or parents. */
+        std::set<Address> DbParentRowAddresses() const
+        {
+            std::set<Address> addresses;
+            std::unique_ptr<CDBIterator> iter{m_db.NewIterator()};
+            auto key = std::make_pair(DB_PARENT_ADDRESS, Address{});
+            for (iter->Seek(key); iter->Valid() && iter->GetKey(key) && key.first == DB_PARENT_ADDRESS; iter->Next()) {
+                referral::AddressPair parent;
+                BOOST_REQUIRE(iter->GetValue(parent));
+                addresses.insert(key.second);
+                addresses.insert(parent.second);
+            }
+            return addresses;
+        }
+
+        //The parent lookup from before the parents were kept in memory.
+        MaybeAddressPair DbParentAddress(const Address& address) const
+        {
+            referral::AddressPair parent;
+            return m_db.Read(std::make_pair(DB_PARENT_ADDRESS, address), parent) ?
+                MaybeAddressPair{parent} : MaybeAddressPair{};
+        }
+
+        Rows ReadLotteryRows() const
+        {
+            return ReadRows(m_lottery_db, {DB_LOT_SIZE, DB_LOT_VAL, DB_LOT_INV});
+        }
+
+        //The invite lottery confirmation lookups from before they were kept
+        //in memory, which read the rows every time.
+        uint64_t DbTotalConfirmations() const
+        {
+            uint64_t total = 0;
+            m_lottery_db.Read(DB_CONFIRMATION_TOTAL, total);
+            return total;
+        }
+
+        MaybeConfirmedAddress DbConfirmation(uint64_t idx) const
+        {
+            std::pair<char, Address> val;
+            if (!m_lottery_db.Read(std::make_pair(DB_CONFIRMATION_IDX, idx), val)) {
+                return MaybeConfirmedAddress{};
+            }
+            return DbConfirmation(val.first, val.second);
+        }
+
+        MaybeConfirmedAddress DbConfirmation(char address_type, const Address& address) const
+        {
+            std::pair<uint64_t, int> confirmation{0, 0};
+            if (!m_lottery_db.Read(std::make_pair(DB_CONFIRMATION, address), confirmation)) {
+                return MaybeConfirmedAddress{};
+            }
+            return MaybeConfirmedAddress{{address_type, address, confirmation.second}};
+        }
+
+        bool DbIsConfirmed(const Address& address) const
+        {
+            const auto confirmation = DbConfirmation(1, address);
+            return confirmation && confirmation->invites > 0;
+        }
+    };
+
+    /**
+     * The pog1 lottery reservoir the way it was kept before it was loaded
+     * in memory, reading and writing the DB for every step of the heap. The
+     * ANVs and parents come from a referral DB.
+     */
+    class DbLottery
+    {
+    public:
+        DbLottery() : m_db{GetDataDir() / "refdb_tests_db_lottery", 1 << 20, true, true} {}
+
+        bool Add(
+                const ReferralsViewDB& refs,
+                int height,
+                uint256 rand_value,
+                char address_type,
+                MaybeAddress address,
+                uint64_t max_reservoir_size,
+                LotteryUndos& undos)
+        {
+            auto maybe_anv = refs.GetANV(*address);
+            if (!maybe_anv) return false;
+
+            if (address_type != 1 && address_type != 2) {
+                return true;
+            }
+
+            while (address) {
+                if (height >= 16000) {
+                    maybe_anv = refs.GetANV(*address);
+                    if (!maybe_anv) return false;
+
+                    CHashWriter hasher{SER_DISK, CLIENT_VERSION};
+                    hasher << rand_value << *address;
+                    rand_value = hasher.GetHash();
+                }
+
+                const auto weighted_key = pog::WeightedKeyForSampling(rand_value, maybe_anv->anv);
+                const auto heap_size = Size();
+
+                if (heap_size < max_reservoir_size) {
+                    uint64_t pos;
+                    if (!FindPos(*address, pos)) return false;
+
+                    if (pos == heap_size) {
+                        if (!Insert(LotteryEntrant{weighted_key, address_type, *address})) return false;
+                        undos.push_back(LotteryUndo{weighted_key, address_type, *address, *address});
+                    }
+                } else {
+                    LotteryEntrant min;
+                    if (!m_db.Read(std::make_pair(DB_LOT_VAL, uint64_t{0}), min)) return false;
+
+                    if (std::get<0>(min) < weighted_key) {
+                        uint64_t pos;
+                        if (!FindPos(*address, pos)) return false;
+
+                        if (pos == heap_size) {
+                            if (!Remove(0)) return false;
+                            if (!Insert(LotteryEntrant{weighted_key, address_type, *address})) return false;
+                            undos.push_back(LotteryUndo{std::get<0>(min), std::get<1>(min), std::get<2>(min), *address});
+                        }
+                    }
+                }
+
+                MaybeAddressPair parent;
+                if (!refs.GetParentAddress(*address, parent)) return false;
+                if (parent) {
+                    address_type = parent->first;
+                    address = parent->second;
+                } else {
+                    address.reset();
+                }
+            }
+
+            return true;
+        }
+
+        bool Undo(const LotteryUndo& undo)
+        {
+            uint64_t pos;
+            if (!FindPos(undo.replaced_with, pos) || !Remove(pos)) {
+                return false;
+            }
+
+            if (undo.replaced_with == undo.replaced_address) {
+                return true;
+            }
+
+            return Insert(LotteryEntrant{undo.replaced_key, undo.replaced_address_type, undo.replaced_address});
+        }
+
+        Rows ReadRows()
+        {
+            return ::ReadRows(m_db, {DB_LOT_SIZE, DB_LOT_VAL, DB_LOT_INV});
+        }
+
+    private:
+        CDBWrapper m_db;
+
+        uint64_t Size() const
+        {
+            uint64_t size = 0;
+            m_db.Read(DB_LOT_SIZE, size);
+            return size;
+        }
+
+        bool FindPos(const Address& address, uint64_t& pos)
+        {
+            if (m_db.Read(std::make_pair(DB_LOT_INV, address), pos)) {
+                return true;
+            }
+
+            const auto heap_size = Size();
+            for (uint64_t i = 0; i < heap_size; i++) {
+                LotteryEntrant v;
+                if (!m_db.Read(std::make_pair(DB_LOT_VAL, i), v)) return false;
+
+                if (std::get<2>(v) == address) {
+                    pos = i;
+                    return m_db.Write(std::make_pair(DB_LOT_INV, address), pos);
+                }
+            }
+
+            pos = heap_size;
+            return true;
+        }
+
+        bool Insert(const LotteryEntrant& entrant)
+        {
+            const auto heap_size = Size();
+            auto pos = heap_size;
+            while (pos != 0) {
+                const auto parent_pos = (pos - 1) / 2;
+
+                LotteryEntrant parent;
+                if (!m_db.Read(std::make_pair(DB_LOT_VAL, parent_pos), parent)) return false;
+                if (std::get<0>(parent) < std::get<0>(entrant)) {
+                    break;
+                }
+
+                if (!m_db.Write(std::make_pair(DB_LOT_VAL, pos), parent)) return false;
+                if (!m_db.Write(std::make_pair(DB_LOT_INV, std::get<2>(parent)), pos)) return false;
+                pos = parent_pos;
+            }
+
+            return m_db.Write(std::make_pair(DB_LOT_VAL, pos), entrant) &&
+                m_db.Write(std::make_pair(DB_LOT_INV, std::get<2>(entrant)), pos) &&
+                m_db.Write(DB_LOT_SIZE, heap_size + 1);
+        }
+
+        //Like before, the last entrant is compared against the entrants that
+        //moved up rather than against itself on the way down.
+        bool Remove(uint64_t current)
+        {
+            const auto heap_size = Size();
+            if (heap_size == 0) return false;
+
+            LotteryEntrant last;
+            LotteryEntrant current_val;
+            if (!m_db.Read(std::make_pair(DB_LOT_VAL, heap_size - 1), last) ||
+                    !m_db.Read(std::make_pair(DB_LOT_VAL, current), current_val) ||
+                    !m_db.Erase(std::make_pair(DB_LOT_INV, std::get<2>(current_val)))) {
+                return false;
+            }
+
+            LotteryEntrant smallest_val = last;
+            while (true) {
+                uint64_t smallest = current;
+                for (const uint64_t child : {2 * current + 1, 2 * current + 2}) {
+                    LotteryEntrant child_val;
+                    if (child >= heap_size) {
+                        continue;
+                    }
+                    if (!m_db.Read(std::make_pair(DB_LOT_VAL, child), child_val)) return false;
+                    if (std::get<0>(child_val) < std::get<0>(smallest_val)) {
+                        smallest = child;
+                        smallest_val = child_val;
+                    }
+                }
+
+                if (smallest == current) {
+                    break;
+                }
+
+                if (!m_db.Write(std::make_pair(DB_LOT_VAL, current), smallest_val)) return false;
+                if (!m_db.Write(std::make_pair(DB_LOT_INV, std::get<2>(smallest_val)), current)) return false;
+                current = smallest;
+            }
+
+            return m_db.Write(std::make_pair(DB_LOT_VAL, current), last) &&
+                m_db.Write(std::make_pair(DB_LOT_INV, std::get<2>(last)), current) &&
+                m_db.Write(DB_LOT_SIZE, heap_size - 1);
+        }
+    };
+
+    /**
+     * Inserts a random tree of key addresses with a few roots. Each address
+     * gets a parent inserted before it.
+     */
+    Addresses InsertTree(ReferralsViewDB& db, size_t size, size_t roots, Parents& parents)
+    {
+        Addresses addresses;
+        for (size_t i = 0; i < size; i++) {
+            CKey key;
+            key.MakeNewKey(true);
+            const auto pubkey = key.GetPubKey();
+
+            Address parent;
+            if (i >= roots) {
+                parent = addresses[InsecureRandRange(addresses.size())];
+                parents[pubkey.GetID()] = parent;
+            }
+
+            const Referral referral{MutableReferral{1, pubkey.GetID(), pubkey, parent}};
+            BOOST_REQUIRE(db.InsertReferral(0, referral, i < roots, false));
+            addresses.push_back(referral.GetAddress());
+        }
+        return addresses;
+    }
+
+    //What UpdateANV did for each change before the changes of a block were
+    //batched: add the change to the address and half of it to its parent,
+    //a quarter to the grandparent and so on.
+    void ApplyAnvChanges(const ANVChanges& changes, const Parents& parents, Anvs& anvs)
+    {
+        for (const auto& c : changes) {
+            AnvRat change = int128_t{std::get<2>(c)};
+            auto address = std::get<1>(c);
+            while (change != 0) {
+                anvs[address] += change;
+                BOOST_REQUIRE(anvs[address] >= 0);
+
+                const auto parent = parents.find(address);
+                if (parent == parents.end()) {
+                    break;
+                }
+                address = parent->second;
+                change /= 2;
+            }
+        }
+    }
+
+    ANVChanges RandomAnvChanges(const Addresses& addresses, size_t size)
+    {
+        ANVChanges changes;
+        for (size_t i = 0; i < size; i++) {
+            //Some changes are zero and some addresses change more than once.
+            const CAmount change = InsecureRandBool() ? 0 : InsecureRandRange(COIN);
+            changes.emplace_back(1, addresses[InsecureRandRange(addresses.size())], change);
+        }
+        return changes;
+    }
+
+    bool SameConfirmation(const MaybeConfirmedAddress& a, const MaybeConfirmedAddress& b)
+    {
+        if (!a || !b) {
+            return !a && !b;
+        }
+        return a->address_type == b->address_type &&
+            a->address == b->address &&
+            a->invites == b->invites;
+    }
+
+    /**
+     * Checks the in-memory confirmations of the DB against the lookups that
+     * read its rows.
+     */
+    void CheckConfirmations(const TestReferralsViewDB& db, const Addresses& addresses)
+    {
+        const auto total = db.GetTotalConfirmations();
+        BOOST_CHECK_EQUAL(total, db.DbTotalConfirmations());
+
+        for (uint64_t idx = 0; idx < total + 2; idx++) {
+            BOOST_CHECK(SameConfirmation(db.GetConfirmation(idx), db.DbConfirmation(idx)));
+        }
+
+        for (size_t i = 0; i < addresses.size(); i++) {
+            const char address_type = 1 + i % 2;
+            BOOST_CHECK(SameConfirmation(
+                        db.GetConfirmation(address_type, addresses[i]),
+                        db.DbConfirmation(address_type, addresses[i])));
+            BOOST_CHECK_EQUAL(db.IsConfirmed(addresses[i]), db.DbIsConfirmed(addresses[i]));
+        }
+    }
+
+    using ChildrenMap = std::map<Address, ChildAddresses>;
+
+    Address InsertChild(ReferralsViewDB& db, const Address& parent, ChildrenMap& children)
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        const auto pubkey = key.GetPubKey();
+
+        const Referral referral{MutableReferral{1, pubkey.GetID(), pubkey, parent}};
+        BOOST_REQUIRE(db.InsertReferral(0, referral, false, false));
+        children[parent].push_back(referral.GetAddress());
+        return referral.GetAddress();
+    }
+
+    /**
+     * Checks the children of every parent and that each child has one
+     * DB_CHILD row, keyed by its parent and its sequence number written big
+     * endian, and a DB_CHILD_SEQ row with the same number.
+     */
+    void CheckChildren(const TestReferralsViewDB& db, const ChildrenMap& children)
+    {
+        size_t total = 0;
+        for (const auto& c : children) {
+            BOOST_CHECK(db.GetChildren(c.first) == c.second);
+            total += c.second.size();
+        }
+
+        const auto rows = db.ReadReferralRows({DB_CHILDREN, DB_CHILD, DB_CHILD_SEQ});
+        BOOST_CHECK_EQUAL(rows.size(), 2 * total);
+        for (const auto& row : rows) {
+            if (row.first[0] != DB_CHILD) {
+                continue;
+            }
+
+            BOOST_REQUIRE_EQUAL(row.first.size(), 1U + 20 + 4);
+            std::vector<unsigned char> seq_key{DB_CHILD_SEQ};
+            seq_key.insert(seq_key.end(), row.second.begin(), row.second.end());
+
+            const auto seq = rows.find(seq_key);
+            BOOST_REQUIRE(seq != rows.end());
+            BOOST_REQUIRE_EQUAL(seq->second.size(), 4U);
+            BOOST_CHECK(std::equal(row.first.rbegin(), row.first.rbegin() + 4, seq->second.begin()));
+        }
+    }
+
+    void CheckParents(const TestReferralsViewDB& db, const Addresses& addresses)
+    {
+        for (const auto& address : addresses) {
+            MaybeAddressPair parent;
+            BOOST_REQUIRE(db.GetParentAddress(address, parent));
+            const auto expected = db.DbParentAddress(address);
+            BOOST_CHECK_EQUAL(bool{parent}, bool{expected});
+            if (parent && expected) {
+                BOOST_CHECK(*parent == *expected);
+            }
+        }
+    }
+
+    ANVChanges UndoAnvChanges(const ANVChanges& changes)
+    {
+        ANVChanges undo;
+        for (auto c = changes.rbegin(); c != changes.rend(); c++) {
+            undo.emplace_back(std::get<0>(*c), std::get<1>(*c), -std::get<2>(*c));
+        }
+        return undo;
+    }
+
+    /** The referral DBs are under the data directory, so give them one of their own. */
+    struct RefDBTestingSetup : public BasicTestingSetup
+    {
+        fs::path path;
+
+        RefDBTestingSetup() : path{fs::temp_directory_path() / fs::unique_path()}
+        {
+            fs::create_directories(path);
+            ClearDatadirCache();
+            gArgs.ForceSetArg("-datadir", path.string());
+        }
+
+        ~RefDBTestingSetup()
+        {
+            ClearDatadirCache();
+            fs::remove_all(path);
+        }
+    };
+}
+
+BOOST_FIXTURE_TEST_SUITE(refdb_tests, RefDBTestingSetup)
+
+BOOST_AUTO_TEST_CASE(update_anvs)
+{
+    TestReferralsViewDB batched{"refdb_tests_batched", true};
+    TestReferralsViewDB single{"refdb_tests_single", true};
+
+    //Both DBs get the same tree.
+    Parents parents;
+    const auto addresses = InsertTree(batched, 40, 3, parents);
+    for (const auto& address : addresses) {
+        const auto referral = batched.GetReferral(address);
+        BOOST_REQUIRE(referral);
+        BOOST_REQUIRE(single.InsertReferral(0, *referral, parents.count(address) == 0, false));
+    }
+
+    Anvs expected;
+    for (const auto& address : addresses) {
+        expected[address] = 0;
+    }
+    BOOST_CHECK(batched.ReadAnvs() == expected);
+
+    std::vector<ANVChanges> blocks;
+    for (size_t b = 0; b < 5; b++) {
+        blocks.push_back(RandomAnvChanges(addresses, 1 + InsecureRandRange(60)));
+        const auto& changes = blocks.back();
+
+        ApplyAnvChanges(changes, parents, expected);
+        BOOST_CHECK(batched.UpdateANVs(changes));
+        for (const auto& c : changes) {
+            BOOST_CHECK(single.UpdateANV(std::get<0>(c), std::get<1>(c), std::get<2>(c)));
+        }
+
+        //The sums are exact, so the rows are the same as well.
+        BOOST_CHECK(batched.ReadAnvs() == expected);
+        BOOST_CHECK(single.ReadAnvs() == expected);
+    }
+
+    //Undo the blocks the way DisconnectBlock does, last block first.
+    for (auto b = blocks.rbegin(); b != blocks.rend(); b++) {
+        const auto undo = UndoAnvChanges(*b);
+
+        ApplyAnvChanges(undo, parents, expected);
+        BOOST_CHECK(batched.UpdateANVs(undo));
+        for (const auto& c : undo) {
+            BOOST_CHECK(single.UpdateANV(std::get<0>(c), std::get<1>(c), std::get<2>(c)));
+        }
+
+        BOOST_CHECK(batched.ReadAnvs() == expected);
+        BOOST_CHECK(single.ReadAnvs() == expected);
+    }
+
+    for (const auto& anv : expected) {
+        BOOST_CHECK(anv.second == 0);
+    }
+
+    //A change for an address that is not in the DB fails.
+    BOOST_CHECK(!batched.UpdateANVs({ANVChange{1, Address{}, COIN}}));
+}
+
+BOOST_AUTO_TEST_CASE(lottery)
+{
+    const uint64_t max_reservoir_size = 8;
+
+    std::unique_ptr<TestReferralsViewDB> db{new TestReferralsViewDB{"refdb_tests", true}};
+    DbLottery expected;
+
+    Parents parents;
+    const auto addresses = InsertTree(*db, 30, 2, parents);
+    BOOST_REQUIRE(db->UpdateANVs(RandomAnvChanges(addresses, 60)));
+
+    //Blocks add a few beacons each, around the height the sampling changed.
+    //Some get disconnected again, which leaves stale rows behind, and the
+    //lottery is reloaded from the DB now and then.
+    std::vector<LotteryUndos> blocks;
+    for (int height = 15980; height < 16040; height++) {
+        if (!blocks.empty() && InsecureRandRange(4) == 0) {
+            const auto undos = blocks.back();
+            blocks.pop_back();
+
+            for (auto u = undos.rbegin(); u != undos.rend(); u++) {
+                BOOST_CHECK(db->UndoLotteryEntrant(*u, max_reservoir_size));
+                BOOST_CHECK(expected.Undo(*u));
+            }
+        } else {
+            const auto rand_value = InsecureRand256();
+            LotteryUndos undos;
+            LotteryUndos expected_undos;
+            for (size_t i = InsecureRandRange(4); i > 0; i--) {
+                const auto address = addresses[InsecureRandRange(addresses.size())];
+                BOOST_CHECK(db->AddAddressToLottery(height, rand_value, 1, address, max_reservoir_size, undos));
+                BOOST_CHECK(expected.Add(*db, height, rand_value, 1, address, max_reservoir_size, expected_undos));
+            }
+
+            BOOST_REQUIRE_EQUAL(undos.size(), expected_undos.size());
+            for (size_t i = 0; i < undos.size(); i++) {
+                BOOST_CHECK(undos[i].replaced_key == expected_undos[i].replaced_key);
+                BOOST_CHECK(undos[i].replaced_address == expected_undos[i].replaced_address);
+                BOOST_CHECK(undos[i].replaced_with == expected_undos[i].replaced_with);
+            }
+            blocks.push_back(undos);
+        }
+
+        BOOST_CHECK(db->FlushLottery());
+        BOOST_CHECK(db->ReadLotteryRows() == expected.ReadRows());
+
+        if (InsecureRandRange(5) == 0) {
+            AddressANVs entrants;
+            db->GetAllRewardableANVs(Params().GetConsensus(), height, entrants);
+
+            db.reset();
+            db.reset(new TestReferralsViewDB{"refdb_tests", false});
+
+            AddressANVs reloaded;
+            db->GetAllRewardableANVs(Params().GetConsensus(), height, reloaded);
+            BOOST_REQUIRE_EQUAL(entrants.size(), reloaded.size());
+            for (size_t i = 0; i < entrants.size(); i++) {
+                BOOST_CHECK(entrants[i].address == reloaded[i].address);
+            }
+        }
+    }
+
+    //Undo everything left, the reservoir ends up empty.
+    for (auto b = blocks.rbegin(); b != blocks.rend(); b++) {
+        for (auto u = b->rbegin(); u != b->rend(); u++) {
+            BOOST_CHECK(db->UndoLotteryEntrant(*u, max_reservoir_size));
+            BOOST_CHECK(expected.Undo(*u));
+        }
+    }
+    BOOST_CHECK(db->FlushLottery());
+    BOOST_CHECK(db->ReadLotteryRows() == expected.ReadRows());
+
+    AddressANVs entrants;
+    db->GetAllRewardableANVs(Params().GetConsensus(), 16040, entrants);
+    BOOST_CHECK(entrants.empty());
+}
+
+BOOST_AUTO_TEST_CASE(confirmations)
+{
+    std::unique_ptr<TestReferralsViewDB> db{new TestReferralsViewDB{"refdb_tests", true}};
+
+    Addresses addresses;
+    for (size_t i = 0; i < 12; i++) {
+        const auto r = InsecureRand256();
+        addresses.emplace_back(std::vector<unsigned char>{r.begin(), r.begin() + 20});
+    }
+
+    const auto update = [&db](size_t i, const Address& address, CAmount amount) {
+        CAmount updated_amount = -1;
+        const bool updated = db->UpdateConfirmation(1 + i % 2, address, amount, updated_amount);
+        return updated ? updated_amount : -1;
+    };
+
+    //Confirm three addresses, unconfirm the last and confirm it again.
+    BOOST_CHECK_EQUAL(update(0, addresses[0], 1), 1);
+    BOOST_CHECK_EQUAL(update(1, addresses[1], 1), 1);
+    BOOST_CHECK_EQUAL(update(2, addresses[2], 2), 2);
+    CheckConfirmations(*db, addresses);
+
+    BOOST_CHECK_EQUAL(update(2, addresses[2], -2), 0);
+    BOOST_CHECK_EQUAL(db->GetTotalConfirmations(), 2U);
+    BOOST_CHECK(!db->GetConfirmation(2));
+    BOOST_CHECK(!db->GetConfirmation(2, addresses[2]));
+    CheckConfirmations(*db, addresses);
+
+    BOOST_CHECK_EQUAL(update(2, addresses[2], 1), 1);
+    BOOST_CHECK_EQUAL(db->GetTotalConfirmations(), 3U);
+    BOOST_CHECK(db->GetConfirmation(2)->address == addresses[2]);
+    CheckConfirmations(*db, addresses);
+
+    //An address that is not the last one keeps its index without invites.
+    BOOST_CHECK_EQUAL(update(1, addresses[1], -1), 0);
+    BOOST_CHECK_EQUAL(db->GetTotalConfirmations(), 3U);
+    BOOST_CHECK(!db->IsConfirmed(addresses[1]));
+    BOOST_CHECK_EQUAL(db->GetConfirmation(1)->invites, 0);
+    CheckConfirmations(*db, addresses);
+
+    BOOST_CHECK_EQUAL(update(1, addresses[1], 1), 1);
+    BOOST_CHECK(db->IsConfirmed(addresses[1]));
+    CheckConfirmations(*db, addresses);
+
+    //Invites can't go below zero.
+    BOOST_CHECK_EQUAL(update(0, addresses[0], -2), -1);
+    CheckConfirmations(*db, addresses);
+
+    //Random changes, reloading from the DB now and then.
+    for (size_t n = 0; n < 300; n++) {
+        const size_t i = InsecureRandRange(addresses.size());
+        const auto confirmation = db->GetConfirmation(1 + i % 2, addresses[i]);
+        if (!confirmation) {
+            BOOST_CHECK_EQUAL(update(i, addresses[i], 1), 1);
+        } else {
+            const int invites = confirmation->invites;
+            switch (InsecureRandRange(4)) {
+                case 0:
+                    BOOST_CHECK_EQUAL(update(i, addresses[i], 1), invites + 1);
+                    break;
+                case 1:
+                    BOOST_CHECK_EQUAL(update(i, addresses[i], -1), invites > 0 ? invites - 1 : -1);
+                    break;
+                case 2:
+                    BOOST_CHECK_EQUAL(update(i, addresses[i], -invites), 0);
+                    break;
+                default:
+                    BOOST_CHECK_EQUAL(update(i, addresses[i], -invites - 1), -1);
+            }
+        }
+        CheckConfirmations(*db, addresses);
+
+        if (InsecureRandRange(50) == 0) {
+            db.reset();
+            db.reset(new TestReferralsViewDB{"refdb_tests", false});
+            CheckConfirmations(*db, addresses);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(children)
+{
+    std::unique_ptr<TestReferralsViewDB> db{new TestReferralsViewDB{"refdb_tests", true}};
+
+    Parents parents;
+    const auto addresses = InsertTree(*db, 30, 2, parents);
+
+    ChildrenMap children;
+    for (const auto& address : addresses) {
+        const auto parent = parents.find(address);
+        if (parent != parents.end()) {
+            children[parent->second].push_back(address);
+        }
+    }
+
+    //More than 256 children, so the order depends on the byte order of the
+    //sequence numbers.
+    const auto& wide = addresses[0];
+    for (size_t i = 0; i < 300; i++) {
+        InsertChild(*db, wide, children);
+    }
+    CheckChildren(*db, children);
+
+    //A DB with the children of a parent in one row is upgraded to one row
+    //per child in the same order.
+    db->DowngradeChildren();
+    BOOST_CHECK_EQUAL(db->ReadReferralRows({DB_CHILD, DB_CHILD_SEQ, DB_NEXT_CHILD_SEQ}).size(), 0U);
+    BOOST_CHECK_EQUAL(db->ReadReferralRows({DB_CHILDREN}).size(), children.size());
+    BOOST_CHECK(db->Upgrade());
+    CheckChildren(*db, children);
+    BOOST_CHECK(db->Upgrade());
+    CheckChildren(*db, children);
+
+    //Children removed from the middle leave the others in order, and
+    //children added after them go last.
+    for (size_t n = 0; n < 40; n++) {
+        auto& wide_children = children[wide];
+        const auto child = wide_children.begin() + InsecureRandRange(wide_children.size());
+        const auto referral = db->GetReferral(*child);
+        BOOST_REQUIRE(referral);
+        BOOST_CHECK(db->RemoveReferral(*referral));
+        wide_children.erase(child);
+
+        if (InsecureRandBool()) {
+            InsertChild(*db, wide, children);
+        }
+    }
+    InsertChild(*db, addresses[1], children);
+    CheckChildren(*db, children);
+
+    db.reset();
+    db.reset(new TestReferralsViewDB{"refdb_tests", false});
+    CheckChildren(*db, children);
+}
+
+BOOST_AUTO_TEST_CASE(parents)
+{
+    std::unique_ptr<TestReferralsViewDB> db{new TestReferralsViewDB{"refdb_tests", true}};
+
+    Parents parents;
+    auto addresses = InsertTree(*db, 40, 2, parents);
+    CheckParents(*db, addresses);
+    BOOST_CHECK(db->ParentNodes() == db->DbParentRowAddresses());
+
+    //Removed beacons leave the table once nothing points at them, so the
+    //table holds the same addresses as the rows as beacons come and go.
+    Addresses removed;
+    ChildrenMap children;
+    for (size_t n = 0; n < 60; n++) {
+        if (InsecureRandBool()) {
+            const auto parent = addresses[InsecureRandRange(addresses.size())];
+            addresses.push_back(InsertChild(*db, parent, children));
+        } else {
+            const auto referral = db->GetReferral(addresses.back());
+            BOOST_REQUIRE(referral);
+            BOOST_CHECK(db->RemoveReferral(*referral));
+            removed.push_back(addresses.back());
+            addresses.pop_back();
+        }
+
+        BOOST_CHECK(db->ParentNodes() == db->DbParentRowAddresses());
+        CheckParents(*db, addresses);
+        CheckParents(*db, removed);
+    }
+
+    //Removing everything but the roots empties the table.
+    while (addresses.size() > 2) {
+        const auto referral = db->GetReferral(addresses.back());
+        BOOST_REQUIRE(referral);
+        BOOST_CHECK(db->RemoveReferral(*referral));
+        addresses.pop_back();
+    }
+    BOOST_CHECK(db->ParentNodes().empty());
+    CheckParents(*db, addresses);
+
+    //A reload finds the same parents.
+    for (size_t n = 0; n < 40; n++) {
+        const auto parent = addresses[InsecureRandRange(addresses.size())];
+        addresses.push_back(InsertChild(*db, parent, children));
+    }
+    const auto nodes = db->ParentNodes();
+    db.reset();
+    db.reset(new TestReferralsViewDB{"refdb_tests", false});
+    CheckParents(*db, addresses);
+    BOOST_CHECK(db->ParentNodes() == nodes);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,297 @@
+// Copyright (c) 2017-2021 The Merit Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "hash.h"
+#include "key.h"
+#include "policy/policy.h"
+#include "primitives/referral.h"
+#include "script/sigcache.h"
+#include "test/test_merit.h"
+#include "util.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace referral;
+
+namespace
+{
+    /** Counts the signatures that were really verified. */
+    class CountingReferralSignatureChecker : public CachingReferralSignatureChecker
+    {
+    public:
+        mutable int verified = 0;
+
+        explicit CountingReferralSignatureChecker(bool store) :
+            CachingReferralSignatureChecker{store} {}
+
+    protected:
+        bool VerifySignature(const Referral& ref) const override
+        {
+            verified++;
+            return CachingReferralSignatureChecker::VerifySignature(ref);
+        }
+    };
+
+    MutableReferral MakeSignedReferral(const Address& parent)
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        const auto pubkey = key.GetPubKey();
+
+        MutableReferral ref{1, pubkey.GetID(), pubkey, parent};
+        const auto hash = (CHashWriter(SER_GETHASH, 0) << ref.parentAddress << ref.GetAddress()).GetHash();
+        BOOST_REQUIRE(key.Sign(hash, ref.signature));
+        return ref;
+    }
+
+    /** A chain with a root beacon that packages can build on. */
+    struct ReferralPackageSetup : public TestingSetup
+    {
+        Address root;
+
+        ReferralPackageSetup() : TestingSetup(CBaseChainParams::REGTEST)
+        {
+            const Referral root_ref{MakeSignedReferral(uint160{})};
+            BOOST_REQUIRE(prefviewdb->InsertReferral(0, root_ref, true, false));
+            root = root_ref.GetAddress();
+        }
+
+        ~ReferralPackageSetup()
+        {
+            mempoolReferral.Clear();
+        }
+    };
+
+    ReferralRef MakeRef(const MutableReferral& ref)
+    {
+        return MakeReferralRef(ref);
+    }
+
+    ReferralPackage MakePackage(const std::vector<ReferralRef>& refs)
+    {
+        ReferralPackage package;
+        for (const auto& ref : refs) {
+            package.emplace_back(ref);
+        }
+        return package;
+    }
+
+    void CheckOrder(const ReferralPackage& package, const std::vector<ReferralRef>& expected)
+    {
+        BOOST_REQUIRE_EQUAL(package.size(), expected.size());
+        for (size_t i = 0; i < package.size(); i++) {
+            BOOST_CHECK(package[i].ref->GetHash() == expected[i]->GetHash());
+        }
+    }
+
+    void CheckAccepted(const ReferralPackageEntry& e)
+    {
+        BOOST_CHECK(e.accepted);
+        BOOST_CHECK(!e.missing_referrer);
+        BOOST_CHECK(e.state.IsValid());
+        BOOST_CHECK(mempoolReferral.Exists(e.ref->GetHash()));
+    }
+
+    void CheckMissingReferrer(const ReferralPackageEntry& e)
+    {
+        BOOST_CHECK(!e.accepted);
+        BOOST_CHECK(e.missing_referrer);
+        BOOST_CHECK_EQUAL(e.state.GetRejectReason(), "ref-parent-not-beaconed");
+        BOOST_CHECK(!mempoolReferral.Exists(e.ref->GetHash()));
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(referral_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(signature_cache)
+{
+    const Referral ref{MakeSignedReferral(uint160{})};
+
+    //The first check verifies and stores the signature, the second is a hit.
+    CountingReferralSignatureChecker checker{true};
+    BOOST_CHECK(checker.CheckSignature(ref));
+    BOOST_CHECK_EQUAL(checker.verified, 1);
+    BOOST_CHECK(checker.CheckSignature(ref));
+    BOOST_CHECK_EQUAL(checker.verified, 1);
+    BOOST_CHECK(CheckReferralSignature(ref));
+
+    //A tampered signature has another hash so it misses and fails, and
+    //isn't stored.
+    MutableReferral tampered{ref};
+    tampered.signature.back() ^= 1;
+    const Referral bad{tampered};
+    BOOST_CHECK(!checker.CheckSignature(bad));
+    BOOST_CHECK_EQUAL(checker.verified, 2);
+    BOOST_CHECK(!checker.CheckSignature(bad));
+    BOOST_CHECK_EQUAL(checker.verified, 3);
+}
+
+BOOST_AUTO_TEST_CASE(signature_cache_erase)
+{
+    //The smallest cache has two slots so any new entry overwrites the
+    //entries that were marked for erasure.
+    gArgs.ForceSetArg("-maxsigcachesize", "0");
+    InitReferralSignatureCache();
+
+    const Referral ref{MakeSignedReferral(uint160{})};
+
+    CountingReferralSignatureChecker storing{true};
+    BOOST_CHECK(storing.CheckSignature(ref));
+    BOOST_CHECK_EQUAL(storing.verified, 1);
+
+    //Checking without storing is still a hit but erases the entry.
+    CountingReferralSignatureChecker erasing{false};
+    BOOST_CHECK(erasing.CheckSignature(ref));
+    BOOST_CHECK_EQUAL(erasing.verified, 0);
+
+    for (int i = 0; i < 8; i++) {
+        BOOST_CHECK(storing.CheckSignature(Referral{MakeSignedReferral(uint160{})}));
+    }
+    BOOST_CHECK_EQUAL(storing.verified, 9);
+
+    BOOST_CHECK(storing.CheckSignature(ref));
+    BOOST_CHECK_EQUAL(storing.verified, 10);
+
+    gArgs.ForceSetArg("-maxsigcachesize", std::to_string(DEFAULT_MAX_SIG_CACHE_SIZE));
+    InitReferralSignatureCache();
+}
+
+BOOST_FIXTURE_TEST_CASE(package_children_before_parents, ReferralPackageSetup)
+{
+    const auto parent = MakeRef(MakeSignedReferral(root));
+    const auto child1 = MakeRef(MakeSignedReferral(parent->GetAddress()));
+    const auto child2 = MakeRef(MakeSignedReferral(parent->GetAddress()));
+
+    auto package = MakePackage({child1, child2, parent});
+    BOOST_CHECK(AcceptReferralPackageToMemoryPool(mempoolReferral, package));
+
+    //Children keep their relative order after the parent.
+    CheckOrder(package, {parent, child1, child2});
+    for (const auto& e : package) {
+        CheckAccepted(e);
+    }
+    BOOST_CHECK_EQUAL(mempoolReferral.Size(), 3);
+}
+
+BOOST_FIXTURE_TEST_CASE(package_reversed_chain, ReferralPackageSetup)
+{
+    const auto parent = MakeRef(MakeSignedReferral(root));
+    const auto child = MakeRef(MakeSignedReferral(parent->GetAddress()));
+    const auto grandchild = MakeRef(MakeSignedReferral(child->GetAddress()));
+
+    auto package = MakePackage({grandchild, child, parent});
+    BOOST_CHECK(AcceptReferralPackageToMemoryPool(mempoolReferral, package));
+
+    CheckOrder(package, {parent, child, grandchild});
+    for (const auto& e : package) {
+        CheckAccepted(e);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(package_cycle, ReferralPackageSetup)
+{
+    //Two referrals can't beacon each other since both addresses would have
+    //to be signed for first, but a peer can still send such a package.
+    CKey key_a;
+    CKey key_b;
+    key_a.MakeNewKey(true);
+    key_b.MakeNewKey(true);
+    const auto pubkey_a = key_a.GetPubKey();
+    const auto pubkey_b = key_b.GetPubKey();
+
+    MutableReferral mut_a{1, pubkey_a.GetID(), pubkey_a, pubkey_b.GetID()};
+    MutableReferral mut_b{1, pubkey_b.GetID(), pubkey_b, pubkey_a.GetID()};
+    BOOST_REQUIRE(key_a.Sign((CHashWriter(SER_GETHASH, 0) << mut_a.parentAddress << mut_a.GetAddress()).GetHash(), mut_a.signature));
+    BOOST_REQUIRE(key_b.Sign((CHashWriter(SER_GETHASH, 0) << mut_b.parentAddress << mut_b.GetAddress()).GetHash(), mut_b.signature));
+    const auto a = MakeRef(mut_a);
+    const auto b = MakeRef(mut_b);
+
+    const auto beacon = MakeRef(MakeSignedReferral(root));
+    const auto orphan = MakeRef(MakeSignedReferral(uint160{ParseHex("0102030405060708090a0b0c0d0e0f1011121314")}));
+
+    auto package = MakePackage({a, beacon, b, orphan});
+    BOOST_CHECK(!AcceptReferralPackageToMemoryPool(mempoolReferral, package));
+
+    //Referrals whose parents aren't in the package come first in their
+    //order, the cycle is left at the end.
+    CheckOrder(package, {beacon, orphan, a, b});
+    CheckAccepted(package[0]);
+    CheckMissingReferrer(package[1]);
+    CheckMissingReferrer(package[2]);
+    CheckMissingReferrer(package[3]);
+    BOOST_CHECK_EQUAL(mempoolReferral.Size(), 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(package_skips_invalid_source, ReferralPackageSetup)
+{
+    const auto valid = MakeRef(MakeSignedReferral(root));
+    const auto after_invalid = MakeRef(MakeSignedReferral(root));
+    const auto other_source = MakeRef(MakeSignedReferral(root));
+
+    MutableReferral unsigned_ref = MakeSignedReferral(root);
+    unsigned_ref.signature.clear();
+    const auto invalid = MakeRef(unsigned_ref);
+
+    //Like orphans of two peers, the first sends an invalid referral.
+    ReferralPackage package;
+    package.emplace_back(valid, 1);
+    package.emplace_back(invalid, 1);
+    package.emplace_back(after_invalid, 1);
+    package.emplace_back(other_source, 2);
+    BOOST_CHECK(!AcceptReferralPackageToMemoryPool(mempoolReferral, package));
+
+    CheckOrder(package, {valid, invalid, after_invalid, other_source});
+    CheckAccepted(package[0]);
+
+    int nDoS = 0;
+    BOOST_CHECK(!package[1].accepted);
+    BOOST_CHECK(!package[1].skipped);
+    BOOST_CHECK(package[1].state.IsInvalid(nDoS));
+    BOOST_CHECK_EQUAL(nDoS, 100);
+    BOOST_CHECK_EQUAL(package[1].state.GetRejectReason(), "bad-ref-sig-empty");
+
+    //The rest of the first source is left unchecked.
+    BOOST_CHECK(package[2].skipped);
+    BOOST_CHECK(!package[2].accepted);
+    BOOST_CHECK(package[2].state.IsValid());
+    BOOST_CHECK(!mempoolReferral.Exists(after_invalid->GetHash()));
+
+    BOOST_CHECK(!package[3].skipped);
+    CheckAccepted(package[3]);
+    BOOST_CHECK_EQUAL(mempoolReferral.Size(), 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(package_mempool_full, ReferralPackageSetup)
+{
+    const auto parent = MakeRef(MakeSignedReferral(root));
+    const auto child = MakeRef(MakeSignedReferral(parent->GetAddress()));
+    const auto orphan = MakeRef(MakeSignedReferral(uint160{ParseHex("0102030405060708090a0b0c0d0e0f1011121314")}));
+
+    //Nothing fits in an empty mempool so everything accepted is trimmed.
+    gArgs.ForceSetArg("-maxrefmempool", "0");
+    auto package = MakePackage({child, orphan, parent});
+    BOOST_CHECK(!AcceptReferralPackageToMemoryPool(mempoolReferral, package));
+    gArgs.ForceSetArg("-maxrefmempool", std::to_string(DEFAULT_MAX_REFERRALS_MEMPOOL_SIZE));
+
+    CheckOrder(package, {orphan, parent, child});
+    CheckMissingReferrer(package[0]);
+    for (size_t i = 1; i < package.size(); i++) {
+        const auto& e = package[i];
+        BOOST_CHECK(!e.accepted);
+        BOOST_CHECK(!e.missing_referrer);
+        BOOST_CHECK_EQUAL(e.state.GetRejectCode(), REJECT_MEMPOOL_FULL);
+        BOOST_CHECK_EQUAL(e.state.GetRejectReason(), "referrals mempool full");
+    }
+    BOOST_CHECK_EQUAL(mempoolReferral.Size(), 0);
+
+    //With room again the same package is accepted.
+    package = MakePackage({child, parent});
+    BOOST_CHECK(AcceptReferralPackageToMemoryPool(mempoolReferral, package));
+    CheckOrder(package, {parent, child});
+    CheckAccepted(package[0]);
+    CheckAccepted(package[1]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -16,6 +16,8 @@
 #include "net_processing.h"
 #include "pubkey.h"
 #include "random.h"
+#include "refdb.h"
+#include "referrals.h"
 #include "txdb.h"
 #include "txmempool.h"
 #include "ui_interface.h"
@@ -40,6 +42,7 @@ BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
         SetupNetworking();
         InitSignatureCache();
         InitScriptExecutionCache();
+        InitReferralSignatureCache();
         fPrintToDebugLog = false; // don't want to write to debug.log file
         fCheckBlockIndex = true;
         SelectParams(chainName);
@@ -73,6 +76,8 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         pblocktree = new CBlockTreeDB(1 << 20, true);
         pcoinsdbview = new CCoinsViewDB(1 << 23, true);
         pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+        prefviewdb = new referral::ReferralsViewDB{0, true, true};
+        prefviewcache = new referral::ReferralsViewCache{prefviewdb};
         if (!LoadGenesisBlock(chainparams)) {
             throw std::runtime_error("LoadGenesisBlock failed.");
         }
@@ -85,6 +90,8 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         nScriptCheckThreads = 3;
         for (int i=0; i < nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i < nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadReferralCheck);
         g_connman = std::unique_ptr<CConnman>(new CConnman(0x1337, 0x1337)); // Deterministic randomness for tests.
         connman = g_connman.get();
         RegisterNodeSignals(GetNodeSignals());
@@ -98,6 +105,10 @@ TestingSetup::~TestingSetup()
         GetMainSignals().FlushBackgroundCallbacks();
         GetMainSignals().UnregisterBackgroundSignalScheduler();
         UnloadBlockIndex();
+        delete prefviewcache;
+        delete prefviewdb;
+        prefviewcache = nullptr;
+        prefviewdb = nullptr;
         delete pcoinsTip;
         delete pcoinsdbview;
         delete pblocktree;
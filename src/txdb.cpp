@@ -681,7 +681,7 @@ bool CBlockTreeDB::CacheAllUnspent()
 
             CAddressUnspentValue value;
             if (pcursor->GetValue(value)) {
-                unspent_cache.push_back(std::make_pair(key.second, value));
+                AddToUnspentCache(std::make_pair(key.second, value));
             } else {
                 return error("failed to get address unspent value");
             }
@@ -693,13 +693,20 @@ bool CBlockTreeDB::CacheAllUnspent()
 
 void CBlockTreeDB::EraseFromUnspentCache(const RemoveUnspentSet& to_remove)
 {
-    unspent_cache.erase(std::remove_if(unspent_cache.begin(), unspent_cache.end(),
-                [&to_remove](const UnspentPair& a) {
-                   return to_remove.count(a.first);  
-                }), unspent_cache.end());
+    for (const auto& key : to_remove) {
+        auto address = unspent_cache.find(key.hashBytes);
+        if (address == unspent_cache.end()) {
+            continue;
+        }
+
+        address->second.erase(key);
+        if (address->second.empty()) {
+            unspent_cache.erase(address);
+        }
+    }
 }
 
 void CBlockTreeDB::AddToUnspentCache(const UnspentPair& p)
 {
-    unspent_cache.push_back(p);
+    unspent_cache[p.first.hashBytes][p.first] = p.second;
 }
@@ -120,7 +120,10 @@ private:
 };
 
 using UnspentPair = std::pair<CAddressUnspentKey, CAddressUnspentValue>;
-using UnspentCache = std::vector<UnspentPair>;
+using AddressUnspent = std::map<CAddressUnspentKey, CAddressUnspentValue>;
+
+/** Unspent outputs grouped by address hash, of any type. */
+using UnspentCache = std::map<uint160, AddressUnspent>;
 using RemoveUnspentSet = std::set<CAddressUnspentKey>;
 using SpentCache = std::set<CSpentIndexKey>;
 
@@ -166,12 +169,29 @@ public:
                 bool invite,
                 F process) {
             assert(!unspent_cache.empty());
-            for(const auto& unspent : unspent_cache) { 
-                process(unspent.first, unspent.second);
+            for(const auto& address : unspent_cache) {
+                for(const auto& unspent : address.second) {
+                    process(unspent.first, unspent.second);
+                }
             }
             return true;
         }
 
+    /** Processes the cached unspent outputs of one address, of any type. */
+    template<class F>
+        void ReadCachedAddressUnspent(
+                const uint160& addressHash,
+                F process) const {
+            const auto address = unspent_cache.find(addressHash);
+            if (address == unspent_cache.end()) {
+                return;
+            }
+
+            for(const auto& unspent : address->second) {
+                process(unspent.first, unspent.second);
+            }
+        }
+
     bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool ReadAddressIndex(
@@ -246,6 +246,7 @@ const CLogCategoryDesc LogCategories[] =
     {BCLog::VALIDATION, "validataion"},
     {BCLog::POG, "pog"},
     {BCLog::BEACONS, "beacons"},
+    {BCLog::STRATUM, "stratum"},
     {BCLog::ALL, "1"},
     {BCLog::ALL, "all"},
 };
@@ -106,6 +106,7 @@ namespace BCLog {
         VALIDATION  = (1 << 22),
         POG         = (1 << 23),
         BEACONS     = (1 << 24),
+        STRATUM     = (1 << 25),
         ALL         = ~(uint32_t)0,
     };
 }
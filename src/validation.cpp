@@ -23,6 +23,8 @@
 #include "pog/select.h"
 #include "pog2/reward.h"
 #include "pog2/select.h"
+#include "pog3/cgsstate.h"
+#include "pog3/snapshot.h"
 #include "pog3/reward.h"
 #include "pog3/select.h"
 #include "pog/invitebuffer.h"
@@ -58,6 +60,7 @@
 
 #include <algorithm>
 #include <atomic>
+#include <deque>
 #include <sstream>
 #include <numeric>
 
@@ -93,6 +96,8 @@ bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
+bool fCgsFixedPointCheck = DEFAULT_CGS_FIXED_POINT_CHECK;
+bool fCheckLotteryCache = DEFAULT_CHECK_LOTTERY_CACHE;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
@@ -396,15 +401,98 @@ referral::MaybeReferral LookupReferral(
     return it != extraReferrals.end() ? **it : referral::MaybeReferral{};
 }
 
-bool CheckReferralSignature(const referral::Referral& ref)
+namespace {
+/**
+ * Referral signatures that verified, so a referral seen in the mempool
+ * isn't verified again when its block is connected. Blocks are checked on
+ * the referral check threads so the cache is locked the same way as the
+ * script signature cache.
+ */
+class CReferralSignatureCache
+{
+private:
+    //! Entries are SHA256(nonce || referral hash)
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs_refsigcache;
+
+public:
+    CReferralSignatureCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const referral::Referral& ref)
+    {
+        // The referral hash commits to the pubkey, addresses and signature
+        // so a referral with the same hash has the same valid signature.
+        CSHA256().Write(nonce.begin(), 32).Write(ref.GetHash().begin(), 32).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry, const bool erase)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_refsigcache);
+        return setValid.contains(entry, erase);
+    }
+
+    void Set(uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_refsigcache);
+        setValid.insert(entry);
+    }
+
+    uint32_t setup_bytes(size_t n)
+    {
+        return setValid.setup_bytes(n);
+    }
+};
+
+static CReferralSignatureCache referralSignatureCache;
+} // namespace
+
+void InitReferralSignatureCache()
+{
+    // Entries are only a hash per referral so an eighth of the signature
+    // cache budget holds far more beacons than fit in the mempool.
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 8), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = referralSignatureCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu/8 requested for referral signature cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*8)>>20, nElems);
+}
+
+bool CachingReferralSignatureChecker::VerifySignature(const referral::Referral& ref) const
+{
+    auto hash = (CHashWriter(SER_GETHASH, 0) << ref.parentAddress << ref.GetAddress()).GetHash();
+    return ref.pubkey.Verify(hash, ref.signature);
+}
+
+bool CachingReferralSignatureChecker::CheckSignature(const referral::Referral& ref) const
 {
     if (!ref.pubkey.IsValid()) {
         return false;
     }
 
-    auto hash = (CHashWriter(SER_GETHASH, 0) << ref.parentAddress << ref.GetAddress()).GetHash();
+    uint256 entry;
+    referralSignatureCache.ComputeEntry(entry, ref);
+    if (referralSignatureCache.Get(entry, !store)) {
+        return true;
+    }
 
-    return ref.pubkey.Verify(hash, ref.signature);
+    if (!VerifySignature(ref)) {
+        return false;
+    }
+
+    if (store) {
+        referralSignatureCache.Set(entry);
+    }
+
+    return true;
+}
+
+bool CheckReferralSignature(const referral::Referral& ref, bool cache_store)
+{
+    return CachingReferralSignatureChecker{cache_store}.CheckSignature(ref);
 }
 
 bool CheckReferralAliasUnique(
@@ -726,14 +814,18 @@ static bool CheckInputsFromMempoolAndCache(
             txdata);
 }
 
-bool AcceptReferralToMemoryPoolWithTime(referral::ReferralTxMemPool& pool,
+/**
+ * Checks the referral against the chain and the mempool and adds it to the
+ * mempool if valid. pool.cs must be held.
+ */
+static bool AddReferralToMemoryPool(referral::ReferralTxMemPool& pool,
     CValidationState& state,
     const referral::ReferralRef& referral,
     int64_t nAcceptTime,
-    bool& missingReferrer,
-    bool fOverrideMempoolLimit)
+    bool& missingReferrer)
 {
     assert(referral);
+    AssertLockHeld(pool.cs);
 
     missingReferrer = false;
 
@@ -745,51 +837,181 @@ bool AcceptReferralToMemoryPoolWithTime(referral::ReferralTxMemPool& pool,
         return false;
     }
 
+    if (CheckAddressBeaconed(referral->GetAddress())) {
+        return state.Invalid(false, REJECT_DUPLICATE, "ref-address-beaconed");
+    }
+
+    // check if referral alias is already occupied
+    // we allow referrals with non-unique aliases in mempool
+    // but only one of them would be accepted to new block
+    if (!CheckReferralAliasUnique(referral, nullptr, true)) {
+        return state.Invalid(false, REJECT_DUPLICATE, "ref-alias-duplicate");
+    }
+
+    if (!(prefviewcache->Exists(referral->parentAddress) ||
+        pool.Exists(referral->parentAddress))) {
+        missingReferrer = true;
+        return state.Invalid(false, REJECT_INVALID, "ref-parent-not-beaconed");
+    }
+
+    if (!CheckReferralSignature(*referral)) {
+        return state.Invalid(false, REJECT_INVALID, "ref-bad-sig");
+    }
+
     referral::RefMemPoolEntry entry(*referral, nAcceptTime, chainActive.Height());
+    pool.AddUnchecked(referral->GetHash(), entry);
+    return true;
+}
+
+static void LimitReferralMempoolSize(referral::ReferralTxMemPool& pool)
+{
+    LimitMempoolSize(
+        pool,
+        gArgs.GetArg("-maxrefmempool", DEFAULT_MAX_REFERRALS_MEMPOOL_SIZE) * 1000000,
+        gArgs.GetArg("-refmempoolexpiry", DEFAULT_REFERRALS_MEMPOOL_EXPIRY) * 60 * 60);
+}
+
+bool AcceptReferralToMemoryPoolWithTime(referral::ReferralTxMemPool& pool,
+    CValidationState& state,
+    const referral::ReferralRef& referral,
+    int64_t nAcceptTime,
+    bool& missingReferrer,
+    bool fOverrideMempoolLimit)
+{
+    assert(referral);
 
     const auto hash = referral->GetHash();
 
     {
         LOCK(pool.cs);
+        if (!AddReferralToMemoryPool(pool, state, referral, nAcceptTime, missingReferrer)) {
+            return false;
+        }
+    }
 
-        if (CheckAddressBeaconed(referral->GetAddress())) {
-            return state.Invalid(false, REJECT_DUPLICATE, "ref-address-beaconed");
+    // trim mempool and check if referral was trimmed
+    if (!fOverrideMempoolLimit) {
+        LimitReferralMempoolSize(pool);
+        if (!pool.Exists(hash)) {
+            return state.DoS(0, false, REJECT_MEMPOOL_FULL, "referrals mempool full");
         }
+    }
+
+    GetMainSignals().ReferralAddedToMempool(referral);
+
+    return true;
+}
+
+/**
+ * Orders the package so that every referral comes after its parent when the
+ * parent is in the package too. Referrals whose parents are not in the
+ * package keep their relative order and come first.
+ */
+static void SortReferralPackage(ReferralPackage& package)
+{
+    std::set<referral::Address> addresses;
+    for (const auto& e : package) {
+        addresses.insert(e.ref->GetAddress());
+    }
 
-        // check if referral alias is already occupied
-        // we allow referrals with non-unique aliases in mempool
-        // but only one of them would be accepted to new block
-        if (!CheckReferralAliasUnique(referral, nullptr, true)) {
-            return state.Invalid(false, REJECT_DUPLICATE, "ref-alias-duplicate");
+    std::map<referral::Address, std::vector<size_t>> children;
+    std::deque<size_t> to_process;
+    for (size_t i = 0; i < package.size(); i++) {
+        const auto& ref = *package[i].ref;
+        if (ref.parentAddress != ref.GetAddress() && addresses.count(ref.parentAddress)) {
+            children[ref.parentAddress].push_back(i);
+        } else {
+            to_process.push_back(i);
         }
+    }
+
+    std::vector<bool> done(package.size(), false);
+    std::vector<size_t> order;
+    order.reserve(package.size());
+
+    while (!to_process.empty()) {
+        const auto i = to_process.front();
+        to_process.pop_front();
 
-        if (!(prefviewcache->Exists(referral->parentAddress) ||
-            pool.Exists(referral->parentAddress))) {
-            missingReferrer = true;
-            return state.Invalid(false, REJECT_INVALID, "ref-parent-not-beaconed");
+        if (done[i]) {
+            continue;
         }
 
-        if (!CheckReferralSignature(*referral)) {
-            return state.Invalid(false, REJECT_INVALID, "ref-bad-sig");
+        done[i] = true;
+        order.push_back(i);
+
+        const auto c = children.find(package[i].ref->GetAddress());
+        if (c != children.end()) {
+            to_process.insert(to_process.end(), c->second.begin(), c->second.end());
         }
+    }
 
-        pool.AddUnchecked(hash, entry);
+    //Referrals in a cycle have no parent to wait for. They are left at the
+    //end and rejected for their missing referrer.
+    for (size_t i = 0; i < package.size(); i++) {
+        if (!done[i]) {
+            order.push_back(i);
+        }
     }
 
-    // trim mempool and check if referral was trimmed
+    ReferralPackage sorted;
+    sorted.reserve(package.size());
+    for (auto i : order) {
+        sorted.push_back(std::move(package[i]));
+    }
+
+    package.swap(sorted);
+}
+
+bool AcceptReferralPackageToMemoryPool(
+    referral::ReferralTxMemPool& pool,
+    ReferralPackage& package,
+    bool fOverrideMempoolLimit)
+{
+    SortReferralPackage(package);
+
+    const auto now = GetTime();
+
+    {
+        LOCK(pool.cs);
+        std::set<int64_t> invalid_sources;
+        for (auto& e : package) {
+            assert(e.ref);
+            if (e.source >= 0 && invalid_sources.count(e.source)) {
+                e.skipped = true;
+                continue;
+            }
+
+            e.accepted = AddReferralToMemoryPool(pool, e.state, e.ref, now, e.missing_referrer);
+
+            int nDoS = 0;
+            if (e.source >= 0 && e.state.IsInvalid(nDoS) && nDoS > 0) {
+                invalid_sources.insert(e.source);
+            }
+        }
+    }
+
+    // trim mempool once for the whole package and check what was trimmed
     if (!fOverrideMempoolLimit) {
-        LimitMempoolSize(
-            pool,
-            gArgs.GetArg("-maxrefmempool", DEFAULT_MAX_REFERRALS_MEMPOOL_SIZE) * 1000000,
-            gArgs.GetArg("-refmempoolexpiry", DEFAULT_REFERRALS_MEMPOOL_EXPIRY) * 60 * 60);
-        if (!pool.Exists(hash)) {
-            return state.DoS(0, false, REJECT_MEMPOOL_FULL, "referrals mempool full");
+        LimitReferralMempoolSize(pool);
+        for (auto& e : package) {
+            if (e.accepted && !pool.Exists(e.ref->GetHash())) {
+                e.accepted = false;
+                e.state.DoS(0, false, REJECT_MEMPOOL_FULL, "referrals mempool full");
+            }
         }
     }
 
-    GetMainSignals().ReferralAddedToMempool(referral);
+    bool all_accepted = true;
+    for (const auto& e : package) {
+        if (e.accepted) {
+            GetMainSignals().ReferralAddedToMempool(e.ref);
+        } else {
+            all_accepted = false;
+        }
+    }
 
-    return true;
+    return all_accepted;
 }
 
 bool AcceptReferralToMemoryPool(
@@ -1977,7 +2199,11 @@ std::pair<pog::AmbassadorLottery, pog2::AddressSelectorPtr> Pog2RewardAmbassador
     pog2::CGSContext context;
     context.cgs_pool = pog3::GetCgsThreadPool();
 
-    pog2::GetAllRewardableEntrants(context, *prefviewcache, params, height, entrants);
+    // The referral DB is at the previous block, except for a forced lottery
+    // like simulatelottery runs, which seeds with any hash and uses the tip.
+    const uint256 referrals_hash = force_pog2 ?
+        chainActive.Tip()->GetBlockHash() : previous_block_hash;
+    pog2::GetAllRewardableEntrants(context, *prefviewcache, params, referrals_hash, height, entrants);
 
     max_ambassador_lottery = std::max(max_ambassador_lottery, entrants.size());
 
@@ -2056,6 +2282,45 @@ std::pair<pog::AmbassadorLottery, pog2::AddressSelectorPtr> Pog2RewardAmbassador
     return std::make_pair(rewards, selector);
 }
 
+/**
+ * Selects the winners of a lottery again from entrants computed with
+ * pog3::FixedAmount and logs whether they match the ones consensus selected.
+ * Running with -reindex-chainstate replays every historical lottery this way.
+ */
+void CheckCgsFixedPoint(
+        int height,
+        const uint256& previous_block_hash,
+        const pog3::CGSContext& context,
+        size_t desired_winners,
+        const pog3::Entrants& winners,
+        const Consensus::Params& params)
+{
+    pog3::Entrants entrants;
+    entrants.reserve(context.entrants.size());
+    pog3::ComputeFixedPointEntrants(context, params, entrants);
+
+    pog3::AddressSelector selector{height, entrants, params};
+    const auto fixed_winners = selector.SelectByCgs(
+            *prefviewcache,
+            previous_block_hash,
+            desired_winners);
+
+    const bool same = fixed_winners.size() == winners.size() &&
+        std::equal(winners.begin(), winners.end(), fixed_winners.begin(),
+                [](const pog3::Entrant& a, const pog3::Entrant& b) {
+                    return a.address == b.address;
+                });
+
+    if (same) {
+        LogPrint(BCLog::POG, "%s: fixed point winners match at height %d\n", __func__, height);
+        return;
+    }
+
+    LogPrintf("%s: fixed point winners differ at height %d\n", __func__, height);
+    LogWinners(winners);
+    LogWinners(fixed_winners);
+}
+
 std::pair<pog::AmbassadorLottery, pog3::AddressSelectorPtr> Pog3RewardAmbassadors(
         int height,
         const uint256& previous_block_hash,
@@ -2069,22 +2334,15 @@ std::pair<pog::AmbassadorLottery, pog3::AddressSelectorPtr> Pog3RewardAmbassador
 
     assert(prefviewdb != nullptr);
 
-    static size_t max_ambassador_lottery = 0;
-    pog3::Entrants entrants;
-
-    // unlikely that the candidates grew over 50% since last time.
-    auto reserve_size = max_ambassador_lottery * 1.5;
-    entrants.reserve(reserve_size);
-
-    pog3::CGSContext context;
-    context.cgs_pool = pog3::GetCgsThreadPool();
-
-    pog3::GetAllRewardableEntrants(context, *prefviewcache, params, height, entrants);
-
-    max_ambassador_lottery = std::max(max_ambassador_lottery, entrants.size());
+    // The referral DB is at the previous block, except for a forced lottery
+    // like simulatelottery runs, which seeds with any hash and uses the tip.
+    // The miner and ConnectBlock of the mined block share the same snapshot.
+    const uint256 referrals_hash = force_pog3 ?
+        chainActive.Tip()->GetBlockHash() : previous_block_hash;
+    const auto snapshot = pog3::GetCgsSnapshot(*prefviewcache, params, referrals_hash, height);
 
     // Wallet selector will create a distribution from all the keys
-    auto selector = std::make_shared<pog3::AddressSelector>(height, entrants, params);
+    auto selector = std::make_shared<pog3::AddressSelector>(height, snapshot->entrants, params);
 
     // We may have fewer keys in the distribution than the expected winners,
     // so just pick smallest of the two.
@@ -2117,6 +2375,10 @@ std::pair<pog::AmbassadorLottery, pog3::AddressSelectorPtr> Pog3RewardAmbassador
 
     assert(winners.size() <= desired_winners);
 
+    if (fCgsFixedPointCheck) {
+        CheckCgsFixedPoint(height, previous_block_hash, snapshot->context, desired_winners, winners, params);
+    }
+
     // Compute reward for all the winners
     const auto rewards = pog3::RewardAmbassadors(height, winners, total);
     LogPrint(BCLog::POG, "%s: Rewarding %d winners\n", __func__, rewards.winners.size());
@@ -2157,6 +2419,144 @@ std::tuple<pog::AmbassadorLottery, pog2::AddressSelectorPtr, pog3::AddressSelect
             pog3::AddressSelectorPtr{});
 }
 
+/**
+ * The ambassador lottery of the block after previous_block_hash as last
+ * computed, ahead of time once the tip connected, for a block template or
+ * while connecting a block on the tip. Guarded by cs_main.
+ */
+struct NextBlockLottery
+{
+    uint256 previous_block_hash;
+    int height = -1;
+    CAmount total = 0;
+    pog::AmbassadorLottery lottery;
+    pog2::AddressSelectorPtr pog2_selector;
+    pog3::AddressSelectorPtr pog3_selector;
+};
+
+static NextBlockLottery g_next_block_lottery;
+
+/** Set while a lottery is being computed ahead of time on the CGS pool. */
+static std::atomic<bool> g_precomputing_lottery{false};
+
+template <typename Selector>
+static std::shared_ptr<Selector> CopySelector(const std::shared_ptr<Selector>& selector)
+{
+    return selector ? std::make_shared<Selector>(*selector) : nullptr;
+}
+
+template <typename Selector>
+static size_t SelectorSize(const std::shared_ptr<Selector>& selector)
+{
+    return selector ? selector->Size() : 0;
+}
+
+/**
+ * Recomputes the lottery the cache is about to hand out and logs whether the
+ * winners match. If they don't, the cache missed a change to the referrals
+ * and the fresh lottery replaces it.
+ */
+static void CheckCachedLottery(NextBlockLottery& cached, const Consensus::Params& params)
+{
+    const auto fresh = RewardAmbassadors(cached.height, cached.previous_block_hash, cached.total, params);
+    const auto& lottery = std::get<0>(fresh);
+
+    const bool same = lottery.remainder == cached.lottery.remainder &&
+        lottery.winners.size() == cached.lottery.winners.size() &&
+        std::equal(lottery.winners.begin(), lottery.winners.end(), cached.lottery.winners.begin(),
+                [](const pog::AmbassadorReward& a, const pog::AmbassadorReward& b) {
+                    return a.address_type == b.address_type &&
+                        a.address == b.address &&
+                        a.amount == b.amount;
+                }) &&
+        SelectorSize(std::get<1>(fresh)) == SelectorSize(cached.pog2_selector) &&
+        SelectorSize(std::get<2>(fresh)) == SelectorSize(cached.pog3_selector);
+
+    if (same) {
+        LogPrint(BCLog::POG, "%s: cached lottery matches at height %d\n", __func__, cached.height);
+        return;
+    }
+
+    LogPrintf("%s: cached lottery differs at height %d (%d vs %d winners), using the fresh one\n",
+            __func__, cached.height, cached.lottery.winners.size(), lottery.winners.size());
+
+    cached.lottery = lottery;
+    cached.pog2_selector = std::get<1>(fresh);
+    cached.pog3_selector = std::get<2>(fresh);
+}
+
+std::tuple<pog::AmbassadorLottery, pog2::AddressSelectorPtr, pog3::AddressSelectorPtr> CachedRewardAmbassadors(
+        int height,
+        const uint256& previous_block_hash,
+        CAmount total,
+        const Consensus::Params& params)
+{
+    AssertLockHeld(cs_main);
+
+    auto& cached = g_next_block_lottery;
+    if (cached.height != height ||
+            cached.previous_block_hash != previous_block_hash ||
+            cached.total != total) {
+        auto lottery = RewardAmbassadors(height, previous_block_hash, total, params);
+
+        cached.previous_block_hash = previous_block_hash;
+        cached.height = height;
+        cached.total = total;
+        cached.lottery = std::get<0>(lottery);
+        cached.pog2_selector = std::get<1>(lottery);
+        cached.pog3_selector = std::get<2>(lottery);
+    } else {
+        LogPrint(BCLog::POG, "%s: reusing the lottery of height %d\n", __func__, height);
+        if (fCheckLotteryCache) {
+            CheckCachedLottery(cached, params);
+        }
+    }
+
+    return std::make_tuple(
+            cached.lottery,
+            CopySelector(cached.pog2_selector),
+            CopySelector(cached.pog3_selector));
+}
+
+void PrecomputeRewardAmbassadors(const CBlockIndex* tip, const Consensus::Params& params)
+{
+    assert(tip);
+
+    //The lottery waits on CGS tasks pushed to the same pool, so it needs a
+    //thread of its own besides the ones doing the work.
+    auto* pool = pog3::GetCgsThreadPool();
+    if (pool->size() < 2 || g_precomputing_lottery.exchange(true)) {
+        return;
+    }
+
+    const uint256 previous_block_hash = tip->GetBlockHash();
+    const int height = tip->nHeight + 1;
+
+    pool->push([previous_block_hash, height, &params](int) {
+        try {
+            LOCK(cs_main);
+
+            //Another block may have connected, or the tip may have been
+            //disconnected, while this waited for the lock.
+            if (!ShutdownRequested() &&
+                    chainActive.Tip() != nullptr &&
+                    chainActive.Tip()->GetBlockHash() == previous_block_hash) {
+                const auto subsidy = GetSplitSubsidy(height, params);
+                CachedRewardAmbassadors(height, previous_block_hash, subsidy.ambassador, params);
+            }
+        } catch (const std::exception& e) {
+            LogPrintf("%s: unable to compute the lottery of height %d: %s\n", __func__, height, e.what());
+        }
+        g_precomputing_lottery = false;
+    });
+}
+
+void ClearCachedRewardAmbassadors()
+{
+    AssertLockHeld(cs_main);
+    g_next_block_lottery = NextBlockLottery{};
+}
+
 bool OldComputeInviteLotteryParams(
         CBlockIndex* pindexPrev,
         CCoinsViewCache& view,
@@ -3189,16 +3589,7 @@ bool GetDebitsAndCredits(DebitsAndCredits& debits_and_credits, const CTransactio
 bool UpdateANV(const DebitsAndCredits& debits_and_credits)
 {
     //apply the debit and credits to the addresses in the block transactions.
-    for (const auto& t : debits_and_credits) {
-        const auto addressType = std::get<0>(t);
-        const auto& address = std::get<1>(t);
-        const auto amount = std::get<2>(t);
-        if (!prefviewdb->UpdateANV(addressType, address, amount)) {
-            return false;
-        }
-    }
-
-    return true;
+    return prefviewdb->UpdateANVs(debits_and_credits);
 }
 
 bool UpdateANV(const CBlock& block, CCoinsViewCache& view) {
@@ -3293,6 +3684,10 @@ bool UpdateLotteryEntrants(
 
     }
 
+    if (!prefviewdb->FlushLottery()) {
+        return false;
+    }
+
     LogPrint(BCLog::BEACONS, "%s: Adding lottery undo entrants %d\n", __func__, undo.lottery.size());
     return true;
 }
@@ -3307,7 +3702,7 @@ bool UndoLotteryEntrants(const CBlockUndo& undo, const size_t max_reservoir_size
             return false;
         }
     }
-    return true;
+    return prefviewdb->FlushLottery();
 }
 
 bool RecordNewPoolInviteRewards(
@@ -3553,6 +3948,10 @@ static DisconnectResult DisconnectBlock(
 {
     debug("DisconnectBlock: %s", block.GetHash().GetHex());
 
+    //The referrals go back to the state of the parent, so the lottery of
+    //the block after this one no longer holds.
+    ClearCachedRewardAmbassadors();
+
     bool fClean = true;
 
     CBlockUndo block_undo;
@@ -3628,6 +4027,11 @@ static DisconnectResult DisconnectBlock(
     fClean &= pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex);
     fClean &= pblocktree->UpdateSpentIndex(spentIndex);
 
+    // The CGS state only moves forward, it is rebuilt on next use. The
+    // snapshots computed on top of this block no longer hold either.
+    pog3::GetCgsState().Invalidate();
+    pog3::ClearCgsSnapshots();
+
     if (block.IsDaedalus()) {
         if (!UpdateConfirmations(block, invite_debits_and_credits)) {
             error("DisconnectBlock(): unable to undo confirmations");
@@ -3710,6 +4114,23 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CReferralCheck> referralcheckqueue(128);
+
+void ThreadReferralCheck() {
+    RenameThread("merit-refch");
+    referralcheckqueue.Thread();
+}
+
+static ctpl::thread_pool header_pow_pool;
+
+void SetupHeaderPowThreadPool(size_t threads) {
+    header_pow_pool.resize(threads);
+}
+
+bool CReferralCheck::operator()() {
+    return CheckReferralSignature(*ref, cacheStore);
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -4262,6 +4683,29 @@ static bool ConnectBlock(
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
 
+    // Referral signatures don't depend on anything else in the block so they
+    // are verified by the referral check threads while the transactions are
+    // connected and their scripts checked.
+    CCheckQueueControl<CReferralCheck> ref_control(validate && nScriptCheckThreads ? &referralcheckqueue : nullptr);
+    if (validate) {
+        std::vector<CReferralCheck> ref_checks;
+        ref_checks.reserve(block.m_vRef.size());
+
+        for (const auto& ref: block.m_vRef) {
+            CReferralCheck check{*ref, fJustCheck};
+            if (nScriptCheckThreads) {
+                ref_checks.push_back(CReferralCheck{});
+                check.swap(ref_checks.back());
+            } else if (!check()) {
+                return state.DoS(100,
+                        error("ConnectBlock(): referral sig check failed on %s", ref->GetHash().GetHex()),
+                        REJECT_INVALID, "bad-ref-sig-failed");
+            }
+        }
+
+        ref_control.Add(ref_checks);
+    }
+
     std::vector<int> prevheights;
     CAmount nFees = 0;
     int nInputs = 0;
@@ -4459,6 +4903,12 @@ static bool ConnectBlock(
 
     int64_t nTime7 = GetTimeMicros();
 
+    // The referral signatures have to be settled before the alias checks
+    // below, which fail without marking the block invalid.
+    if (!ref_control.Wait()) {
+        return state.DoS(100, error("%s: referral sig check failed", __func__), REJECT_INVALID, "bad-ref-sig-failed");
+    }
+
     if (validate) {
         for (const auto& ref: block.m_vRef) {
             if (CheckAddressBeaconed(ref->GetAddress(), false)) {
@@ -4467,12 +4917,6 @@ static bool ConnectBlock(
                         REJECT_INVALID, "bad-ref-address-beaconed");
             }
 
-            if (!CheckReferralSignature(*ref)) {
-                return state.DoS(100,
-                        error("ConnectBlock(): referral sig check failed on %s", ref->GetHash().GetHex()),
-                        REJECT_INVALID, "bad-ref-sig-failed");
-            }
-
             // is referral alias already occupied?
             if (!CheckReferralAliasUnique(
                         ref,
@@ -4539,8 +4983,15 @@ static bool ConnectBlock(
             nTimeVerify * MILLI / nBlocksTotal);
 
     // Figure out which ambassadors should be rewarded and check to make sure
-    // they are paid the expected amount.
-    const auto lottery = RewardAmbassadors(
+    // they are paid the expected amount. On the tip the lottery was most
+    // likely computed already, ahead of time or for a block template.
+    const auto lottery = pindex->pprev == chainActive.Tip() ?
+        CachedRewardAmbassadors(
+            pindex->nHeight,
+            hashPrevBlock,
+            subsidy.ambassador,
+            chainparams.GetConsensus()) :
+        RewardAmbassadors(
             pindex->nHeight,
             hashPrevBlock,
             subsidy.ambassador,
@@ -4643,7 +5094,6 @@ static bool ConnectBlock(
                 REJECT_INVALID, "bad-orphan-referrals");
     }
 
-
     if (!control.Wait()) {
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
     }
@@ -4758,6 +5208,12 @@ static bool ConnectBlock(
         return AbortNode(state, "Failed to write referral transaction index");
     }
 
+    pog3::GetCgsState().BlockConnected(
+            pindex->GetBlockHash(),
+            hashPrevBlock,
+            pindex->nHeight,
+            ordered_referrals);
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -5496,6 +5952,11 @@ bool ActivateBestChain(
         // Notify external listeners about the new tip.
         GetMainSignals().UpdatedBlockTip(pindexNewTip, pindexFork, fInitialDownload);
 
+        // Get the lottery of the next block ready while it is being mined.
+        if (pindexFork != pindexNewTip && !fInitialDownload) {
+            PrecomputeRewardAmbassadors(pindexNewTip, chainparams.GetConsensus());
+        }
+
         // Always notify the UI if a new block tip was connected
         if (pindexFork != pindexNewTip) {
             uiInterface.NotifyBlockTip(fInitialDownload, pindexNewTip);
@@ -6279,11 +6740,51 @@ static bool AcceptBlockHeader(
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex)
 {
+    // Headers we already have are accepted without checking their
+    // proof-of-work again, so leave them out of the batch. Peers resend
+    // overlapping headers all the time.
+    std::vector<uint256> hashes;
+    hashes.reserve(headers.size());
+    for (const auto& header : headers) {
+        hashes.push_back(header.GetHash());
+    }
+
+    std::vector<size_t> unknown;
+    {
+        LOCK(cs_main);
+        for (size_t i = 0; i < headers.size(); i++) {
+            if (mapBlockIndex.count(hashes[i]) == 0) {
+                unknown.push_back(i);
+            }
+        }
+    }
+
+    // Check the proof-of-work of the new headers up front without cs_main.
+    // Headers before the first failing one don't need checking again, it and
+    // the ones after are checked as usual so they fail the same way.
+    size_t first_bad_pow = headers.size();
+    if (unknown.size() == headers.size()) {
+        first_bad_pow = cuckoo::VerifyProofOfWorkBatch(
+                headers, chainparams.GetConsensus(), header_pow_pool);
+    } else if (!unknown.empty()) {
+        std::vector<CBlockHeader> batch;
+        batch.reserve(unknown.size());
+        for (const auto i : unknown) {
+            batch.push_back(headers[i]);
+        }
+
+        const size_t first_bad = cuckoo::VerifyProofOfWorkBatch(
+                batch, chainparams.GetConsensus(), header_pow_pool);
+        if (first_bad < unknown.size()) {
+            first_bad_pow = unknown[first_bad];
+        }
+    }
+
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); i++) {
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!AcceptBlockHeader(header, state, chainparams, &pindex)) {
+            if (!AcceptBlockHeader(headers[i], state, chainparams, &pindex, i >= first_bad_pow)) {
                 return false;
             }
             if (ppindex) {
@@ -7815,94 +8316,42 @@ std::pair<Ranks, size_t> TopANVRanks(
 
 std::pair<Pog3Ranks, size_t> CGSRanks(
         const std::vector<CAmount>& cgs,
-        int height,
-        const Consensus::Params& params,
-        CAmount& lottery_cgs)
+        const pog3::CGSSnapshot& snapshot)
 {
-    assert(height >= 0);
-    assert(prefviewcache);
-
-    static size_t max_ambassador_lottery = 0;
-    pog3::Entrants entrants;
-
-    // unlikely that the candidates grew over 50% since last time.
-    auto reserve_size = max_ambassador_lottery * 1.5;
-    entrants.reserve(reserve_size);
-
-    pog3::CGSContext context;
-    context.cgs_pool = pog3::GetCgsThreadPool();
-
-    pog3::GetAllRewardableEntrants(context, *prefviewcache, params, height, entrants);
-
-    max_ambassador_lottery = std::max(max_ambassador_lottery, entrants.size());
-
-    lottery_cgs = std::accumulate(entrants.begin(), entrants.end(), CAmount{0},
-            [](CAmount acc, const pog3::Entrant& e) {
-                return acc + e.cgs;
-            });
-
-    std::sort(entrants.begin(), entrants.end(),
-            [](const pog3::Entrant& a, const pog3::Entrant& b) {
-                return a.cgs < b.cgs;
-            });
+    const auto& entrants = snapshot.entrants;
+    const auto& by_cgs = snapshot.by_cgs;
 
     Pog3Ranks ranks;
     ranks.resize(cgs.size());
 
     std::transform(cgs.begin(), cgs.end(), ranks.begin(),
-            [&entrants](CAmount cgs) {
-                auto pos = std::lower_bound(entrants.begin(), entrants.end(), cgs,
-                        [](const pog3::Entrant& a, CAmount cgs) {
-                            return a.cgs < cgs;
+            [&entrants, &by_cgs](CAmount cgs) {
+                auto pos = std::lower_bound(by_cgs.begin(), by_cgs.end(), cgs,
+                        [&entrants](size_t a, CAmount cgs) {
+                            return entrants[a].cgs < cgs;
                         });
-                return std::make_pair(*pos, std::distance(entrants.begin(), pos));
+                return std::make_pair(
+                        pos != by_cgs.end() ? entrants[*pos] : pog3::Entrant{},
+                        std::distance(by_cgs.begin(), pos));
             });
 
-    size_t total = entrants.size();
-    return {ranks, total};
+    return {ranks, entrants.size()};
 }
 
 std::pair<Pog3Ranks, size_t> TopCGSRanks(
         size_t total,
-        int height,
-        const Consensus::Params& params,
-        CAmount& lottery_cgs)
+        const pog3::CGSSnapshot& snapshot)
 {
-    assert(height >= 0);
-    assert(prefviewcache);
-
-    static size_t max_ambassador_lottery = 0;
-    pog3::Entrants entrants;
-
-    // unlikely that the candidates grew over 50% since last time.
-    auto reserve_size = max_ambassador_lottery * 1.5;
-    entrants.reserve(reserve_size);
-
-    pog3::CGSContext context;
-    context.cgs_pool = pog3::GetCgsThreadPool();
-
-    pog3::GetAllRewardableEntrants(context, *prefviewcache, params, height, entrants);
-
-    lottery_cgs = std::accumulate(entrants.begin(), entrants.end(), CAmount{0},
-            [](CAmount acc, const pog3::Entrant& e) {
-                return acc + e.cgs;
-            });
-
-    max_ambassador_lottery = std::max(max_ambassador_lottery, entrants.size());
+    const auto& entrants = snapshot.entrants;
     total = std::min(total, entrants.size());
 
-    std::partial_sort(entrants.begin(), entrants.begin() + total, entrants.end(),
-            [](const pog3::Entrant& a, const pog3::Entrant& b) {
-                return a.cgs > b.cgs;
-            });
-
     Pog3Ranks ranks;
     ranks.resize(total);
 
     int pos = 1;
-    std::transform(entrants.begin(), entrants.begin() + total, ranks.begin(),
-            [&pos,&entrants](const pog3::Entrant& e) {
-                return std::make_pair(e, entrants.size() - pos++);
+    std::transform(snapshot.by_cgs.rbegin(), snapshot.by_cgs.rbegin() + total, ranks.begin(),
+            [&pos,&entrants](size_t e) {
+                return std::make_pair(entrants[e], entrants.size() - pos++);
             });
 
     return {ranks, entrants.size()};
@@ -14,6 +14,7 @@
 #include "amount.h"
 #include "base58.h"
 #include "coins.h"
+#include "consensus/validation.h"
 #include "fs.h"
 #include "protocol.h" // For CMessageHeader::MessageStartChars
 #include "policy/feerate.h"
@@ -28,6 +29,7 @@
 #include "pog2/select.h"
 #include "pog3/cgs.h"
 #include "pog3/select.h"
+#include "pog3/snapshot.h"
 #include "txdb.h"
 #include "script/standard.h"
 
@@ -182,6 +184,12 @@ static const bool DEFAULT_PEERBLOOMFILTERS = true;
 /** Default for -stopatheight */
 static const int DEFAULT_STOPATHEIGHT = 0;
 
+/** Default for -cgsfixedpointcheck */
+static const bool DEFAULT_CGS_FIXED_POINT_CHECK = false;
+
+/** Default for -checklotterycache */
+static const bool DEFAULT_CHECK_LOTTERY_CACHE = false;
+
 struct BlockHasher
 {
     size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
@@ -207,6 +215,10 @@ extern int nScriptCheckThreads;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
+/** Recompute every pog3 lottery with pog3::FixedAmount and log whether the winners match */
+extern bool fCgsFixedPointCheck;
+/** Recompute every lottery CachedRewardAmbassadors reuses and log whether the winners match */
+extern bool fCheckLotteryCache;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
@@ -318,6 +330,10 @@ bool LoadChainTip(const CChainParams& chainparams, bool sample);
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the referral signature checking thread */
+void ThreadReferralCheck();
+/** Start the threads that help checking the proof-of-work of header batches */
+void SetupHeaderPowThreadPool(size_t threads);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -330,8 +346,12 @@ bool ActivateBestChain(
         const CChainParams& chainparams,
         std::shared_ptr<const CBlock> pblock = std::shared_ptr<const CBlock>(),
         bool sample = false);
-/** Check whether referral signature is valid */
-bool CheckReferralSignature(const referral::Referral& ref);
+/**
+ * Check whether referral signature is valid. Valid signatures are remembered
+ * in the referral signature cache if cache_store is set, otherwise a cached
+ * entry is removed once it is used.
+ */
+bool CheckReferralSignature(const referral::Referral& ref, bool cache_store = true);
 /** Build a set of confirmed address in block */
 void BuildConfirmationSet(const CTransactionRef& invite, ConfirmationSet& confirmations_in_block);
 /** Extract address and address type from tx out */
@@ -364,6 +384,28 @@ std::tuple<pog::AmbassadorLottery, pog2::AddressSelectorPtr, pog3::AddressSelect
         CAmount total,
         const Consensus::Params&);
 
+/**
+ * RewardAmbassadors for block templates and blocks connecting on the tip. The
+ * lottery only depends on the previous block, so it runs once per tip and
+ * every caller on the same tip gets the same winners and its own copies of the
+ * selectors, as they were left by the lottery. Requires cs_main.
+ */
+std::tuple<pog::AmbassadorLottery, pog2::AddressSelectorPtr, pog3::AddressSelectorPtr> CachedRewardAmbassadors(
+        int height,
+        const uint256& previous_block_hash,
+        CAmount total,
+        const Consensus::Params&);
+
+/**
+ * Computes the lottery of the block after tip on the CGS thread pool so
+ * CachedRewardAmbassadors finds it when the next template is made and when
+ * the next block connects. Does nothing if one is already being computed.
+ */
+void PrecomputeRewardAmbassadors(const CBlockIndex* tip, const Consensus::Params&);
+
+/** Drops the cached lottery, for when the referrals change under it. Requires cs_main. */
+void ClearCachedRewardAmbassadors();
+
 std::pair<pog::AmbassadorLottery, pog2::AddressSelectorPtr> Pog2RewardAmbassadors(
         int height,
         const uint256& previous_block_hash,
@@ -441,6 +483,35 @@ void PruneBlockFilesManual(int nManualPruneHeight);
 bool AcceptReferralToMemoryPool(referral::ReferralTxMemPool& pool, CValidationState& state,
         const referral::ReferralRef& referral, bool& pfMissingReferrer, bool fOverrideMempoolLimit = false);
 
+/** A referral of a package and the outcome of accepting it to the mempool */
+struct ReferralPackageEntry
+{
+    referral::ReferralRef ref;
+    CValidationState state;
+    bool accepted = false;
+    bool missing_referrer = false;
+    bool skipped = false;
+
+    /** Where the referral came from, like the peer of an orphan, or -1 */
+    int64_t source = -1;
+
+    explicit ReferralPackageEntry(referral::ReferralRef refIn, int64_t sourceIn = -1) :
+        ref{std::move(refIn)}, source{sourceIn} {}
+};
+
+using ReferralPackage = std::vector<ReferralPackageEntry>;
+
+/**
+ * (try to) add a set of referrals that may depend on each other to the
+ * memory pool. The package is sorted so parents come before their children
+ * and every referral is checked and added under one mempool lock. Once a
+ * referral of a source is invalid with a DoS score, the referrals of that
+ * source after it are skipped and left unchecked. The outcome of each
+ * referral is recorded in its entry. Returns true if all were accepted.
+ */
+bool AcceptReferralPackageToMemoryPool(referral::ReferralTxMemPool& pool,
+        ReferralPackage& package, bool fOverrideMempoolLimit = false);
+
 /** (try to) add transaction to memory pool
  * plTxnReplaced will be appended to with all transactions replaced from mempool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx, bool fLimitFree,
@@ -550,6 +621,51 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Checks referral signatures against the referral signature cache. Valid
+ * signatures are remembered if store is set, otherwise a cached entry is
+ * removed once it is used.
+ */
+class CachingReferralSignatureChecker
+{
+private:
+    bool store;
+
+public:
+    explicit CachingReferralSignatureChecker(bool storeIn) : store{storeIn} {}
+    virtual ~CachingReferralSignatureChecker() {}
+
+    bool CheckSignature(const referral::Referral& ref) const;
+
+protected:
+    virtual bool VerifySignature(const referral::Referral& ref) const;
+};
+
+/**
+ * Closure representing the signature verification of one referral
+ * Note that this stores a reference to the referral
+ */
+class CReferralCheck
+{
+private:
+    const referral::Referral* ref;
+    bool cacheStore;
+
+public:
+    CReferralCheck(): ref{nullptr}, cacheStore{false} {}
+
+    CReferralCheck(const referral::Referral& refIn, bool cacheIn) :
+        ref{&refIn},
+        cacheStore{cacheIn} {}
+
+    bool operator()();
+
+    void swap(CReferralCheck& check) {
+        std::swap(ref, check.ref);
+        std::swap(cacheStore, check.cacheStore);
+    }
+};
+
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes);
 bool GetSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value);
 bool HashOnchainActive(const uint256 &hash);
@@ -574,6 +690,9 @@ bool GetAllUnspent(
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
+/** Initializes the referral signature cache */
+void InitReferralSignatureCache();
+
 
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(
@@ -765,15 +884,11 @@ std::pair<Ranks, size_t> TopANVRanks(
 
 std::pair<Pog3Ranks, size_t> CGSRanks(
         const std::vector<CAmount>& cgs,
-        int height,
-        const Consensus::Params& params,
-        CAmount& lottery_cgs);
+        const pog3::CGSSnapshot& snapshot);
 
 std::pair<Pog3Ranks, size_t> TopCGSRanks(
         size_t total,
-        int height,
-        const Consensus::Params& params,
-        CAmount& lottery_cgs);
+        const pog3::CGSSnapshot& snapshot);
 
 template<class F>
     bool GetAllUnspent(
@@ -787,5 +902,14 @@ template<class F>
         return true;
     }
 
+/** Processes the unspent outputs of one address, of any type, from the cache. */
+template<class F>
+    void GetCachedAddressUnspent(
+            const uint160& addressHash,
+            F process)
+    {
+        pblocktree->ReadCachedAddressUnspent(addressHash, process);
+    }
+
 
 #endif // MERIT_VALIDATION_H
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017-2021 The Merit Foundation
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the ambassador lottery cache against fresh lotteries.
+
+The node runs with -checklotterycache, so every lottery reused for a tip is
+recomputed and the node logs whether the winners match. The cache is used
+through the pog1, pog2 and pog3 heights of regtest
+
+- on tip changes, by block templates and by the blocks connecting on them
+- across reorgs, where DisconnectBlock drops it
+- after loadreferralsnapshot, which drops it too"""
+
+import os
+
+from test_framework.test_framework import MeritTestFramework
+from test_framework.util import assert_equal, log_filename
+
+# Past the pog3 height of regtest.
+CHAIN_LENGTH = 14
+
+class LotteryCacheTest(MeritTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        # getblocktemplate needs a peer.
+        self.num_nodes = 2
+        self.extra_args = [["-checklotterycache"], []]
+
+    def setup_nodes(self):
+        # Mining a block at the edge bits of regtest can take minutes.
+        self.add_nodes(self.num_nodes, self.extra_args, timewait=900)
+        self.start_nodes()
+
+    def count_log(self, message):
+        with open(log_filename(self.options.tmpdir, 0, "debug.log"), encoding="utf-8") as log:
+            return sum(1 for line in log if message in line)
+
+    def check_cache(self):
+        """Every reused lottery so far matched a fresh one."""
+        assert_equal(self.count_log("cached lottery differs"), 0)
+        return self.count_log("cached lottery matches")
+
+    def generate_on_template(self, blocks):
+        """Asks for a template twice before each block so the lottery is reused on the tip."""
+        for _ in range(blocks):
+            self.node.getblocktemplate({})
+            self.node.getblocktemplate({})
+            self.node.generate(1)
+
+    def run_test(self):
+        self.node = self.nodes[0]
+
+        self.log.info("Mine through the pog1, pog2 and pog3 heights")
+        # No templates until the node is out of the initial block download.
+        self.node.unlockwallet("58094f46fb")
+        self.node.generate(1)
+        self.generate_on_template(CHAIN_LENGTH - 1)
+        assert_equal(self.node.getblockcount(), CHAIN_LENGTH)
+        matches = self.check_cache()
+        assert matches >= 2 * (CHAIN_LENGTH - 1)
+
+        self.log.info("Reorg to a shorter chain with invalidateblock")
+        old_tip = self.node.getbestblockhash()
+        fork = self.node.getblockhash(CHAIN_LENGTH - 3)
+        self.node.invalidateblock(fork)
+        assert_equal(self.node.getblockcount(), CHAIN_LENGTH - 4)
+        self.generate_on_template(2)
+        assert self.check_cache() > matches
+
+        self.log.info("Reorg back to the longer chain with reconsiderblock")
+        self.node.getblocktemplate({})
+        self.node.reconsiderblock(fork)
+        assert_equal(self.node.getbestblockhash(), old_tip)
+        self.generate_on_template(2)
+        matches = self.check_cache()
+
+        self.log.info("Load a referral snapshot of the tip")
+        path = os.path.join(self.options.tmpdir, "referrals.snapshot")
+        dumped = self.node.dumpreferralsnapshot(path)
+        self.node.getblocktemplate({})
+        loaded = self.node.loadreferralsnapshot(path, dumped["hash"])
+        assert_equal(loaded, dumped)
+        self.generate_on_template(2)
+        assert self.check_cache() > matches
+
+if __name__ == '__main__':
+    LotteryCacheTest().main()
@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017-2021 The Merit Foundation
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test dumpreferralsnapshot and loadreferralsnapshot.
+
+- a snapshot loaded into a wiped referral DB gives the same ANVs,
+  confirmations, lottery, aliases and CGS ranks as the node it came from,
+  and the node keeps syncing blocks on top of it
+- dumping refuses to overwrite a file
+- loading rejects a wrong hash, a truncated file and a snapshot of another tip
+- a node refuses to start after a load was interrupted, until it is
+  rebuilt with -reindex-chainstate"""
+
+import http.client
+import os
+import shutil
+
+from test_framework.test_framework import MeritTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_jsonrpc,
+    connect_nodes_bi,
+    get_datadir_path,
+    sync_blocks,
+    wait_until,
+)
+
+# Past the pog3 height of regtest.
+CHAIN_LENGTH = 14
+
+ALIAS = "snapshotalias"
+
+# RPC_MISC_ERROR and RPC_INVALID_PARAMETER
+MISC_ERROR = -1
+INVALID_PARAMETER = -8
+
+class ReferralSnapshotTest(MeritTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+
+    def setup_nodes(self):
+        # Mining a block at the edge bits of regtest can take minutes.
+        self.add_nodes(self.num_nodes, timewait=900)
+        self.start_nodes()
+
+    def referral_state(self, node):
+        """What the referral DB answers about the chain and the miner's address."""
+        addresses = {"addresses": [self.address]}
+        address = node.validateaddress(self.address)
+        return {
+            "anv": node.getaddressanv(addresses),
+            "rank": node.getaddressrank(addresses),
+            "leaderboard": node.getaddressleaderboard(100),
+            "lottery": node.simulatelottery(),
+            "beaconed": address["isbeaconed"],
+            "confirmed": address["isconfirmed"],
+            "alias": address["alias"],
+            "aliasvacant": node.validatealias(ALIAS)["isvacant"],
+        }
+
+    def wipe_referral_db(self, i):
+        """Stops node i and deletes its referral DB, keeping the chainstate."""
+        self.stop_node(i)
+        regtest = os.path.join(get_datadir_path(self.options.tmpdir, i), "regtest")
+        for name in ["referrals", "referrals_anv", "referrals_lottery"]:
+            shutil.rmtree(os.path.join(regtest, name))
+
+    def run_test(self):
+        node0, node1 = self.nodes
+
+        self.log.info("Mine through the pog3 height with a beacon that has an alias")
+        self.address = node0.unlockwallet("58094f46fb", ALIAS)["referraladdress"]
+        node0.generate(CHAIN_LENGTH)
+        sync_blocks(self.nodes)
+
+        expected = self.referral_state(node0)
+        assert expected["confirmed"]
+        assert_equal(expected["alias"], ALIAS)
+        assert not expected["aliasvacant"]
+        assert_equal(self.referral_state(node1), expected)
+
+        self.log.info("Dump a snapshot of the tip")
+        path = os.path.join(self.options.tmpdir, "referrals.snapshot")
+        dumped = node0.dumpreferralsnapshot(path)
+        assert_equal(dumped["blockhash"], node0.getbestblockhash())
+        assert_equal(dumped["height"], CHAIN_LENGTH)
+        assert dumped["rows"] > 0
+
+        self.log.info("Dumping again to the same file fails")
+        assert_raises_jsonrpc(INVALID_PARAMETER, "already exists", node0.dumpreferralsnapshot, path)
+
+        self.log.info("Snapshots with a wrong hash or truncated are rejected")
+        assert_raises_jsonrpc(MISC_ERROR, "Unable to load the referral snapshot",
+                node1.loadreferralsnapshot, path, "11" * 32)
+
+        truncated = os.path.join(self.options.tmpdir, "truncated.snapshot")
+        with open(path, "rb") as f:
+            data = f.read()
+        with open(truncated, "wb") as f:
+            f.write(data[:-10])
+        assert_raises_jsonrpc(MISC_ERROR, "Unable to load the referral snapshot",
+                node1.loadreferralsnapshot, truncated)
+
+        # Nothing was replaced.
+        assert_equal(self.referral_state(node1), expected)
+
+        self.log.info("Load the snapshot into a wiped referral DB")
+        self.wipe_referral_db(1)
+        # Checking blocks at level 3 disconnects them, which needs the referrals.
+        self.start_node(1, ["-checklevel=2"])
+        assert_equal(node1.getbestblockhash(), dumped["blockhash"])
+        assert_equal(node1.validateaddress(self.address)["isbeaconed"], False)
+
+        loaded = node1.loadreferralsnapshot(path, dumped["hash"])
+        assert_equal(loaded, dumped)
+        assert_equal(self.referral_state(node1), expected)
+
+        self.log.info("The node keeps syncing on top of the snapshot")
+        connect_nodes_bi(self.nodes, 0, 1)
+        node0.generate(2)
+        sync_blocks(self.nodes)
+        assert_equal(self.referral_state(node1), self.referral_state(node0))
+
+        self.log.info("A snapshot of another tip is rejected")
+        assert_raises_jsonrpc(MISC_ERROR, "Unable to load the referral snapshot",
+                node1.loadreferralsnapshot, path, dumped["hash"])
+
+        self.log.info("Interrupt loading a snapshot")
+        path = os.path.join(self.options.tmpdir, "referrals2.snapshot")
+        dumped = node0.dumpreferralsnapshot(path)
+        self.stop_node(1)
+        # Exits right after the first keyspace is erased.
+        self.start_node(1, ["-dbcrashratio=1"])
+        try:
+            node1.loadreferralsnapshot(path, dumped["hash"])
+            raise AssertionError("loadreferralsnapshot should have crashed the node")
+        except (http.client.HTTPException, OSError) as e:
+            self.log.debug("loadreferralsnapshot raised %s", e)
+        node1.wait_until_stopped()
+
+        self.log.info("The node refuses to start until it is rebuilt")
+        self.assert_start_raises_init_error(1, [], "Loading a referral snapshot did not finish")
+
+        self.start_node(1, ["-reindex-chainstate"])
+        wait_until(lambda: node1.getblockcount() == node0.getblockcount(), timeout=120)
+        assert_equal(node1.getbestblockhash(), node0.getbestblockhash())
+        assert_equal(self.referral_state(node1), self.referral_state(node0))
+
+if __name__ == '__main__':
+    ReferralSnapshotTest().main()
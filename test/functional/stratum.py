@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017-2021 The Merit Foundation
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the stratum job server with a local Cuckoo Cycle solver.
+
+- subscribe and the job pushed after it
+- set_share_bits
+- submit of bad cycles, shares and a block that the node accepts
+- stale jobs once the tip changed"""
+
+import hashlib
+import json
+import socket
+import struct
+
+from test_framework.cuckoo import cycle_hash, find_cycle
+from test_framework.test_framework import MeritTestFramework
+from test_framework.util import assert_equal, p2p_port
+
+# RPC_VERIFY_REJECTED and RPC_INVALID_PARAMETER
+VERIFY_REJECTED = -26
+INVALID_PARAMETER = -8
+
+# Offset of the nonce in the hashed header bytes of a job.
+NONCE_OFFSET = 76
+
+class StratumClient():
+    """Speaks newline delimited JSON to the stratum server, keeping the jobs it pushes."""
+
+    def __init__(self, port):
+        self.sock = socket.create_connection(("127.0.0.1", port), timeout=60)
+        self.buf = b""
+        self.next_id = 1
+        self.jobs = []
+
+    def close(self):
+        self.sock.close()
+
+    def read_message(self):
+        while b"\n" not in self.buf:
+            data = self.sock.recv(4096)
+            assert data, "stratum server closed the connection"
+            self.buf += data
+        line, self.buf = self.buf.split(b"\n", 1)
+        return json.loads(line.decode())
+
+    def request(self, method, params):
+        """Returns the reply to the request, any jobs pushed meanwhile are kept."""
+        request_id = self.next_id
+        self.next_id += 1
+        self.sock.sendall((json.dumps({"id": request_id, "method": method, "params": params}) + "\n").encode())
+        while True:
+            message = self.read_message()
+            if message.get("method") == "job":
+                self.jobs.append(message["params"])
+            elif message["id"] == request_id:
+                return message
+
+    def wait_for_job(self):
+        while not self.jobs:
+            message = self.read_message()
+            assert_equal(message.get("method"), "job")
+            self.jobs.append(message["params"])
+        return self.jobs.pop(0)
+
+def assert_rejected(reply, code, reason):
+    assert_equal(reply["result"], None)
+    assert_equal(reply["error"]["code"], code)
+    assert reply["error"]["message"].startswith(reason), reply["error"]["message"]
+
+def solve(job, nonce):
+    """Returns the cycle of the job's graph at nonce, or None."""
+    header = bytearray.fromhex(job["header"])
+    struct.pack_into("<I", header, NONCE_OFFSET, nonce)
+    block_hash = hashlib.sha256(hashlib.sha256(bytes(header)).digest()).digest()[::-1].hex()
+    return find_cycle(block_hash, job["edge_bits"], job["proof_size"])
+
+class StratumTest(MeritTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+
+    def run_test(self):
+        node = self.nodes[0]
+
+        # Jobs are only handed out once the node left initial block download.
+        node.unlockwallet("58094f46fb")
+        node.generate(1)
+        address = node.getnewaddress()
+        tip_time = node.getblock(node.getbestblockhash())["time"]
+
+        # Blocks more than two spacings after the tip may use the minimum
+        # difficulty and edge bits, which the python solver can manage.
+        port = p2p_port(self.num_nodes)
+        self.stop_node(0)
+        self.start_node(0, [
+            "-stratum=1",
+            "-stratumport=%d" % port,
+            "-stratumaddress=%s" % address,
+            "-mocktime=%d" % (tip_time + 60),
+            "-debug=stratum"])
+        node = self.nodes[0]
+        height = node.getblockcount()
+
+        self.log.info("subscribe")
+        client = StratumClient(port)
+        reply = client.request("submit", {"job_id": "1", "nonce": 0, "cycle": []})
+        assert_equal(reply["error"]["message"], "Not subscribed")
+
+        reply = client.request("subscribe", [])
+        assert_equal(reply["error"], None)
+        subscription = reply["result"]
+        nonce_start = subscription["nonce_start"]
+        assert_equal(subscription["nonce_count"], 1 << 24)
+
+        job = client.wait_for_job()
+        assert_equal(job["clean"], True)
+        assert_equal(job["height"], height + 1)
+        assert_equal(job["prev_hash"], node.getbestblockhash())
+        assert_equal(job["nonce_start"], nonce_start)
+        assert_equal(job["edge_bits"], 16)
+        assert_equal(len(bytes.fromhex(job["header"])), 81)
+
+        self.log.info("set_share_bits")
+        assert_rejected(client.request("set_share_bits", ["zz"]), INVALID_PARAMETER, "Invalid share bits")
+        reply = client.request("set_share_bits", ["1f00ffff"])
+        assert_equal(reply["error"], None)
+        assert_equal(int(reply["result"]["share_target"], 16), 0xffff << (8 * (0x1f - 3)))
+
+        # The share target is capped at the proof-of-work limit.
+        reply = client.request("set_share_bits", ["2100ff00"])
+        assert_equal(reply["error"], None)
+        share_target = int(reply["result"]["share_target"], 16)
+        assert_equal(share_target, (1 << 255) - 1)
+
+        self.log.info("submit bad solutions")
+        assert_rejected(client.request("submit", {"job_id": "nope", "nonce": nonce_start, "cycle": []}), VERIFY_REJECTED, "stale-job")
+        assert_rejected(client.request("submit", {"job_id": job["job_id"], "nonce": nonce_start + (1 << 24), "cycle": []}), VERIFY_REJECTED, "nonce-out-of-range")
+        assert_rejected(client.request("submit", {"job_id": job["job_id"], "nonce": nonce_start, "cycle": [1, 2, 3]}), VERIFY_REJECTED, "bad-cycle")
+        cycle = list(range(job["proof_size"]))
+        assert_rejected(client.request("submit", {"job_id": job["job_id"], "nonce": nonce_start, "cycle": cycle}), VERIFY_REJECTED, "bad-cycle")
+
+        self.log.info("solve cuckoo%d graphs until a cycle meets the block target" % (job["edge_bits"] + 1))
+        # The block target is the proof-of-work limit as well, so nearly
+        # every cycle that counts as a share is a block too.
+        target = int(job["target"], 16)
+        assert target <= share_target
+        shares = 0
+        nonce = nonce_start
+        while True:
+            cycle = solve(job, nonce)
+            if cycle is not None:
+                submission = {"job_id": job["job_id"], "nonce": nonce, "cycle": cycle}
+                reply = client.request("submit", submission)
+                h = cycle_hash(cycle)
+                if h <= target:
+                    break
+                elif h <= share_target:
+                    assert_equal(reply["error"], None)
+                    assert_equal(reply["result"], {"share": True, "block": False})
+                    shares += 1
+                else:
+                    assert_rejected(reply, VERIFY_REJECTED, "low-difficulty-share")
+
+                # A solution counts once.
+                assert_rejected(client.request("submit", submission), VERIFY_REJECTED, "duplicate")
+            nonce += 1
+        self.log.info("found a block at nonce %d after %d shares" % (nonce, shares))
+
+        self.log.info("submit a block")
+        assert_equal(reply["error"], None)
+        result = reply["result"]
+        assert_equal(result["share"], True)
+        assert_equal(result["block"], True)
+        assert_equal(result["accepted"], True)
+        assert_equal(node.getbestblockhash(), result["block_hash"])
+        assert_equal(node.getblockcount(), height + 1)
+        assert_equal(node.getblock(result["block_hash"])["nonce"], nonce)
+
+        self.log.info("new job on the new tip")
+        job = client.wait_for_job()
+        assert_equal(job["clean"], True)
+        assert_equal(job["height"], height + 2)
+        assert_equal(job["prev_hash"], result["block_hash"])
+
+        # The solution is a share of a job that is gone with the old tip.
+        assert_rejected(client.request("submit", submission), VERIFY_REJECTED, "stale-job")
+
+        client.close()
+
+if __name__ == '__main__':
+    StratumTest().main()
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017-2021 The Merit Foundation
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Cuckoo Cycle proof-of-work for small graphs.
+
+This mirrors src/cuckoo/cuckoo.cpp. It is far too slow for real edge bits
+but finds cycles on the regtest graphs, which is enough for solvers in tests.
+"""
+
+import hashlib
+import struct
+
+from .siphash import siphash_round
+
+def siphash24(k0, k1, nonce):
+    """SipHash-2-4 specialized to 8 byte nonces the way the Cuckoo graph uses it."""
+    v0 = k0 ^ 0x736f6d6570736575
+    v1 = k1 ^ 0x646f72616e646f6d
+    v2 = k0 ^ 0x6c7967656e657261
+    v3 = k1 ^ 0x7465646279746573 ^ nonce
+    v0, v1, v2, v3 = siphash_round(v0, v1, v2, v3)
+    v0, v1, v2, v3 = siphash_round(v0, v1, v2, v3)
+    v0 ^= nonce
+    v2 ^= 0xff
+    v0, v1, v2, v3 = siphash_round(v0, v1, v2, v3)
+    v0, v1, v2, v3 = siphash_round(v0, v1, v2, v3)
+    v0, v1, v2, v3 = siphash_round(v0, v1, v2, v3)
+    v0, v1, v2, v3 = siphash_round(v0, v1, v2, v3)
+    return v0 ^ v1 ^ v2 ^ v3
+
+def siphash_keys(block_hash_hex):
+    """The siphash keys of the graph of a block, given its hash as getblockhash prints it."""
+    digest = hashlib.blake2b(block_hash_hex.encode('ascii'), digest_size=32).digest()
+    return struct.unpack("<QQ", digest[:16])
+
+def graph_edges(block_hash_hex, edge_bits):
+    """Returns the (u, v) endpoints of every edge, u nodes even and v nodes odd."""
+    k0, k1 = siphash_keys(block_hash_hex)
+    mask = (1 << edge_bits) - 1
+    return [((siphash24(k0, k1, 2 * n) & mask) << 1,
+             (siphash24(k0, k1, 2 * n + 1) & mask) << 1 | 1)
+            for n in range(1 << edge_bits)]
+
+def _path(cuckoo, u):
+    """The node u followed by the nodes its links lead to."""
+    path = [u]
+    u = cuckoo.get(u, 0)
+    while u:
+        path.append(u)
+        u = cuckoo.get(u, 0)
+    return path
+
+def find_cycle(block_hash_hex, edge_bits, proof_size):
+    """Returns the sorted edge indices of a proof_size cycle in the graph of the block, or None.
+
+    The graph is walked the same way FindCycle in src/cuckoo/cuckoo.cpp does,
+    so both find the same cycle."""
+    edges = graph_edges(block_hash_hex, edge_bits)
+    cuckoo = {}
+    for u0, v0 in edges:
+        if u0 == 0:
+            continue
+        us = _path(cuckoo, u0)
+        vs = _path(cuckoo, v0)
+        nu, nv = len(us) - 1, len(vs) - 1
+        if us[nu] == vs[nv]:
+            m = min(nu, nv)
+            nu, nv = nu - m, nv - m
+            while us[nu] != vs[nv]:
+                nu += 1
+                nv += 1
+            if nu + nv + 1 == proof_size:
+                cycle = {(us[0], vs[0])}
+                for i in range(nu):
+                    cycle.add((us[(i + 1) & ~1], us[i | 1]))
+                for i in range(nv):
+                    cycle.add((vs[i | 1], vs[(i + 1) & ~1]))
+                nonces = []
+                for n, e in enumerate(edges):
+                    if e in cycle:
+                        cycle.remove(e)
+                        nonces.append(n)
+                return nonces
+            continue
+        if nu < nv:
+            for i in range(nu, 0, -1):
+                cuckoo[us[i]] = us[i - 1]
+            cuckoo[u0] = v0
+        else:
+            for i in range(nv, 0, -1):
+                cuckoo[vs[i]] = vs[i - 1]
+            cuckoo[v0] = u0
+    return None
+
+def cycle_hash(cycle):
+    """Double SHA256 of the serialized cycle as an integer, to compare against targets."""
+    assert len(cycle) < 253
+    data = struct.pack("<B", len(cycle)) + b"".join(struct.pack("<I", n) for n in cycle)
+    return int.from_bytes(hashlib.sha256(hashlib.sha256(data).digest()).digest(), 'little')
@@ -134,6 +134,9 @@ EXTENDED_SCRIPTS = [
     'maxuploadtarget.py',
     'mempool_packages.py',
     'dbcrash.py',
+    'stratum.py',
+    'lotterycache.py',
+    'referralsnapshot.py',
     # vv Tests less than 2m vv
     'bip68-sequence.py',
     'getblocktemplate_longpoll.py',